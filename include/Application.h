@@ -118,6 +118,10 @@ protected:
 
     VkQueue graphicsQueue;
     VkQueue presentQueue;
+    bool meshShaderSupported = false;
+    bool memoryBudgetSupported = false;
+    bool drawIndirectCountSupported = false;
+    bool cpuDevice = false;
     VkCommandPool commandPool;
     std::vector<VkCommandBuffer> commandBuffers;
 
@@ -142,6 +146,9 @@ protected:
 
     virtual void cleanup_extended() = 0;
 
+    // Called after the swap chain and its depth buffer were created again, the device is idle
+    virtual void recreate_swap_chain_extended() = 0;
+
     void init_window();
 
     void create_instance();
@@ -165,6 +172,7 @@ protected:
     void createSurface();
 
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    bool checkOptionalDeviceExtensionSupport(VkPhysicalDevice device, const char* extensionName);
 
     SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
@@ -23,6 +23,8 @@ public:
 	glm::vec3 right;
 	glm::vec3 worldUp;
 
+	float fovY = 45.0f;
+
 	float moveSpeed = 1000.0;
 	float deltaTime;
 
@@ -0,0 +1,111 @@
+#ifndef DEFERRED_RENDERER_H
+#define DEFERRED_RENDERER_H
+
+#include "Helper.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Settings of the shading pass, the ambient occlusion ones match MeshPushConstants
+struct DeferredShadingPushConstants {
+	glm::mat4 inverseViewProjection;
+	float occlusionDecayFactor;
+	VkBool32 ambientOcclusionEnabled;
+	VkBool32 occlusionVisualizationEnabled;
+	float surfaceOffset;
+	float coneCutoff;
+	// Set by DeferredRenderer::shade
+	uint32_t ambientOcclusionScale;
+};
+
+// Deferred alternative to shading in the main pass. The geometry pass writes albedo and world normals next to the
+// depth buffer, then a compute pass lights every pixel once, one workgroup per screen tile, with the same shadowing
+// and voxel cone traced occlusion as main.frag. The result is drawn into the swap chain render pass.
+//
+// Occlusion can be traced at half or quarter resolution instead, once per block of pixels in a pass of its own. The
+// shading pass then upsamples it with weights that follow depth and normals.
+//
+// The geometry pipeline belongs to the renderer since it shares the main pass's layout. The shading pipeline reads
+// the renderer's, shadow map's and voxelizer's descriptor sets, so it is created and destroyed with them. Tied to the
+// depth buffer it was created for, resize has to be called when the swap chain is created again.
+class DeferredRenderer
+{
+public:
+	static const uint32_t TILE_SIZE = 8;
+
+	static const VkFormat ALBEDO_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+	static const VkFormat NORMAL_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+	static const VkFormat COLOR_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+	static const VkFormat AMBIENT_OCCLUSION_FORMAT = VK_FORMAT_R32_SFLOAT;
+	static const uint32_t MAX_AMBIENT_OCCLUSION_SCALE = 4;
+
+	std::shared_ptr<Helper> helper;
+
+	// Pixels per occlusion texel on a side: 1, 2 or MAX_AMBIENT_OCCLUSION_SCALE
+	uint32_t ambientOcclusionScale = 2;
+
+	// Clears the G-buffer, the second one draws over it for the second occlusion culling phase. Both leave every
+	// attachment in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+	VkRenderPass geometryRenderPass;
+	VkRenderPass geometryLoadRenderPass;
+
+	// The composite pipeline is created for the swap chain render pass
+	DeferredRenderer(std::shared_ptr<Helper> helper, VkImageView depthView, VkExtent2D extent, VkRenderPass swapChainRenderPass);
+	~DeferredRenderer();
+
+	void resize(VkImageView depthView, VkExtent2D extent);
+
+	// The renderer's, shadow map's, voxel mip levels' and voxel grid's layouts, bound as sets 0, 2, 3 and 4
+	void createShadingPipeline(const std::vector<VkDescriptorSetLayout>& sceneLayouts);
+	void destroyShadingPipeline();
+
+	void beginGeometryPass(VkCommandBuffer commandBuffer, bool clear);
+	void endGeometryPass(VkCommandBuffer commandBuffer);
+	// The sets of createShadingPipeline's layouts, in the same order
+	void shade(VkCommandBuffer commandBuffer, const std::vector<VkDescriptorSet>& sceneSets, const DeferredShadingPushConstants& pushConstants);
+	// Inside the swap chain render pass, with its viewport set
+	void composite(VkCommandBuffer commandBuffer);
+
+private:
+	VkExtent2D extent;
+
+	VkImage albedoImage;
+	VkDeviceMemory albedoImageMemory;
+	VkImageView albedoImageView;
+	VkImage normalImage;
+	VkDeviceMemory normalImageMemory;
+	VkImageView normalImageView;
+	VkImage colorImage;
+	VkDeviceMemory colorImageMemory;
+	VkImageView colorImageView;
+	// Sized for half resolution, quarter resolution uses its top left quarter
+	VkImage ambientOcclusionImage;
+	VkDeviceMemory ambientOcclusionImageMemory;
+	VkImageView ambientOcclusionImageView;
+	VkFramebuffer framebuffer;
+	VkSampler sampler;
+
+	// The G-buffer, the shaded image and the reduced resolution occlusion, shared by both compute pipelines
+	VkDescriptorSetLayout shadingDescriptorSetLayout;
+	VkDescriptorSet shadingDescriptorSet;
+	VkPipelineLayout shadingPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline shadingPipeline = VK_NULL_HANDLE;
+	VkPipeline ambientOcclusionPipeline = VK_NULL_HANDLE;
+
+	VkDescriptorSetLayout compositeDescriptorSetLayout;
+	VkDescriptorSet compositeDescriptorSet;
+	VkPipelineLayout compositePipelineLayout;
+	VkPipeline compositePipeline;
+
+	void createRenderPasses();
+	void createImages(VkImageView depthView);
+	void destroyImages();
+	void createDescriptorSets();
+	void writeDescriptorSets(VkImageView depthView);
+	void createCompositePipeline(VkRenderPass swapChainRenderPass);
+	VkPipeline createComputePipeline(const std::string& shaderPath);
+};
+
+#endif // !DEFERRED_RENDERER_H
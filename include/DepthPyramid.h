@@ -0,0 +1,56 @@
+#ifndef DEPTH_PYRAMID_H
+#define DEPTH_PYRAMID_H
+
+#include "Helper.h"
+
+#include <memory>
+#include <vector>
+
+// Hierarchical depth of the main pass. Every texel of level 0 holds the farthest depth of a 2x2 block of the depth
+// buffer, and every further level the farthest of a 2x2 block of the level below it. Level 0 is half the depth buffer
+// rounded up to powers of two, so the blocks cover the whole depth buffer and texel x of level n covers pixels
+// x * 2^(n+1) onwards. Texels past the depth buffer repeat its edge and are never read on their own.
+//
+// Tied to the depth buffer it was created for, it has to be created again when the swap chain is.
+class DepthPyramid
+{
+public:
+	static const uint32_t WORKGROUP_SIZE = 8;
+
+	std::shared_ptr<Helper> helper;
+
+	DepthPyramid(std::shared_ptr<Helper> helper, VkImageView depthView, VkExtent2D depthExtent);
+	~DepthPyramid();
+
+	// The depth buffer has to be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, the pyramid is left in
+	// VK_IMAGE_LAYOUT_GENERAL and can be read by compute shaders afterwards
+	void build(VkCommandBuffer commandBuffer);
+
+	// Every level, sampled with texelFetch
+	VkImageView getView() const;
+	VkSampler getSampler() const;
+	uint32_t getLevelCount() const;
+	VkExtent2D getDepthExtent() const;
+
+private:
+	VkImage image;
+	VkDeviceMemory memory;
+	VkImageView view;
+	std::vector<VkImageView> levelViews;
+	std::vector<VkExtent2D> levelExtents;
+	VkSampler sampler;
+
+	// One set per level, reading the level below it or the depth buffer and writing the level
+	VkDescriptorSetLayout descriptorSetLayout;
+	std::vector<VkDescriptorSet> descriptorSets;
+	VkPipelineLayout pipelineLayout;
+	VkPipeline pipeline;
+
+	VkExtent2D depthExtent;
+
+	void createImage();
+	void createDescriptorSets(VkImageView depthView);
+	void createPipeline();
+};
+
+#endif // !DEPTH_PYRAMID_H
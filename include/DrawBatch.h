@@ -0,0 +1,169 @@
+#ifndef DRAW_BATCH_H
+#define DRAW_BATCH_H
+
+#include "Helper.h"
+#include "Mesh.h"
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+enum DrawBatchPass
+{
+	DRAW_BATCH_MAIN_PASS,
+	DRAW_BATCH_SHADOW_PASS,
+	DRAW_BATCH_VOXELIZATION_PASS,
+	DRAW_BATCH_PASS_COUNT
+};
+
+// Per draw data, one entry per mesh of every render object. Shaders find it through the instance buffer.
+struct DrawData {
+	// Index of the world matrix in the TransformSystem's buffer
+	uint32_t transformIndex;
+	// Slot in the texture array, 0 is the placeholder
+	uint32_t textureIndex;
+	// See TextureStreamer
+	uint32_t textureFeedbackSlot;
+	uint32_t textureBaseMip;
+};
+
+// Collects the draws of a frame and records each pass as one multi-draw indirect per geometry arena block.
+//
+// Every mesh drawn in a frame gets a DrawData entry, which replaces the per object push constants and the per material
+// descriptor sets. Shaders find the entry through the instance buffer at gl_InstanceIndex and sample its material
+// texture from one bindless array. Model matrices are read from the TransformSystem's buffer, bound next to the
+// others, at the entry's transform index.
+//
+// Render objects sharing a model add commands for the same geometry. These are merged into one instanced command whose
+// instances are consecutive entries of the instance buffer, so every mesh level is drawn once per pass however many
+// objects use it. The instance buffer starts with one entry per draw pointing at itself, which lets commands built
+// elsewhere, such as the MeshletCuller's, use a draw index as their firstInstance.
+//
+// Rebuilt every frame, begin is called after the frame's fence wait. The passes that rarely change are placed first in
+// the command buffer, so their commands keep their position while the main pass's LODs change.
+class DrawBatch
+{
+public:
+	static const uint32_t MAX_TEXTURES = 1024;
+
+	// DrawData buffer, the texture array, the instance buffer and the transform buffer
+	inline static VkDescriptorSetLayout descriptorSetLayout;
+	inline static bool descriptorSetLayoutCreated = false;
+	// Size of the texture array, MAX_TEXTURES unless the device allows fewer
+	inline static uint32_t textureCapacity = 0;
+
+	std::shared_ptr<Helper> helper;
+	// Merge commands that draw the same geometry into instanced ones
+	bool instancing = true;
+
+	DrawBatch(std::shared_ptr<Helper> helper);
+	~DrawBatch();
+
+	void begin(uint32_t currentFrame);
+	// Returns the draw index, texture may be null
+	uint32_t addDraw(uint32_t transform, const std::shared_ptr<Texture>& texture);
+	void addCommand(DrawBatchPass pass, uint32_t drawIndex, const Mesh& mesh, const MeshLod& lod);
+	// Uploads the draws and commands and updates the texture array, after the TransformSystem uploaded the frame
+	void end();
+
+	// The DrawData and transform buffers are also visible to compute, see DrawCuller
+	void bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set, VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS);
+	void draw(VkCommandBuffer commandBuffer, DrawBatchPass pass);
+
+	uint32_t getDrawCount() const;
+	uint32_t getTextureCount() const;
+	// Indirect draw calls recorded for the pass
+	uint32_t getMultiDrawCount(DrawBatchPass pass) const;
+	// Commands of the pass after merging, and the instances they draw
+	uint32_t getCommandCount(DrawBatchPass pass) const;
+	uint32_t getInstanceCount(DrawBatchPass pass) const;
+	// Changes whenever draw would record different commands for the pass in the current frame, or commands recorded
+	// earlier refer to buffers or descriptors that were replaced or written since. See StaticPassCache.
+	uint64_t getPassVersion(DrawBatchPass pass) const;
+
+	static void createDescriptorSetLayout(Helper& helper);
+	static void destroyDescriptorSetLayout(Helper& helper);
+
+private:
+	// One draw of a mesh level, the geometry fields are the merge key
+	struct Instance
+	{
+		uint32_t block;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		int32_t vertexOffset;
+		uint32_t drawIndex;
+	};
+
+	// Commands of a pass that share a geometry arena block
+	struct Run
+	{
+		uint32_t block;
+		uint32_t firstCommand;
+		uint32_t commandCount;
+	};
+
+	struct FrameResources
+	{
+		VkBuffer drawBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory drawBufferMemory = VK_NULL_HANDLE;
+		void* drawBufferMapped = nullptr;
+		uint32_t drawCapacity = 0;
+
+		VkBuffer commandBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory commandBufferMemory = VK_NULL_HANDLE;
+		void* commandBufferMapped = nullptr;
+		uint32_t commandCapacity = 0;
+
+		VkBuffer instanceBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory instanceBufferMemory = VK_NULL_HANDLE;
+		void* instanceBufferMapped = nullptr;
+		uint32_t instanceCapacity = 0;
+
+		VkDescriptorSet descriptorSet;
+		// TransformSystem buffer the set refers to
+		VkBuffer transformBuffer = VK_NULL_HANDLE;
+		// Texture each array slot was last written with, kept alive while the set refers to it
+		std::vector<std::shared_ptr<Texture>> slotTextures;
+		std::vector<VkImageView> slotViews;
+
+		// Set whenever the descriptor set is written or a buffer is replaced
+		bool resourcesChanged = true;
+		uint64_t arenaGeneration = 0;
+		std::array<std::vector<Run>, DRAW_BATCH_PASS_COUNT> recordedRuns;
+		std::array<uint32_t, DRAW_BATCH_PASS_COUNT> recordedFirstCommands{};
+		std::array<uint64_t, DRAW_BATCH_PASS_COUNT> passVersions{};
+	};
+
+	VkDescriptorPool descriptorPool;
+	VkSampler sampler;
+	std::shared_ptr<Texture> placeholder;
+	std::vector<FrameResources> frames;
+	uint32_t currentFrame = 0;
+
+	std::vector<DrawData> draws;
+	std::array<std::vector<Instance>, DRAW_BATCH_PASS_COUNT> instances;
+	std::vector<VkDrawIndexedIndirectCommand> commands;
+	std::vector<uint32_t> instanceDrawIndices;
+	std::array<std::vector<Run>, DRAW_BATCH_PASS_COUNT> runs;
+	// Position of each pass's commands in the frame's command buffer
+	std::array<uint32_t, DRAW_BATCH_PASS_COUNT> firstCommands{};
+	std::array<uint32_t, DRAW_BATCH_PASS_COUNT> commandCounts{};
+
+	std::vector<std::shared_ptr<Texture>> textures;
+	std::unordered_map<const Texture*, uint32_t> textureSlots;
+
+	void createFrameResources();
+	void createDrawBuffer(FrameResources& frame, uint32_t capacity);
+	void createCommandBuffer(FrameResources& frame, uint32_t capacity);
+	void createInstanceBuffer(FrameResources& frame, uint32_t capacity);
+	void buildCommands(DrawBatchPass pass);
+	void destroyBuffers(FrameResources& frame);
+	void updateTextures(FrameResources& frame);
+	void updateTransformBuffer(FrameResources& frame);
+	void updatePassVersions(FrameResources& frame);
+};
+
+#endif // !DRAW_BATCH_H
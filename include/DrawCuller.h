@@ -0,0 +1,164 @@
+#ifndef DRAW_CULLER_H
+#define DRAW_CULLER_H
+
+#include "Helper.h"
+#include "Mesh.h"
+#include "DrawBatch.h"
+#include "DepthPyramid.h"
+
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+enum DrawCullPhase
+{
+	// Draws visible in the previous frame, or every draw in the frustum without occlusion culling
+	DRAW_CULL_FIRST_PHASE,
+	// Draws found visible against the depth pyramid of the first phase that it did not draw
+	DRAW_CULL_SECOND_PHASE,
+	DRAW_CULL_PHASE_COUNT
+};
+
+// One main pass draw, the bounds are in mesh space
+struct DrawCullInput {
+	glm::vec3 boundsMin;
+	uint32_t drawIndex;
+	glm::vec3 boundsMax;
+	// Geometry arena block run the draw belongs to, also the index of the run's draw count
+	uint32_t run;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	// First output command of the run
+	uint32_t firstCommand;
+};
+
+struct DrawCullPushConstants {
+	glm::mat4 viewProjection;
+	glm::vec2 depthExtent;
+	uint32_t inputCount;
+	uint32_t phase;
+	// Where the phase's commands and draw counts start
+	uint32_t commandOffset;
+	uint32_t countOffset;
+	VkBool32 occlusionCulling;
+	uint32_t depthPyramidLevelCount;
+};
+
+// Culls the main pass on the GPU. A compute pass tests the world space bounds of every draw against the camera frustum
+// and appends the visible ones to their block run's range of the output commands, which are drawn with
+// vkCmdDrawIndexedIndirectCount. The CPU only lists the draws, it never tests them.
+//
+// With occlusion culling the main pass is drawn in two phases. The first draws what was visible in the previous
+// frame, a depth pyramid is built from its depth, and the second tests every draw in the frustum against the pyramid,
+// drawing the visible ones the first phase skipped. Visibility is stored per draw index for the next frame, so a mesh
+// that comes into view is drawn in the same frame instead of one frame late.
+//
+// Every output command draws a single instance whose firstInstance is the draw index, which the identity prefix of the
+// DrawBatch's instance buffer resolves to the draw itself. Only created when the device supports drawIndirectCount.
+class DrawCuller
+{
+public:
+	static const uint32_t WORKGROUP_SIZE = 64;
+
+	// Inputs, output commands, draw counts, visibility and the depth pyramid
+	inline static VkDescriptorSetLayout descriptorSetLayout;
+	inline static bool descriptorSetLayoutCreated = false;
+
+	std::shared_ptr<Helper> helper;
+	bool occlusionCulling = true;
+
+	VkPipelineLayout pipelineLayout;
+	VkPipeline pipeline;
+
+	DrawCuller(std::shared_ptr<Helper> helper, VkImageView depthView, VkExtent2D depthExtent);
+	~DrawCuller();
+
+	// After the swap chain was created again, while the device is idle
+	void resize(VkImageView depthView, VkExtent2D depthExtent);
+
+	void begin(uint32_t currentFrame);
+	void addDraw(uint32_t drawIndex, const Mesh& mesh, const MeshLod& lod);
+	void end();
+
+	// First phase, recorded outside of render passes after the DrawBatch's end
+	void cull(VkCommandBuffer commandBuffer, DrawBatch& drawBatch, const glm::mat4& viewProjection);
+	// Second phase, after the first phase was drawn and its depth buffer transitioned to
+	// VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	void cullOccluded(VkCommandBuffer commandBuffer, DrawBatch& drawBatch, const glm::mat4& viewProjection);
+	// The DrawBatch set has to be bound
+	void draw(VkCommandBuffer commandBuffer, DrawCullPhase phase);
+
+	// Draws handed to the GPU in the current frame
+	uint32_t getDrawCount() const;
+
+	static void createDescriptorSetLayout(Helper& helper);
+	static void destroyDescriptorSetLayout(Helper& helper);
+
+private:
+	// Consecutive draws that share a geometry arena block
+	struct Run
+	{
+		uint32_t block;
+		uint32_t firstCommand;
+		uint32_t commandCount;
+	};
+
+	struct FrameResources
+	{
+		VkBuffer inputBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory inputBufferMemory = VK_NULL_HANDLE;
+		void* inputBufferMapped = nullptr;
+
+		// Written by the culling passes, each phase has the capacity of the inputs
+		VkBuffer commandBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory commandBufferMemory = VK_NULL_HANDLE;
+		uint32_t drawCapacity = 0;
+
+		// Each phase has a count per run
+		VkBuffer countBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory countBufferMemory = VK_NULL_HANDLE;
+		uint32_t runCapacity = 0;
+
+		VkDescriptorSet descriptorSet;
+		// Visibility buffer the set refers to
+		VkBuffer visibilityBuffer = VK_NULL_HANDLE;
+	};
+
+	struct RetiredBuffer
+	{
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		uint32_t framesLeft;
+	};
+
+	std::vector<FrameResources> frames;
+	uint32_t currentFrame = 0;
+
+	std::unique_ptr<DepthPyramid> depthPyramid;
+
+	// Indexed by draw index and shared by every frame, the first phase of a frame reads what the second phase of the
+	// previous one wrote. Replaced buffers are kept until the frames referring to them are done.
+	VkBuffer visibilityBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory visibilityBufferMemory = VK_NULL_HANDLE;
+	uint32_t visibilityCapacity = 0;
+	std::vector<RetiredBuffer> retiredVisibilityBuffers;
+
+	std::vector<DrawCullInput> inputs;
+	std::vector<Run> runs;
+	// Largest draw index added plus one
+	uint32_t visibilityCount = 0;
+
+	void createFrameResources();
+	void createDrawBuffers(FrameResources& frame, uint32_t capacity);
+	void createCountBuffer(FrameResources& frame, uint32_t capacity);
+	void createVisibilityBuffer(uint32_t capacity);
+	void destroyDrawBuffers(FrameResources& frame);
+	void destroyCountBuffer(FrameResources& frame);
+	void writeDescriptorSet(FrameResources& frame);
+	void writeDepthPyramidDescriptor(FrameResources& frame);
+	void createPipeline();
+	void dispatch(VkCommandBuffer commandBuffer, DrawBatch& drawBatch, const glm::mat4& viewProjection, DrawCullPhase phase);
+};
+
+#endif // !DRAW_CULLER_H
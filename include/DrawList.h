@@ -0,0 +1,43 @@
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include "Mesh.h"
+#include "RenderObject.h"
+
+#include <memory>
+#include <vector>
+
+struct DrawListEntry {
+	RenderObject* renderObject;
+	const Mesh* mesh;
+	uint32_t renderObjectIndex;
+	uint32_t meshIndex;
+	// Position of the mesh in scene order, which is its DrawBatch draw index and MeshletCuller slot
+	uint32_t drawIndex;
+};
+
+// Every mesh of every render object, sorted so consecutive entries share as much bound state as possible: the
+// geometry arena block first, then the mesh, then its material. Passes walk it instead of the render objects.
+//
+// Each pass uses a single pipeline, so pipelines are not part of the key. Built only when the render objects or their
+// meshes change; transforms and LODs are still read every frame. Geometry relocated by defragmentation leaves the order
+// stale but valid until the next build.
+class DrawList
+{
+public:
+	void build(const std::vector<std::shared_ptr<RenderObject>>& renderObjects);
+
+	const std::vector<DrawListEntry>& getEntries() const;
+	// Times the mesh or the material changes between consecutive entries
+	uint32_t getMeshChangeCount() const;
+	uint32_t getMaterialChangeCount() const;
+	uint32_t getBuildCount() const;
+
+private:
+	std::vector<DrawListEntry> entries;
+	uint32_t meshChangeCount = 0;
+	uint32_t materialChangeCount = 0;
+	uint32_t buildCount = 0;
+};
+
+#endif // !DRAW_LIST_H
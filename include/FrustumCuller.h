@@ -0,0 +1,47 @@
+#ifndef FRUSTUM_CULLER_H
+#define FRUSTUM_CULLER_H
+
+#include "DrawList.h"
+#include "SceneBvh.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Tests the bounding box of every draw list entry against the camera frustum, four boxes at a time with SSE where
+// available, so the main pass skips meshes that are out of view before any of their draws are recorded.
+//
+// World space boxes are stored as structure of arrays, center and half extent, and are only recomputed when the draw
+// list was rebuilt or a transform changed.
+class FrustumCuller
+{
+public:
+	bool enabled = true;
+
+	// With a scene BVH whole subtrees are accepted or rejected at once, the BVH has to be up to date
+	void cull(const DrawList& drawList, const glm::mat4& viewProjection, bool transformsChanged, const SceneBvh* bvh = nullptr);
+	// Indexed like the draw list's entries, every entry is visible while culling is disabled
+	bool isVisible(uint32_t entry) const;
+
+	uint32_t getVisibleCount() const;
+
+	// Gribb-Hartmann plane extraction, pointing inwards, depth is in the 0..1 range
+	static std::array<glm::vec4, 6> extractPlanes(const glm::mat4& viewProjection);
+	// CPU time of the last cull, in milliseconds
+	float getCullTime() const;
+
+private:
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+	std::vector<uint8_t> visible;
+	std::vector<uint32_t> visibleEntries;
+
+	uint32_t drawListBuildCount = UINT32_MAX;
+	uint32_t visibleCount = 0;
+	float cullTime = 0.0f;
+
+	void updateBounds(const DrawList& drawList);
+};
+
+#endif // !FRUSTUM_CULLER_H
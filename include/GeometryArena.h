@@ -0,0 +1,75 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+class Helper;
+
+struct GeometryAllocation {
+	uint32_t block = UINT32_MAX;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+
+	bool isValid() const { return block != UINT32_MAX; }
+	// Closer to the start of the arena, where defragmentation packs allocations
+	bool isBelow(const GeometryAllocation& other) const { return block < other.block || (block == other.block && offset < other.offset); }
+};
+
+// Vertex and index data of every mesh, packed into a few large buffers so a pass can draw many meshes from one
+// vertex and index buffer binding.
+//
+// Blocks are created on demand and destroyed once their last range is freed. Callers only free ranges no frame in
+// flight reads anymore, through ResidencyManager::retire if needed. Main thread only.
+class GeometryArena
+{
+public:
+	// Offsets are multiples of this, which keeps them valid storage buffer offsets and whole vertices and indices
+	static const VkDeviceSize ALIGNMENT = 256;
+
+	VkDeviceSize blockSize = 128ull * 1024ull * 1024ull;
+
+	GeometryArena(Helper& helper);
+	~GeometryArena();
+
+	static VkDeviceSize align(VkDeviceSize size);
+
+	// First fit in the lowest block with room, a new block is created if none has any
+	GeometryAllocation allocate(VkDeviceSize size);
+	// Only returns a range below limit, invalid if there is none
+	GeometryAllocation allocateBelow(VkDeviceSize size, const GeometryAllocation& limit);
+	void free(const GeometryAllocation& allocation);
+	// Copies data to offset bytes into the allocation and waits for the copy
+	void upload(const GeometryAllocation& allocation, VkDeviceSize offset, const void* data, VkDeviceSize size);
+
+	// Usable as vertex, index and storage buffer
+	VkBuffer getBuffer(uint32_t block) const;
+	uint32_t getBlockCount() const;
+	VkDeviceSize getAllocatedSize() const;
+	VkDeviceSize getUsedSize() const;
+	// Incremented whenever a block is created or destroyed
+	uint64_t getGeneration() const;
+
+private:
+	struct Block
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		VkDeviceSize used = 0;
+		// Offset and size of every free range
+		std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+	};
+
+	Helper& helper;
+	// Destroyed blocks leave an empty slot so block indices stay valid
+	std::vector<Block> blocks;
+	uint64_t generation = 0;
+
+	GeometryAllocation findRange(VkDeviceSize size, const GeometryAllocation* limit);
+	uint32_t createBlock(VkDeviceSize size);
+};
+
+#endif // !GEOMETRY_ARENA_H
@@ -17,7 +17,8 @@ public:
 	GeometryVoxelizer(std::shared_ptr<Helper> helper, uint32_t voxelsPerSide, glm::vec4 corner1, glm::vec4 corner2);
 	~GeometryVoxelizer();
 
-	void beginVoxelization(VkCommandBuffer commandBuffer, uint32_t currentFrame) override;
+	void beginVoxelization(VkCommandBuffer commandBuffer, uint32_t currentFrame, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE) override;
+	void bindVoxelizationState(VkCommandBuffer commandBuffer, uint32_t currentFrame) override;
 	void voxelize(VkCommandBuffer commandBuffer, uint32_t currentFrame) override;
 	void endVoxelization(VkCommandBuffer commandBuffer, uint32_t currentFrame) override;
 
@@ -9,8 +9,14 @@
 #include <cmath>
 #include <iostream>
 #include <vector>
+#include <memory>
 
 #include "Camera.h"
+#include "ThreadPool.h"
+#include "ResidencyManager.h"
+#include "GeometryArena.h"
+#include "TextureCache.h"
+#include "TransformSystem.h"
 
 class Helper
 {
@@ -27,16 +33,47 @@ public:
 
 	const int MAX_FRAMES_IN_FLIGHT;
 
+	// Set when VK_EXT_mesh_shader was enabled on the device
+	bool meshShaderSupported = false;
+	PFN_vkCmdDrawMeshTasksEXT cmdDrawMeshTasksEXT = nullptr;
+	// Set when VK_EXT_memory_budget was enabled on the device
+	bool memoryBudgetSupported = false;
+	// Set when the drawIndirectCount feature was enabled on the device
+	bool drawIndirectCountSupported = false;
+	// Set when the device is a software implementation such as lavapipe, GPU work then competes with the CPU
+	bool cpuDevice = false;
+
 	std::shared_ptr<Camera> camera;
 
+	// Shared by CPU side work such as model loading
+	std::shared_ptr<ThreadPool> threadPool;
+
+	// Evictable device memory, consulted before an allocation is given up on
+	std::shared_ptr<ResidencyManager> residency;
+
+	// Vertex and index data of all meshes
+	std::shared_ptr<GeometryArena> geometryArena;
+
+	// Textures and samplers shared by all models
+	std::shared_ptr<TextureCache> textureCache;
+
+	// World transforms of all render objects
+	std::shared_ptr<TransformSystem> transforms;
+
 	Helper(int MAX_FRAMES_IN_FLIGHT);
 
 	VkCommandBuffer beginSingleTimeCommands();
 	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+	// Evicts through the residency manager and retries when the device is out of memory
+	VkResult allocateMemory(const VkMemoryAllocateInfo& allocInfo, VkDeviceMemory& memory);
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
+	void createDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
 	void createTextureImage(std::string path, VkImage& textureImage, VkDeviceMemory& textureImageMemory, VkImageView& textureImageView, uint32_t* mipLevels = nullptr);
+	void createTextureImage(const TextureData& texture, VkImage& textureImage, VkDeviceMemory& textureImageMemory, VkImageView& textureImageView, uint32_t* mipLevels = nullptr);
+	// Only touches the file system, safe to call from worker threads
+	TextureData loadTextureData(const std::string& path);
 	void createImage(uint32_t width, uint32_t height, uint32_t depth, uint32_t mipLevels, VkFormat format, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
 	VkImageView createImageView(VkImage image, uint32_t baseMipLevel, uint32_t mipLevels, VkFormat format, VkImageAspectFlagBits aspectFlags, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D);
 	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
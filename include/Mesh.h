@@ -2,6 +2,7 @@
 #define MESH_H
 
 #include "Helper.h"
+#include "Meshlet.h"
 
 #include <iostream>
 #include <assimp/Importer.hpp>      // C++ importer interface
@@ -13,6 +14,12 @@
 #include <glm/glm.hpp>
 #include <array>
 #include <memory>
+#include <string>
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <exception>
+#include <limits>
 
 struct Vertex {
 	glm::vec3 pos;
@@ -52,6 +59,31 @@ struct Vertex {
 	}
 };
 
+struct MeshLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	// Simplification error in model space units, 0 for the full detail level
+	float error;
+	// Range of this level in the mesh's meshlets
+	uint32_t meshletOffset;
+	uint32_t meshletCount;
+};
+
+// CPU side geometry of a mesh. It is filled on worker threads, the GPU buffers are created from it afterwards.
+struct MeshData {
+	uint32_t materialIndex = 0;
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<MeshLod> lods;
+
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint32_t> meshletTriangles;
+};
+
 class Mesh
 {
 public:
@@ -61,77 +93,146 @@ public:
 	std::vector<uint32_t> indices;
 	uint32_t materialIndex;
 
-	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
-	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
+	// All levels live in the one index buffer, finest first
+	std::vector<MeshLod> lods;
 
-	Mesh(std::shared_ptr<Helper> helper, std::vector<Vertex>&& vertices, std::vector<uint32_t>&& indices, uint32_t materialIndex);
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	glm::vec3 boundingSphereCenter;
+	float boundingSphereRadius;
+
+	std::vector<Meshlet> meshlets;
+	std::vector<uint32_t> meshletVertices;
+	std::vector<uint32_t> meshletTriangles;
+	// Index of this mesh's first meshlet in the model's meshlet buffer
+	uint32_t meshletBufferOffset = 0;
+
+	// Vertices followed by indices in one range of helper->geometryArena, whose block is bound as vertex and index buffer
+	GeometryAllocation geometry;
+	// Position of the mesh in its block, in vertices and indices, for the vertexOffset and firstIndex of draws
+	int32_t vertexOffset = 0;
+	uint32_t firstIndex = 0;
+
+	// The geometry may be evicted under memory pressure, the vertices and indices above stay on the host
+	ResidencyManager::Handle residencyHandle;
+	bool resident = false;
+
+	Mesh(std::shared_ptr<Helper> helper, MeshData&& data);
 	~Mesh();
 
+	// Re-uploads evicted geometry and marks it used this frame.
+	// Returns true if the geometry was uploaded again or moved since the last call.
+	bool makeResident();
+	VkDeviceSize getBufferSize() const;
+	VkBuffer getBuffer() const;
+
+	// Coarsest level whose error does not exceed maxError
+	const MeshLod& selectLod(float maxError) const;
+
+	// Adds the full detail level if there are no levels yet and splits every level into meshlets
+	static void buildMeshlets(MeshData& data);
+
 private:
-	void createVertexBuffer();
-	void createIndexBuffer();
+	VkDeviceSize getIndexDataOffset() const;
+	void uploadGeometry(const GeometryAllocation& allocation);
+	void setGeometry(const GeometryAllocation& allocation);
+	VkDeviceSize relocateGeometry();
+
+	bool geometryReplaced = false;
+};
+
+struct ModelLoadOptions {
+	// Reorder triangles and vertices for the post-transform cache, overdraw and vertex fetch
+	bool optimizeMeshes = true;
+	// Store the processed geometry next to the source file and reuse it on later loads
+	bool useMeshCache = true;
+	float overdrawThreshold = 1.05f;
+	// Append simplified index levels, each with about lodReductionRatio of the previous level's triangles
+	bool generateLods = true;
+	uint32_t maxLodCount = 5;
+	float lodReductionRatio = 0.5f;
+	// Largest simplification error allowed, relative to the mesh's bounding radius
+	float lodMaxRelativeError = 0.1f;
+	// Assimp post processing. Tangents are not used by any pass, so aiProcess_CalcTangentSpace is left out.
+	unsigned int postProcessFlags = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_SortByPType;
+	// Return from the constructor right away and load on the thread pool, see Model::update
+	bool asynchronous = false;
+	// Load textures at a low resolution and leave the finer levels to the TextureStreamer
+	bool streamTextures = false;
 };
 
 class Model
 {
 public:
-	inline static VkDescriptorSetLayout descriptorSetLayout;
-	inline static bool descriptorSetLayoutCreated = false;
-
 	std::shared_ptr<Helper> helper;
 	std::string path;
 	std::string directory;
 
 	std::vector<std::unique_ptr<Mesh>> meshes;
-	std::vector<VkImage> textureImages;
-	std::vector<VkDeviceMemory> textureImagesMemory;
-	std::vector<VkImageView> textureImageViews;
-	VkSampler textureSampler;
-	std::vector<VkDescriptorSet> descriptorSets;
-	std::vector<uint32_t> mipLevels;
-
-	Model(std::string path, std::shared_ptr<Helper> helper);
-	~Model();
+	// Per material, shared with other materials and models through helper->textureCache.
+	// Empty until the texture is loaded, draws use a placeholder until then.
+	std::vector<std::shared_ptr<Texture>> textures;
 
-	inline static void createDescriptorSetLayouts(Helper& helper)
-	{
-		if (descriptorSetLayoutCreated)
-			return;
-
-		descriptorSetLayoutCreated = true;
-
-		VkDescriptorSetLayoutBinding dsLayoutBinding = {};
-		dsLayoutBinding.binding = 0;
-		dsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		dsLayoutBinding.descriptorCount = 1;
-		dsLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-		dsLayoutBinding.pImmutableSamplers = nullptr;
-
-		VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-		layoutInfo.bindingCount = 1;
-		layoutInfo.pBindings = &dsLayoutBinding;
-
-		if (vkCreateDescriptorSetLayout(helper.device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create descriptor set layout");
-		}
-	}
+	// Meshlets of all meshes, vertex and triangle offsets are relative to the start of the model's buffers.
+	// Only created once every mesh is resident.
+	VkBuffer meshletBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory meshletBufferMemory = VK_NULL_HANDLE;
+	VkBuffer meshletVertexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory meshletVertexBufferMemory = VK_NULL_HANDLE;
+	VkBuffer meshletTriangleBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory meshletTriangleBufferMemory = VK_NULL_HANDLE;
 
-	inline static VkDescriptorSetLayout getDescriptorSetLayout()
-	{
-		return descriptorSetLayout;
-	}
+	ModelLoadOptions options;
 
-	inline static void destroyDescriptorSetLayout(Helper& helper)
-	{
-		if (descriptorSetLayoutCreated)
-		{
-			vkDestroyDescriptorSetLayout(helper.device, descriptorSetLayout, nullptr);
-			descriptorSetLayoutCreated = false;
-		}
-	}
+	// Bytes of geometry and texture memory created so far, used for streaming budgets
+	VkDeviceSize memorySize = 0;
+
+	Model(std::string path, std::shared_ptr<Helper> helper, ModelLoadOptions options = ModelLoadOptions());
+	~Model();
+
+	// Creates the GPU resources for meshes and textures the loader has finished, at most uploadBudget of them.
+	// Until then meshes are missing from the meshes list and materials use a placeholder texture.
+	// Returns true once the whole model is resident. Rethrows loader errors.
+	bool update(uint32_t uploadBudget = std::numeric_limits<uint32_t>::max());
+	bool isLoaded() const;
+	// Restores evicted mesh geometry and marks it and the textures used this frame.
+	// Call once per frame for every drawn model before recording. Returns true if a mesh's geometry moved.
+	bool makeResident();
+
+private:
+	// Shared with the loader, guarded by loadMutex
+	std::mutex loadMutex;
+	std::vector<std::string> materialTexturePaths;
+	bool materialsPublished = false;
+	std::vector<MeshData> pendingMeshes;
+	// Decoded textures by path, empty if the cache already had the texture when the loader got to it
+	std::vector<std::pair<std::string, TextureData>> pendingTextures;
+	bool loaderFinished = false;
+	std::exception_ptr loadException;
+
+	std::atomic<bool> cancelLoad{ false };
+	std::future<void> loadTask;
+	bool cacheHit = false;
+	bool materialsCreated = false;
+	bool loaded = false;
+
+	void load();
+	void createMaterials();
+	TextureLoadParams getTextureLoadParams() const;
+
+	inline static const uint32_t MESH_CACHE_MAGIC = 0x4D434356; // "VCCM"
+	inline static const uint32_t MESH_CACHE_VERSION = 4;
+
+	std::string getMeshCachePath() const;
+	bool loadMeshCache(std::vector<MeshData>& meshData);
+	void saveMeshCache() const;
+	uint32_t getMeshCacheFlags() const;
+	void createMeshletBuffers();
+
+	// Copies the Assimp mesh into data and computes its bounds in the same pass, safe to call from worker threads
+	static void convertMesh(const aiMesh* mesh, MeshData& data);
+	static void processMesh(MeshData& data, const ModelLoadOptions& options);
+	static void generateLods(MeshData& data, const ModelLoadOptions& options);
 };
 
 #endif // !MESH_H
@@ -0,0 +1,31 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct Vertex;
+
+class MeshOptimizer
+{
+public:
+	static const uint32_t VERTEX_CACHE_SIZE = 32;
+	static const uint32_t SIMULATED_CACHE_SIZE = 16;
+
+	// Runs the full load time pipeline: vertex cache, overdraw and then vertex fetch.
+	static void optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, float overdrawThreshold = 1.05f);
+
+	static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+	static void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold);
+	static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+	// Average cache miss ratio (misses per triangle) for a FIFO cache of the given size.
+	static float calculateACMR(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize = SIMULATED_CACHE_SIZE);
+
+private:
+	static float vertexScore(int cachePosition, uint32_t remainingValence);
+	static void generateClusterBoundaries(const std::vector<uint32_t>& indices, size_t vertexCount, float threshold, std::vector<uint32_t>& clusters);
+};
+
+#endif // !MESH_OPTIMIZER_H
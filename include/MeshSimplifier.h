@@ -0,0 +1,19 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct Vertex;
+
+class MeshSimplifier
+{
+public:
+	// Quadric error edge collapse. Collapses only move a vertex onto one of its neighbours, so the result
+	// indexes the unmodified vertex array. Border and attribute seam vertices are locked to avoid cracks.
+	// Returns the error of the result in model space units.
+	static float simplify(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, std::vector<uint32_t>& result, size_t targetIndexCount, float targetError);
+};
+
+#endif // !MESH_SIMPLIFIER_H
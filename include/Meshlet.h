@@ -0,0 +1,37 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+struct Vertex;
+
+// Matches the std430 layout of Meshlet in the meshlet shaders
+struct Meshlet {
+	// xyz center, w radius, in model space
+	glm::vec4 boundingSphere;
+	// xyz average normal, w cutoff; the cluster is backfacing for every view direction within the cutoff of the axis
+	glm::vec4 cone;
+	uint32_t vertexOffset;
+	uint32_t triangleOffset;
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+};
+
+class MeshletBuilder
+{
+public:
+	static const uint32_t MAX_VERTICES = 64;
+	static const uint32_t MAX_TRIANGLES = 124;
+
+	// Splits a range of an index buffer into meshlets. meshletVertices holds indices into the vertex array,
+	// meshletTriangles holds one entry per triangle with three 8 bit local vertex indices.
+	static void build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t firstIndex, uint32_t indexCount,
+		std::vector<Meshlet>& meshlets, std::vector<uint32_t>& meshletVertices, std::vector<uint32_t>& meshletTriangles);
+
+private:
+	static void computeBounds(const std::vector<Vertex>& vertices, Meshlet& meshlet, const std::vector<uint32_t>& meshletVertices, const std::vector<uint32_t>& meshletTriangles);
+};
+
+#endif // !MESHLET_H
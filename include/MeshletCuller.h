@@ -0,0 +1,124 @@
+#ifndef MESHLET_CULLER_H
+#define MESHLET_CULLER_H
+
+#include "Helper.h"
+#include "Mesh.h"
+#include "RenderObject.h"
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <glm/glm.hpp>
+
+enum MeshletCullingPass
+{
+	MESHLET_CULLING_MAIN_PASS,
+	MESHLET_CULLING_SHADOW_PASS,
+	MESHLET_CULLING_PASS_COUNT
+};
+
+struct MeshletCullingUBO {
+	glm::vec4 frustumPlanes[6];
+	// xyz view position, used by perspective views
+	glm::vec4 viewPosition;
+	// xyz direction the rasterizer culls against, w is 1 for orthographic views
+	glm::vec4 viewDirection;
+};
+
+// Pushed at MESHLET_PUSH_CONSTANT_OFFSET, after the model matrix and the pass's own constants
+struct MeshletDrawPushConstants {
+	uint32_t meshletOffset;
+	uint32_t meshletCount;
+	float scale;
+	// DrawData entry of the mesh, see DrawBatch
+	uint32_t drawIndex;
+};
+
+struct MeshletCullPushConstants {
+	glm::mat4 model;
+	uint32_t meshletOffset;
+	uint32_t meshletCount;
+	float scale;
+	uint32_t drawIndex;
+};
+
+class MeshletCuller
+{
+public:
+	static const uint32_t MESHLET_PUSH_CONSTANT_OFFSET = 96;
+	static const VkShaderStageFlags MESHLET_PUSH_CONSTANT_STAGES = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	static const uint32_t TASK_WORKGROUP_SIZE = 32;
+
+	// Per mesh: vertices, meshlets, meshlet vertices and meshlet triangles
+	inline static VkDescriptorSetLayout meshletDescriptorSetLayout;
+	// Per pass and frame: culling UBO, compacted indices and indirect draws
+	inline static VkDescriptorSetLayout cullingDescriptorSetLayout;
+	inline static bool descriptorSetLayoutsCreated = false;
+
+	std::shared_ptr<Helper> helper;
+	bool useMeshShaders;
+
+	VkPipelineLayout cullPipelineLayout;
+	VkPipeline cullPipeline;
+
+	struct PassResources
+	{
+		std::vector<VkBuffer> uniformBuffers;
+		std::vector<VkDeviceMemory> uniformBuffersMemory;
+		std::vector<void*> uniformBuffersMapped;
+		std::vector<VkBuffer> indexBuffers;
+		std::vector<VkDeviceMemory> indexBuffersMemory;
+		std::vector<VkBuffer> drawCommandBuffers;
+		std::vector<VkDeviceMemory> drawCommandBuffersMemory;
+		std::vector<VkDescriptorSet> descriptorSets;
+	};
+	std::array<PassResources, MESHLET_CULLING_PASS_COUNT> passes;
+
+	// Initial indirect commands, copied over the pass's commands before every culling dispatch
+	VkBuffer drawCommandTemplateBuffer;
+	VkDeviceMemory drawCommandTemplateBufferMemory;
+
+	std::unordered_map<const Mesh*, VkDescriptorSet> meshDescriptorSets;
+	// Draw slot of every mesh of every render object, indexed [renderObject][mesh]. Slots are in the order the
+	// DrawBatch adds its draws, so a slot doubles as the mesh's draw index.
+	std::vector<std::vector<uint32_t>> drawIndices;
+	uint32_t drawCount = 0;
+
+	// Consecutive slots whose meshes share a geometry arena block, drawn with one multi-draw
+	struct BlockRun
+	{
+		uint32_t block;
+		uint32_t firstDraw;
+		uint32_t drawCount;
+	};
+	std::vector<BlockRun> blockRuns;
+
+	// Mesh set last bound by cullMesh or drawMeshlets, consecutive draws of a mesh skip the bind
+	const Mesh* boundMesh = nullptr;
+
+	MeshletCuller(std::shared_ptr<Helper> helper, const std::vector<std::shared_ptr<RenderObject>>& renderObjects);
+	~MeshletCuller();
+
+	void updateCullingData(MeshletCullingPass pass, uint32_t currentFrame, const glm::mat4& viewProjection, glm::vec3 viewPosition, glm::vec3 viewDirection, bool orthographic);
+
+	// Compute fallback, recorded outside of render passes
+	void beginCulling(VkCommandBuffer commandBuffer, MeshletCullingPass pass, uint32_t currentFrame);
+	void cullMesh(VkCommandBuffer commandBuffer, uint32_t renderObjectIndex, uint32_t meshIndex, RenderObject& renderObject, const Mesh& mesh, const MeshLod& lod);
+	void endCulling(VkCommandBuffer commandBuffer);
+	// Draws every slot of the pass, the DrawBatch set has to be bound
+	void drawCompacted(VkCommandBuffer commandBuffer, MeshletCullingPass pass, uint32_t currentFrame);
+
+	// Mesh shader path, firstSet is the set index of the meshlet set in the pipeline layout, the culling set follows it
+	void bindMeshShaderPass(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t firstSet, MeshletCullingPass pass, uint32_t currentFrame);
+	void drawMeshlets(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t firstSet, uint32_t renderObjectIndex, uint32_t meshIndex, RenderObject& renderObject, const Mesh& mesh, const MeshLod& lod);
+
+	static void createDescriptorSetLayouts(Helper& helper);
+	static void destroyDescriptorSetLayouts(Helper& helper);
+
+private:
+	void createPassResources(const std::vector<VkDrawIndexedIndirectCommand>& drawCommands, VkDeviceSize indexCount);
+	void createMeshDescriptorSets(const std::vector<std::shared_ptr<RenderObject>>& renderObjects);
+	void createCullPipeline();
+};
+
+#endif // !MESHLET_CULLER_H
@@ -8,20 +8,26 @@ class RenderObject
 public:
 	std::shared_ptr<Helper> helper;
 	std::shared_ptr<Model> model;
+	// Slot in the TransformSystem, also the index of the world matrix in its buffers
+	uint32_t transform;
 
-	glm::vec3 position = glm::vec3(0.0f);
-	glm::mat4 rotation = glm::mat4(1.0f);
-	float scale = 1.0f;
+	inline RenderObject(std::shared_ptr<Helper> helper, std::shared_ptr<Model> model) : helper(helper), model(model), transform(helper->transforms->add()) {}
 
-	inline RenderObject(std::shared_ptr<Helper> helper, std::shared_ptr<Model> model) : helper(helper), model(model) {}
+	inline ~RenderObject()
+	{
+		if (helper->transforms)
+			helper->transforms->remove(transform);
+	}
+
+	inline void setPosition(const glm::vec3& position) { helper->transforms->setPosition(transform, position); }
+	inline void setRotation(const glm::quat& rotation) { helper->transforms->setRotation(transform, rotation); }
+	inline void setScale(float scale) { helper->transforms->setScale(transform, scale); }
+	inline float getScale() const { return helper->transforms->getScale(transform); }
 
-	inline glm::mat4 getModelMatrix()
+	// Computed by TransformSystem::update
+	inline const glm::mat4& getModelMatrix() const
 	{
-		glm::mat4 modelMatrix = glm::mat4(1.0f);
-		modelMatrix = glm::scale(modelMatrix, glm::vec3(scale));
-		modelMatrix = modelMatrix * rotation;
-		modelMatrix = glm::translate(modelMatrix, position);
-		return modelMatrix;
+		return helper->transforms->getMatrix(transform);
 	}
 };
 
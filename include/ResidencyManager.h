@@ -0,0 +1,117 @@
+#ifndef RESIDENCY_MANAGER_H
+#define RESIDENCY_MANAGER_H
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Helper;
+
+// Resources with a lower priority are evicted first
+enum ResidencyPriority {
+	// Texture detail the TextureStreamer loads again once it is sampled
+	RESIDENCY_PRIORITY_STREAMED = 0,
+	// Device copies of data that stays on the host, such as mesh buffers
+	RESIDENCY_PRIORITY_HOST_BACKED = 1,
+	// Data rebuilt from the scene, such as the voxel grid. Restoring it may fall back to a lower resolution.
+	RESIDENCY_PRIORITY_REGENERABLE = 2,
+	// Data with no copy to restore it from, such as textures that are not streamed. Never evicted, only relocated.
+	RESIDENCY_PRIORITY_PINNED = 3
+};
+
+// Gives device memory back under memory pressure instead of failing, and keeps it from fragmenting.
+//
+// Resources register a callback that frees (part of) their device memory and returns the bytes freed. When an
+// allocation runs out of device memory, or VK_EXT_memory_budget reports a heap over budget, resources not used in the
+// current frame are evicted, lowest priority and least recently used first. Owners restore evicted resources before
+// they record them again and mark them used, which protects them until the next frame.
+//
+// Every resource has its own allocation, so large frees such as a voxel grid or a scene cell leave holes between the
+// long lived allocations around them. Resources can also register a callback that moves them into a new allocation.
+// After a large free, defragment moves the resources allocated before it a few at a time during idle frames, which
+// lets the driver pack them together again. The owners pick up the new objects and rewrite their descriptors the same
+// way they do after a restore. Main thread only.
+class ResidencyManager
+{
+public:
+	using Handle = uint32_t;
+	static const Handle INVALID_HANDLE = 0;
+
+	// Device local heaps are kept below this fraction of the budget VK_EXT_memory_budget reports
+	float budgetFraction = 0.9f;
+	// Budget driven eviction only takes resources unused for this many frames
+	uint32_t idleFrames = 60;
+	// Frames after an eviction during which streamers should not grow
+	uint32_t pressureFrames = 120;
+	// Bytes moved per idle frame while defragmenting
+	VkDeviceSize defragmentationBytesPerFrame = 32ull * 1024ull * 1024ull;
+
+	ResidencyManager(Helper& helper);
+
+	// relocate moves the resource into a new allocation and returns the bytes moved, it is optional
+	Handle add(const std::string& name, ResidencyPriority priority, VkDeviceSize size, std::function<VkDeviceSize()> evict, std::function<VkDeviceSize()> relocate = nullptr);
+	void remove(Handle handle);
+	// Call when the resource was restored or changed size
+	void setSize(Handle handle, VkDeviceSize size);
+	void markUsed(Handle handle);
+
+	// Advances the frame and evicts idle resources if the device is over budget. Call once per frame after the fence wait.
+	void beginFrame();
+	// Waits for the device and evicts until at least size bytes were freed. Returns the bytes freed.
+	VkDeviceSize makeRoom(VkDeviceSize size, uint32_t minIdleFrames = 1);
+	bool isUnderPressure() const;
+
+	// Destroys objects replaced by a relocation once the frames in flight are done with them
+	void retire(std::function<void()> destroy);
+	// Destroys every retired object right away, the device has to be idle
+	void destroyRetired();
+
+	// Marks everything allocated so far for relocation. Call after freeing a large allocation.
+	void requestDefragmentation();
+	// Relocates up to defragmentationBytesPerFrame of the marked resources. Call during frames without uploads.
+	void defragment();
+	bool isDefragmenting() const;
+
+	VkDeviceSize getTrackedSize() const;
+	uint32_t getEvictedCount() const;
+	uint64_t getEvictionCount() const;
+	VkDeviceSize getRelocatedSize() const;
+
+private:
+	struct Resource
+	{
+		std::string name;
+		ResidencyPriority priority;
+		VkDeviceSize size;
+		uint64_t lastUseFrame;
+		// Order in which the resources got their current allocation
+		uint64_t allocation;
+		std::function<VkDeviceSize()> evict;
+		std::function<VkDeviceSize()> relocate;
+	};
+
+	Helper& helper;
+
+	std::unordered_map<Handle, Resource> resources;
+	Handle nextHandle = 1;
+
+	uint64_t frame = 1;
+	uint64_t lastEvictionFrame = 0;
+	uint64_t evictionCount = 0;
+	// Allocations made by eviction and relocation callbacks must not evict in turn
+	bool evicting = false;
+
+	uint64_t nextAllocation = 1;
+	// Resources allocated before this are relocated by defragment
+	uint64_t defragmentationEnd = 0;
+	VkDeviceSize relocatedSize = 0;
+	// Objects with the number of frames left until they are destroyed
+	std::vector<std::pair<std::function<void()>, uint32_t>> retired;
+
+	VkDeviceSize getOverBudgetSize() const;
+};
+
+#endif // !RESIDENCY_MANAGER_H
@@ -0,0 +1,77 @@
+#ifndef SCENE_BVH_H
+#define SCENE_BVH_H
+
+#include "DrawList.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct SceneBvhHit {
+	// Draw list entry that was hit
+	uint32_t entry;
+	float distance;
+	glm::vec3 position;
+};
+
+// Bounding volume hierarchy over the world space bounding boxes of the draw list's entries. Queries return entry
+// indices, so every pass can find the meshes it needs without scanning the whole draw list.
+//
+// Built top-down with median splits along the longest axis when the draw list was rebuilt. Moved render objects only
+// refit the boxes bottom-up, the tree keeps its shape until the next build.
+class SceneBvh
+{
+public:
+	static const uint32_t MAX_LEAF_SIZE = 4;
+
+	// Rebuilds after the draw list was built again, refits when transforms changed
+	void update(const DrawList& drawList, bool transformsChanged);
+
+	// Planes as extracted by the frustum culler, pointing inwards. Subtrees entirely inside are taken without tests.
+	void queryFrustum(const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& entries) const;
+	void queryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<uint32_t>& entries) const;
+	void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& entries) const;
+	// Entries whose boxes the ray enters within maxDistance, the direction has to be normalized
+	void queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<uint32_t>& entries) const;
+	// Nearest triangle of the full detail meshes along the ray, visiting boxes front to back
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, SceneBvhHit& hit) const;
+
+	glm::vec3 getEntryBoundsMin(uint32_t entry) const;
+	glm::vec3 getEntryBoundsMax(uint32_t entry) const;
+
+	uint32_t getNodeCount() const;
+	uint32_t getBuildCount() const;
+	uint32_t getRefitCount() const;
+
+private:
+	// Children of an inner node are next to each other, the first at firstChildOrItem. A leaf has itemCount items
+	// starting at firstChildOrItem in items.
+	struct Node
+	{
+		glm::vec3 boundsMin;
+		uint32_t firstChildOrItem;
+		glm::vec3 boundsMax;
+		uint32_t itemCount;
+	};
+
+	const DrawList* drawList = nullptr;
+	std::vector<Node> nodes;
+	// Entry indices, ordered so every leaf's items are consecutive
+	std::vector<uint32_t> items;
+	// Indexed by entry
+	std::vector<glm::vec3> entryMin, entryMax;
+
+	uint32_t drawListBuildCount = UINT32_MAX;
+	uint32_t buildCount = 0;
+	uint32_t refitCount = 0;
+
+	void updateEntryBounds();
+	void build();
+	void refit();
+	void collect(uint32_t node, std::vector<uint32_t>& entries) const;
+	template<typename Overlaps> void query(const Overlaps& overlaps, std::vector<uint32_t>& entries) const;
+	bool intersectEntry(uint32_t entry, const glm::vec3& origin, const glm::vec3& direction, float& distance) const;
+};
+
+#endif // !SCENE_BVH_H
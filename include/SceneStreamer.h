@@ -0,0 +1,88 @@
+#ifndef SCENE_STREAMER_H
+#define SCENE_STREAMER_H
+
+#include "Helper.h"
+#include "Mesh.h"
+#include "RenderObject.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// A spatial cell of a streamed scene. Each cell is a regular model file, loaded and evicted as a whole.
+struct SceneCell {
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	std::string path;
+	// Memory the cell needs once resident. Taken from the manifest until the cell has been loaded once.
+	VkDeviceSize memorySize = 0;
+
+	std::shared_ptr<Model> model;
+	std::shared_ptr<RenderObject> renderObject;
+	bool resident = false;
+	// Set when loading failed, the cell is not retried
+	bool failed = false;
+};
+
+struct SceneStreamingOptions {
+	// Cells closer than loadRadius to the camera are loaded, cells farther than unloadRadius are evicted
+	float loadRadius = 4000.0f;
+	float unloadRadius = 5000.0f;
+	// Limit for the memory of resident and loading cells
+	VkDeviceSize memoryBudget = 1024ull * 1024ull * 1024ull;
+	uint32_t maxConcurrentLoads = 2;
+	// Meshes and textures uploaded per loading cell per frame
+	uint32_t uploadsPerFrame = 4;
+	ModelLoadOptions modelOptions;
+};
+
+// Keeps the cells around the camera and inside the voxel grid resident.
+//
+// The manifest is a text file with one cell per line, paths are relative to the manifest:
+//     cell <minX> <minY> <minZ> <maxX> <maxY> <maxZ> <model path> [memory size in bytes]
+// Lines starting with # are ignored. Cells may be the nodes of a uniform grid or the leaves of an octree.
+class SceneStreamer
+{
+public:
+	std::shared_ptr<Helper> helper;
+	SceneStreamingOptions options;
+
+	std::vector<SceneCell> cells;
+
+	SceneStreamer(std::shared_ptr<Helper> helper, const std::string& manifestPath, SceneStreamingOptions options = SceneStreamingOptions());
+	~SceneStreamer();
+
+	// Starts loads, finishes uploads and evicts cells. Call once per frame after the frame's fence was waited on.
+	// Returns true when the set of resident render objects changed.
+	bool update(glm::vec3 cameraPosition, glm::vec3 voxelGridMin, glm::vec3 voxelGridMax);
+
+	// Render objects of the fully loaded cells
+	const std::vector<std::shared_ptr<RenderObject>>& getRenderObjects() const;
+
+	VkDeviceSize getResidentMemorySize() const;
+	uint32_t getResidentCellCount() const;
+	uint32_t getLoadingCellCount() const;
+
+private:
+	struct RetiredCell
+	{
+		std::shared_ptr<Model> model;
+		std::shared_ptr<RenderObject> renderObject;
+		uint32_t framesLeft;
+	};
+
+	std::vector<std::shared_ptr<RenderObject>> renderObjects;
+	// Evicted cells that frames in flight may still draw
+	std::vector<RetiredCell> retiredCells;
+
+	void loadManifest(const std::string& manifestPath);
+	void startLoad(SceneCell& cell);
+	void evict(SceneCell& cell);
+	VkDeviceSize getCommittedMemorySize() const;
+
+	static float distanceToCell(const SceneCell& cell, glm::vec3 point);
+	static bool intersects(const SceneCell& cell, glm::vec3 boundsMin, glm::vec3 boundsMax);
+};
+
+#endif // !SCENE_STREAMER_H
@@ -0,0 +1,47 @@
+#ifndef SHADOW_CASTER_CULLER_H
+#define SHADOW_CASTER_CULLER_H
+
+#include "DrawList.h"
+#include "SceneBvh.h"
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Picks the draw list entries the shadow pass has to draw. Casters are taken from the scene BVH inside the light's
+// orthographic volume, then every caster whose shadow cannot fall on a receiver visible to the camera is dropped.
+//
+// Receivers are the entries in both the camera frustum and the light volume, merged into one box in light space. A
+// caster is kept when its light space box overlaps the receivers' across the light and starts in front of their
+// farthest depth, the shadow map is only sampled by the main pass so nothing else needs it.
+class ShadowCasterCuller
+{
+public:
+	bool enabled = true;
+	bool receiverCulling = true;
+	// Drops the light volume's near plane, casters in front of it are clipped by the shadow pass unless it clamps depth
+	bool extendTowardLight = false;
+
+	// The BVH has to be up to date
+	void cull(const DrawList& drawList, const SceneBvh& bvh, const glm::mat4& lightSpaceMatrix, const glm::mat4& cameraViewProjection);
+	// Indexed like the draw list's entries, every entry is a caster while culling is disabled
+	bool isVisible(uint32_t entry) const;
+
+	uint32_t getCasterCount() const;
+	uint32_t getReceiverCount() const;
+	// CPU time of the last cull, in milliseconds
+	float getCullTime() const;
+
+private:
+	std::vector<uint8_t> visible;
+	std::vector<uint32_t> casters;
+	std::vector<uint32_t> receivers;
+
+	uint32_t casterCount = 0;
+	uint32_t receiverCount = 0;
+	float cullTime = 0.0f;
+
+	static void getLightSpaceBounds(const SceneBvh& bvh, uint32_t entry, const glm::mat4& lightSpaceMatrix, glm::vec3& boundsMin, glm::vec3& boundsMax);
+};
+
+#endif // !SHADOW_CASTER_CULLER_H
@@ -47,6 +47,10 @@ public:
 	VkShaderModule vertShaderModule;
 	VkShaderModule fragShaderModule;
 
+	// Task/mesh shader pipeline, only created when mesh shaders are supported
+	VkPipeline meshletPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout meshletPipelineLayout = VK_NULL_HANDLE;
+
 	VkBuffer uniformBuffer;
 	VkDeviceMemory uniformBufferMemory;
 	void* uniformBufferMapped;
@@ -56,7 +60,9 @@ public:
 
 	void createDescriptorSets();
 	void createPipeline();
-	void beginRender(VkCommandBuffer commandBuffer);
+	// Secondary contents leave binding the pipeline and state to the secondary command buffers, see bindRenderState
+	void beginRender(VkCommandBuffer commandBuffer, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE);
+	void bindRenderState(VkCommandBuffer commandBuffer);
 	void endRender(VkCommandBuffer commandBuffer);
 	glm::mat4 getLightSpaceMatrix();
 };
@@ -0,0 +1,71 @@
+#ifndef SOFTWARE_OCCLUSION_CULLER_H
+#define SOFTWARE_OCCLUSION_CULLER_H
+
+#include "DrawList.h"
+#include "FrustumCuller.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Occlusion culling of the main pass on the CPU, for every path without GPU occlusion culling, meshlet culling
+// included. The largest meshes on screen are rasterized as occluders into a small depth buffer at full detail, and the
+// bounding box of every draw list entry in the frustum is tested against it before any draw is recorded. Simplified
+// levels are not used, their silhouettes can reach past the mesh.
+//
+// Triangles are rasterized four pixels at a time with SSE where available, each one at the farthest depth of its
+// vertices so occluders never hide more than they cover. The depth buffer is split into bands of rows rasterized on the
+// thread pool, and a farthest depth per tile rejects most boxes without reading their pixels.
+class SoftwareOcclusionCuller
+{
+public:
+	static const uint32_t WIDTH = 256;
+	static const uint32_t HEIGHT = 144;
+	static const uint32_t TILE_SIZE = 8;
+
+	bool enabled = true;
+	uint32_t maxOccluderCount = 64;
+	// Occluders stop being added once they reach this many triangles
+	uint32_t maxOccluderTriangleCount = 32768;
+
+	// The frustum culler has to be up to date, entries it rejected stay culled
+	void cull(const DrawList& drawList, const FrustumCuller& frustumCuller, const glm::mat4& viewProjection, ThreadPool& threadPool);
+	// Indexed like the draw list's entries, combines the frustum and the occlusion test
+	bool isVisible(uint32_t entry) const;
+
+	uint32_t getOccluderCount() const;
+	uint32_t getRasterizedTriangleCount() const;
+	uint32_t getOccludedCount() const;
+	// CPU time of the last cull, in milliseconds
+	float getCullTime() const;
+
+private:
+	static const uint32_t TILES_X = WIDTH / TILE_SIZE;
+	static const uint32_t TILES_Y = HEIGHT / TILE_SIZE;
+
+	// Screen space, in pixels of the depth buffer
+	struct ScreenTriangle
+	{
+		float x0, y0, x1, y1, x2, y2;
+		float depth;
+		int32_t minY, maxY;
+	};
+
+	std::vector<float> depthBuffer = std::vector<float>(WIDTH * HEIGHT);
+	std::vector<float> tileDepth = std::vector<float>(TILES_X * TILES_Y);
+	std::vector<std::vector<ScreenTriangle>> occluderTriangles;
+	std::vector<uint8_t> visible;
+
+	uint32_t occluderCount = 0;
+	uint32_t rasterizedTriangleCount = 0;
+	uint32_t occludedCount = 0;
+	float cullTime = 0.0f;
+
+	void selectOccluders(const DrawList& drawList, const FrustumCuller& frustumCuller, const glm::mat4& viewProjection, std::vector<uint32_t>& occluders) const;
+	void transformOccluder(const DrawListEntry& entry, const glm::mat4& viewProjection, std::vector<ScreenTriangle>& triangles) const;
+	void rasterizeBand(uint32_t firstRow, uint32_t rowCount);
+	bool isBoxOccluded(const glm::vec3& center, const glm::vec3& extent, const glm::mat4& viewProjection) const;
+};
+
+#endif // !SOFTWARE_OCCLUSION_CULLER_H
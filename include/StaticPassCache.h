@@ -0,0 +1,56 @@
+#ifndef STATIC_PASS_CACHE_H
+#define STATIC_PASS_CACHE_H
+
+#include "Helper.h"
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <vector>
+
+enum StaticPass
+{
+	STATIC_PASS_SHADOW,
+	STATIC_PASS_VOXELIZATION,
+	STATIC_PASS_COUNT
+};
+
+// Secondary command buffers holding the draws of passes that rarely change, executed again every frame instead of
+// being recorded again.
+//
+// A pass's buffer for a frame is recorded again when the version it is requested with differs from the one it was
+// recorded with, or after invalidate. Callers bump the version whenever anything the buffer refers to changes.
+class StaticPassCache
+{
+public:
+	std::shared_ptr<Helper> helper;
+	bool enabled = true;
+
+	StaticPassCache(std::shared_ptr<Helper> helper);
+	~StaticPassCache();
+
+	// Records the pass's buffer with record if needed and executes it. The render pass has to have been begun with
+	// secondary command buffer contents, subpass 0 is the one inherited.
+	void execute(VkCommandBuffer commandBuffer, StaticPass pass, uint32_t currentFrame, uint64_t version, VkRenderPass renderPass,
+		VkFramebuffer framebuffer, const std::function<void(VkCommandBuffer)>& record);
+	// Called after the resources recorded into every pass were replaced
+	void invalidate();
+
+	uint64_t getRecordCount() const;
+	uint64_t getReuseCount() const;
+
+private:
+	struct Recording
+	{
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		bool valid = false;
+		uint64_t version = 0;
+	};
+
+	// Indexed [pass][frame], a frame's buffers are only recorded again after its fence wait
+	std::array<std::vector<Recording>, STATIC_PASS_COUNT> recordings;
+	uint64_t recordCount = 0;
+	uint64_t reuseCount = 0;
+};
+
+#endif // !STATIC_PASS_CACHE_H
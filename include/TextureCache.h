@@ -0,0 +1,126 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include "ResidencyManager.h"
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Helper;
+
+// Decoded RGBA8 pixels, produced off the main thread and uploaded later
+struct TextureData {
+	int width = 0;
+	int height = 0;
+	std::shared_ptr<unsigned char> pixels;
+	// Size of the source image and the level of its mip chain the pixels are
+	int fullWidth = 0;
+	int fullHeight = 0;
+	uint32_t baseMip = 0;
+};
+
+struct TextureLoadParams {
+	bool generateMipmaps = true;
+	// Start at TextureCache::streamingBaseDimension and let the TextureStreamer add detail
+	bool streamed = false;
+};
+
+struct TextureImage {
+	VkImage image = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+};
+
+// A texture shared through the TextureCache, destroyed with its last reference
+class Texture
+{
+public:
+	VkDevice device;
+	std::string path;
+	TextureLoadParams params;
+
+	VkImage image = VK_NULL_HANDLE;
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkImageView view = VK_NULL_HANDLE;
+	uint32_t mipLevels = 1;
+	VkDeviceSize memorySize = 0;
+
+	// The image holds the levels baseMip and below of the full resolution chain
+	int width = 0;
+	int height = 0;
+	int fullWidth = 0;
+	int fullHeight = 0;
+	uint32_t baseMip = 0;
+	uint32_t fullMipLevels = 1;
+
+	// Streaming state, only used by the TextureStreamer
+	uint32_t streamingBaseMip = 0;
+	uint32_t feedbackSlot = UINT32_MAX;
+	uint32_t requestedMip = UINT32_MAX;
+	uint64_t lastRequestFrame = 0;
+	bool streaming = false;
+	bool streamingFailed = false;
+
+	// Every texture can be relocated, streamed ones can also drop back to their streaming base level
+	std::shared_ptr<ResidencyManager> residency;
+	ResidencyManager::Handle residencyHandle = ResidencyManager::INVALID_HANDLE;
+
+	Texture(Helper& helper, const std::string& path, const TextureData& data, const TextureLoadParams& params);
+	~Texture();
+
+	// Swap in a new image, the old one is returned since frames in flight may still sample it.
+	// The texture is left unchanged if the new image cannot be created.
+	TextureImage replace(Helper& helper, const TextureData& data);
+	// Drops the levels above newBaseMip with a copy on the GPU, no file access needed. Keeping baseMip copies the image.
+	TextureImage shrink(Helper& helper, uint32_t newBaseMip);
+};
+
+// Deduplicates textures by resolved path and load parameters, and hands out shared samplers.
+// The cache only holds weak references, textures are freed as soon as no model uses them.
+class TextureCache
+{
+public:
+	TextureCache(Helper& helper);
+	~TextureCache();
+
+	// Largest side of streamed textures when they are first loaded
+	uint32_t streamingBaseDimension = 256;
+
+	static std::string getKey(const std::string& path, const TextureLoadParams& params);
+	static uint32_t getMipLevelCount(int width, int height);
+	// Bytes of an RGBA8 mip chain whose top level is width x height
+	static VkDeviceSize getMipChainSize(int width, int height);
+	// Box filters the pixels down by the given number of levels
+	static void downsample(TextureData& data, uint32_t levels);
+
+	// Decodes the file and, for streamed textures, reduces it to the streaming base level. Safe on worker threads.
+	TextureData loadTextureData(const std::string& path, const TextureLoadParams& params);
+
+	// Safe to call from worker threads, returns nullptr if the texture is not resident
+	std::shared_ptr<Texture> find(const std::string& path, const TextureLoadParams& params);
+	// Returns the resident texture or creates it from data. The file is decoded here if data is empty.
+	std::shared_ptr<Texture> acquire(const std::string& path, const TextureLoadParams& params, const TextureData& data = TextureData());
+	// 1x1 mid grey texture for materials whose texture is not loaded (yet)
+	std::shared_ptr<Texture> getPlaceholder();
+
+	// Samplers live as long as the cache
+	VkSampler getSampler(uint32_t maxLod);
+
+	uint32_t getTextureCount();
+	std::vector<std::shared_ptr<Texture>> getStreamedTextures();
+
+private:
+	Helper& helper;
+
+	std::mutex mutex;
+	std::unordered_map<std::string, std::weak_ptr<Texture>> textures;
+	std::weak_ptr<Texture> placeholder;
+	std::unordered_map<uint32_t, VkSampler> samplers;
+};
+
+#endif // !TEXTURE_CACHE_H
@@ -0,0 +1,70 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include "Helper.h"
+
+#include <future>
+#include <memory>
+#include <vector>
+
+struct TextureStreamingOptions {
+	// Limit for the memory of all streamed textures
+	VkDeviceSize memoryBudget = 512ull * 1024ull * 1024ull;
+	uint32_t maxConcurrentLoads = 2;
+	// Textures not sampled for this many frames fall back to their streaming base level when memory is needed
+	uint32_t unusedFrames = 120;
+};
+
+// Streams the higher mip levels of streamed textures based on the levels main.frag actually samples.
+//
+// main.frag writes the finest full resolution level it wants into a per frame feedback buffer, one slot per texture.
+// Once the frame's fence has been waited on, update reads it back, loads finer levels on the thread pool and drops
+// the detail of textures nobody looked at lately when the budget is exceeded.
+class TextureStreamer
+{
+public:
+	static const uint32_t MAX_FEEDBACK_SLOTS = 4096;
+	static const uint32_t NO_FEEDBACK_SLOT = UINT32_MAX;
+
+	std::shared_ptr<Helper> helper;
+	TextureStreamingOptions options;
+
+	// Bound at set 0, binding 3 of the main pass
+	std::vector<VkBuffer> feedbackBuffers;
+	std::vector<VkDeviceMemory> feedbackBuffersMemory;
+	std::vector<void*> feedbackBuffersMapped;
+
+	TextureStreamer(std::shared_ptr<Helper> helper, TextureStreamingOptions options = TextureStreamingOptions());
+	~TextureStreamer();
+
+	void update(uint32_t currentFrame);
+	// Makes the frame's feedback writes visible to the host, recorded after the main pass
+	void recordFeedbackBarrier(VkCommandBuffer commandBuffer);
+
+	VkDeviceSize getResidentMemorySize() const;
+	uint32_t getLoadingCount() const;
+
+private:
+	struct StreamRequest
+	{
+		std::shared_ptr<Texture> texture;
+		uint32_t level;
+		std::shared_ptr<TextureData> data;
+		std::future<void> task;
+	};
+
+	std::vector<std::weak_ptr<Texture>> slots;
+	std::vector<StreamRequest> requests;
+	// Replaced images with the number of frames left until they are destroyed
+	std::vector<std::pair<TextureImage, uint32_t>> retiredImages;
+
+	uint64_t frame = 0;
+	VkDeviceSize residentMemorySize = 0;
+
+	void createFeedbackBuffers();
+	void assignSlot(const std::shared_ptr<Texture>& texture);
+	void retire(TextureImage image);
+	uint32_t getTargetLevel(const Texture& texture) const;
+};
+
+#endif // !TEXTURE_STREAMER_H
@@ -0,0 +1,38 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <cstdint>
+#include <cstddef>
+
+class ThreadPool
+{
+public:
+	ThreadPool(uint32_t threadCount = 0);
+	~ThreadPool();
+
+	std::future<void> submit(std::function<void()> task);
+
+	// Runs task(i) for every i in [0, count) on the workers and the calling thread.
+	// The first exception thrown by a task is rethrown once all indices are done.
+	void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+	uint32_t getThreadCount() const;
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::packaged_task<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping = false;
+
+	void workerLoop();
+};
+
+#endif // !THREAD_POOL_H
@@ -0,0 +1,79 @@
+#ifndef TRANSFORM_SYSTEM_H
+#define TRANSFORM_SYSTEM_H
+
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+class Helper;
+
+// Positions, rotations and scales of every render object, stored as structure of arrays. World matrices are computed
+// only for transforms changed since the last update, four at a time with SSE where available.
+//
+// Every frame in flight has its own storage buffer holding the matrices, indexed by transform. Uploading copies only
+// the range changed since that frame's buffer was last written. Main thread only.
+class TransformSystem
+{
+public:
+	TransformSystem(Helper& helper);
+	~TransformSystem();
+
+	// Starts as the identity
+	uint32_t add();
+	void remove(uint32_t transform);
+
+	void setPosition(uint32_t transform, const glm::vec3& position);
+	void setRotation(uint32_t transform, const glm::quat& rotation);
+	void setScale(uint32_t transform, float scale);
+	glm::vec3 getPosition(uint32_t transform) const;
+	glm::quat getRotation(uint32_t transform) const;
+	float getScale(uint32_t transform) const;
+
+	// scale * rotation * translate(position), current as of the last update
+	const glm::mat4& getMatrix(uint32_t transform) const;
+
+	void update();
+	// Called after the frame's fence wait, may replace the frame's buffer
+	void upload(uint32_t currentFrame);
+	VkBuffer getBuffer(uint32_t currentFrame) const;
+
+	uint32_t getCount() const;
+	// Matrices computed by the last update
+	uint32_t getUpdatedCount() const;
+
+private:
+	struct FrameBuffer
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		void* mapped = nullptr;
+		uint32_t capacity = 0;
+		// Matrices written since the last upload to this buffer
+		uint32_t dirtyBegin = UINT32_MAX;
+		uint32_t dirtyEnd = 0;
+	};
+
+	Helper& helper;
+
+	// Padded to a multiple of four so the SSE path never reads past the end
+	std::vector<float> positionX, positionY, positionZ;
+	std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+	std::vector<float> scales;
+	std::vector<uint8_t> dirty;
+	std::vector<glm::mat4> matrices;
+
+	std::vector<uint32_t> freeTransforms;
+	uint32_t count = 0;
+	uint32_t updatedCount = 0;
+	bool anyDirty = false;
+
+	std::vector<FrameBuffer> frames;
+
+	void computeMatrices(uint32_t first);
+	void markDirty(uint32_t transform);
+	void destroyBuffer(FrameBuffer& frame);
+};
+
+#endif // !TRANSFORM_SYSTEM_H
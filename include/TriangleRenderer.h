@@ -8,6 +8,19 @@
 #include "ShadowMap.h"
 #include "GeometryVoxelizer.h"
 #include "Camera.h"
+#include "DeferredRenderer.h"
+#include "MeshletCuller.h"
+#include "DrawBatch.h"
+#include "DrawCuller.h"
+#include "DrawList.h"
+#include "FrustumCuller.h"
+#include "SceneBvh.h"
+#include "ShadowCasterCuller.h"
+#include "VoxelizationCuller.h"
+#include "SoftwareOcclusionCuller.h"
+#include "StaticPassCache.h"
+#include "SceneStreamer.h"
+#include "TextureStreamer.h"
 
 struct MeshPushConstants {
 	glm::mat4 model;
@@ -41,6 +54,20 @@ private:
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkPipelineLayout pipelineLayout;
 	VkPipeline graphicsPipeline;
+	// Depth only draws of the main pass, followed by graphicsPipeline's variant that tests for equal depth without writing
+	// it. The mesh shader path has no pre-pass and keeps graphicsPipeline's state.
+	VkPipeline depthPrePassPipeline;
+	VkPipeline depthEqualGraphicsPipeline;
+	bool enableDepthPrePass = true;
+
+	// G-buffer pass and tiled compute shading in place of the shaded main pass, not used by the mesh shader path
+	std::unique_ptr<DeferredRenderer> deferredRenderer;
+	VkPipeline geometryPipeline;
+	bool enableDeferredShading = false;
+
+	// Task/mesh shader variant of the main pipeline, only created when mesh shaders are supported
+	VkPipelineLayout meshletPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline meshletGraphicsPipeline = VK_NULL_HANDLE;
 
 	std::vector<VkBuffer> transformationUniformBuffers;
 	std::vector<VkDeviceMemory> transformationUniformBuffersMemory;
@@ -65,14 +92,74 @@ private:
 	glm::vec4 corner2 = glm::vec4(1879.78, -160.896, -1264.38f, 1.0f);
 	bool enableVoxelVis = false;
 
+	bool enableMeshLods = true;
+	// Largest simplification error allowed on screen, in pixels
+	float lodErrorThreshold = 1.0f;
+	// Largest simplification error allowed during voxelization, in voxels
+	float voxelLodErrorThreshold = 0.5f;
+
+	// Model matrices, textures and indirect draws of every pass, rebuilt each frame
+	std::unique_ptr<DrawBatch> drawBatch;
+	// Meshes of the scene in the order the passes draw them, rebuilt when drawListDirty is set or while models load
+	DrawList drawList;
+	bool drawListDirty = true;
+	// Bounds of the draw list's entries, rebuilt with the draw list and refit when transforms change
+	SceneBvh sceneBvh;
+	bool enableBvhCulling = true;
+	// Entries drawn by the batched shadow pass
+	ShadowCasterCuller shadowCasterCuller;
+	// Voxelization draws limited to the meshes and meshlets inside the voxel grid
+	VoxelizationCuller voxelizationCuller;
+	// Mesh under the cursor after the last left click, -1 when nothing was hit
+	int32_t pickedRenderObject = -1;
+	uint32_t pickedMesh = 0;
+	float pickedDistance = 0.0f;
+	// Main pass visibility of the draw list's entries, updated before the draws are recorded
+	FrustumCuller frustumCuller;
+	// Occluders rasterized on the CPU, hides main pass meshes in the frustum when nothing culls them on the GPU
+	SoftwareOcclusionCuller softwareOcclusionCuller;
+	// Main pass culling on the GPU for the batched path, replaces the frustum culler there when available
+	std::unique_ptr<DrawCuller> drawCuller;
+	bool enableGpuCulling = true;
+	// Main pass halves drawn before and after the depth pyramid is built, only created with the draw culler
+	VkRenderPass firstPhaseRenderPass = VK_NULL_HANDLE;
+	VkRenderPass secondPhaseRenderPass = VK_NULL_HANDLE;
+	// Shadow and voxelization draws recorded once and executed every frame, the mesh shader path is still recorded inline
+	std::unique_ptr<StaticPassCache> staticPassCache;
+
+	// Created once every model is resident
+	std::unique_ptr<MeshletCuller> meshletCuller;
+	bool enableMeshletCulling = true;
+
+	bool sceneComplete = false;
+	// Meshes and textures uploaded per model per frame while the scene is loading
+	uint32_t modelUploadsPerFrame = 4;
+
+	// Optional streamed scene, its render objects follow the first staticRenderObjectCount entries of renderObjects
+	const std::string streamedScenePath = "models/streamed/scene.cells";
+	std::unique_ptr<SceneStreamer> sceneStreamer;
+	size_t staticRenderObjectCount = 0;
+	std::unique_ptr<TextureStreamer> textureStreamer;
+
+	// Cullers replaced after the render objects changed, with the number of frames left until they are released
+	std::vector<std::pair<std::unique_ptr<MeshletCuller>, uint32_t>> retiredMeshletCullers;
+	// Set when the render objects or their mesh buffers changed, the culler is rebuilt before the next recording
+	bool meshletCullerDirty = false;
+
+	// Smallest grid revoxelize falls back to when the device runs out of memory
+	const int minVoxelResolution = 64;
+
 public:
 	TriangleRenderer(std::string app_name);
 
 	void main_loop_extended(uint32_t currentFrame, uint32_t imageIndex) override;
 	void cleanup_extended() override;
+	void recreate_swap_chain_extended() override;
 	void createGraphicsPipeline();
+	void destroyGraphicsPipeline();
 	void recordCommandBuffer(uint32_t currentFrame, uint32_t imageIndex) override;
-	void beginRenderPass(uint32_t currentFrame, uint32_t imageIndex);
+	void beginRenderPass(uint32_t currentFrame, uint32_t imageIndex, VkRenderPass renderPass = VK_NULL_HANDLE);
+	void createOcclusionRenderPasses();
 	void setDynamicState();
 	void createBuffers();
 	void createDescriptorSetLayouts();
@@ -81,8 +168,20 @@ public:
 	void key_callback_extended(GLFWwindow* window, int key, int scancode, int action, int mods, double deltaTime) override;
 	void mouse_callback_extended(GLFWwindow* window, int button, int action, int mods, double deltaTime) override;
 	void cursor_position_callback_extended(GLFWwindow* window, double xpos, double ypos) override;
-	void renderScene();
+	void pickMesh(GLFWwindow* window);
+	void renderScene(DrawCullPhase phase = DRAW_CULL_FIRST_PHASE);
 	void revoxelize(int resolution);
+	const MeshLod& selectMainPassLod(RenderObject& renderObject, const Mesh& mesh);
+	const MeshLod& selectVoxelizationLod(RenderObject& renderObject, const Mesh& mesh);
+	bool useMeshletCulling();
+	bool useMeshShaderPath();
+	bool useGpuCulling();
+	bool useOcclusionCulling();
+	bool useDeferredShading();
+	void cullMeshlets(MeshletCullingPass pass, uint32_t currentFrame);
+	void buildDrawBatch(uint32_t currentFrame);
+	void updateModels();
+	void makeSceneResident();
 };
 
 #endif // !TRIANGLE_RENDERER_H
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef VOXELIZATION_CULLER_H
+#define VOXELIZATION_CULLER_H
+
+#include "DrawBatch.h"
+#include "DrawList.h"
+#include "SceneBvh.h"
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Keeps the voxelization pass to the geometry inside the voxel grid. Entries whose boxes miss the grid are dropped,
+// entries entirely inside it are drawn whole, and entries crossing its bounds draw only the runs of consecutive
+// meshlets whose bounding spheres touch it. Meshlets cover consecutive triangles of their level, so every run is one
+// range of the index buffer.
+class VoxelizationCuller
+{
+public:
+	bool enabled = true;
+	bool clusterCulling = true;
+
+	// The BVH has to be up to date
+	void cull(const DrawList& drawList, const SceneBvh& bvh, const glm::vec3& gridMin, const glm::vec3& gridMax);
+	// Adds the voxelization draws of a draw list entry at the given level
+	void addCommands(DrawBatch& drawBatch, uint32_t entry, const DrawListEntry& drawListEntry, const MeshLod& lod);
+
+	uint32_t getCulledCount() const;
+	uint32_t getSplitCount() const;
+	// Triangles of split entries left out, counted while adding commands
+	uint32_t getCulledTriangleCount() const;
+
+private:
+	enum Overlap : uint8_t
+	{
+		OVERLAP_NONE,
+		OVERLAP_PARTIAL,
+		OVERLAP_INSIDE
+	};
+
+	std::vector<uint8_t> overlaps;
+	std::vector<uint32_t> entries;
+	glm::vec3 gridMin = glm::vec3(0.0f);
+	glm::vec3 gridMax = glm::vec3(0.0f);
+
+	uint32_t culledCount = 0;
+	uint32_t splitCount = 0;
+	uint32_t culledTriangleCount = 0;
+};
+
+#endif // !VOXELIZATION_CULLER_H
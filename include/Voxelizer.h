@@ -59,6 +59,10 @@ public:
 	std::vector<VkImageView> voxelTextureMipViews;
 	uint32_t mipLevelCount;
 
+	// The grid is rebuilt every frame, so the residency manager may drop the voxel texture. The owner has to create a
+	// new voxelizer before recording once isVoxelTextureResident returns false.
+	ResidencyManager::Handle residencyHandle;
+
 	std::vector<VkBuffer> transformsUniformBuffers;
 	std::vector<VkDeviceMemory> transformsUniformBuffersMemory;
 	std::vector<void*> transformsUniformBuffersMapped;
@@ -107,7 +111,9 @@ public:
 	VkDescriptorSet noiseTextureDescriptorSet;
 	VkSampler noiseTextureSampler;
 
-	virtual void beginVoxelization(VkCommandBuffer commandBuffer, uint32_t currentFrame) = 0;
+	// Secondary contents leave binding the pipeline and state to the secondary command buffers, see bindVoxelizationState
+	virtual void beginVoxelization(VkCommandBuffer commandBuffer, uint32_t currentFrame, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE) = 0;
+	virtual void bindVoxelizationState(VkCommandBuffer commandBuffer, uint32_t currentFrame) = 0;
 	virtual void voxelize(VkCommandBuffer commandBuffer, uint32_t currentFrame) = 0;
 	virtual void endVoxelization(VkCommandBuffer commandBuffer, uint32_t currentFrame) = 0;
 
@@ -129,6 +135,11 @@ public:
 	void createCubeVertexindexBuffers();
 	void createMipMapperComputePipeline();
 	void generateMipMaps(VkCommandBuffer commandBuffer, uint32_t currentFrame);
+	bool isVoxelTextureResident() const;
+	VkDeviceSize getVoxelTextureSize() const;
+
+private:
+	void destroyVoxelTexture();
 };
 
 #endif // !VOXELIZER_H
@@ -10,6 +10,7 @@
 #include <stb_image.h>
 
 #include <array>
+#include <cstring>
 
 
 VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
@@ -99,6 +100,14 @@ void Application::init_vulkan()
     createSurface();
     pickPhysicalDevice();           helper->physicalDevice = physicalDevice;
     createLogicalDevice();          helper->device = device;    helper->graphicsQueue = graphicsQueue;
+    if (meshShaderSupported)
+    {
+        helper->meshShaderSupported = true;
+        helper->cmdDrawMeshTasksEXT = (PFN_vkCmdDrawMeshTasksEXT)vkGetDeviceProcAddr(device, "vkCmdDrawMeshTasksEXT");
+    }
+    helper->memoryBudgetSupported = memoryBudgetSupported;
+    helper->drawIndirectCountSupported = drawIndirectCountSupported;
+    helper->cpuDevice = cpuDevice;
     createCommandPool();            helper->commandPool = commandPool;
     createCommandBuffers();
     createSyncObjects();
@@ -396,11 +405,24 @@ void Application::pickPhysicalDevice()
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(instance, &deviceCount, devices.data());
 
-    for (const auto& device : devices) {
-        if (isDeviceSuitable(device)) {
-            physicalDevice = device;
-            break;
+    // Discrete GPUs first, then anything that can present, such as integrated GPUs or lavapipe
+    for (bool discreteOnly : { true, false }) {
+        for (const auto& device : devices) {
+            VkPhysicalDeviceProperties deviceProperties;
+            vkGetPhysicalDeviceProperties(device, &deviceProperties);
+
+            if (discreteOnly && deviceProperties.deviceType != VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
+                continue;
+
+            if (isDeviceSuitable(device)) {
+                physicalDevice = device;
+                cpuDevice = deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+                break;
+            }
         }
+
+        if (physicalDevice != VK_NULL_HANDLE)
+            break;
     }
 
     if (physicalDevice == VK_NULL_HANDLE) {
@@ -415,6 +437,19 @@ bool Application::isDeviceSuitable(VkPhysicalDevice device)
     VkPhysicalDeviceFeatures deviceFeatures;
     vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
 
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &features12;
+    vkGetPhysicalDeviceFeatures2(device, &features);
+
+    // The passes are drawn indirectly with firstInstance selecting the draw data, and shaders index the bindless
+    // texture array per draw, there is no fallback without these
+    bool featuresSupported = deviceFeatures.multiDrawIndirect && deviceFeatures.drawIndirectFirstInstance &&
+        features12.runtimeDescriptorArray && features12.shaderSampledImageArrayNonUniformIndexing;
+
     QueueFamilyIndices indices = findQueueFamilies(device);
     bool extensionsSupported = checkDeviceExtensionSupport(device);
 
@@ -424,7 +459,7 @@ bool Application::isDeviceSuitable(VkPhysicalDevice device)
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
 
-    return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU && indices.isComplete() && extensionsSupported && swapChainAdequate;
+    return indices.isComplete() && extensionsSupported && swapChainAdequate && featuresSupported;
 }
 
 QueueFamilyIndices Application::findQueueFamilies(VkPhysicalDevice device) 
@@ -483,19 +518,71 @@ void Application::createLogicalDevice()
     deviceFeatures.samplerAnisotropy = VK_TRUE;
     deviceFeatures.geometryShader = VK_TRUE;
     deviceFeatures.fragmentStoresAndAtomics = VK_TRUE;
+    // Every pass is drawn with a few indirect draws whose firstInstance selects the draw data, isDeviceSuitable
+    // checked both
+    deviceFeatures.multiDrawIndirect = VK_TRUE;
+    deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
 
     VkPhysicalDeviceVulkan12Features features12{};
     features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
     features12.pNext = nullptr;
     features12.runtimeDescriptorArray = VK_TRUE;
+    features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+    // Lets GPU culling decide how many of the indirect draws are executed
+    VkPhysicalDeviceVulkan12Features supportedFeatures12{};
+    supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+    VkPhysicalDeviceFeatures2 supportedCoreFeatures{};
+    supportedCoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedCoreFeatures.pNext = &supportedFeatures12;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedCoreFeatures);
+
+    if (supportedFeatures12.drawIndirectCount)
+    {
+        features12.drawIndirectCount = VK_TRUE;
+        drawIndirectCountSupported = true;
+    }
+
+    std::vector<const char*> enabledExtensions = deviceExtensions;
+
+    // Mesh shaders are optional, meshlet culling falls back to compute index compaction without them
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+    meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+
+    if (checkOptionalDeviceExtensionSupport(physicalDevice, VK_EXT_MESH_SHADER_EXTENSION_NAME))
+    {
+        VkPhysicalDeviceFeatures2 supportedFeatures{};
+        supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures.pNext = &meshShaderFeatures;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures);
+
+        if (meshShaderFeatures.taskShader && meshShaderFeatures.meshShader)
+        {
+            meshShaderFeatures.pNext = nullptr;
+            meshShaderFeatures.multiviewMeshShader = VK_FALSE;
+            meshShaderFeatures.primitiveFragmentShadingRateMeshShader = VK_FALSE;
+            meshShaderFeatures.meshShaderQueries = VK_FALSE;
+            features12.pNext = &meshShaderFeatures;
+            enabledExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+            meshShaderSupported = true;
+        }
+    }
+
+    // Lets the residency manager evict before allocations start failing
+    if (checkOptionalDeviceExtensionSupport(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+    {
+        enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        memoryBudgetSupported = true;
+    }
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
     createInfo.pNext = &features12;
 
     if (enableValidationLayers) {
@@ -538,6 +625,23 @@ bool Application::checkDeviceExtensionSupport(VkPhysicalDevice device)
     return requiredExtensions.empty();
 }
 
+bool Application::checkOptionalDeviceExtensionSupport(VkPhysicalDevice device, const char* extensionName)
+{
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions) {
+        if (strcmp(extension.extensionName, extensionName) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 SwapChainSupportDetails Application::querySwapChainSupport(VkPhysicalDevice device) 
 {
     SwapChainSupportDetails details;
@@ -749,6 +853,8 @@ void Application::recreateSwapChain() {
     createImageViews();
     createDepthResources();
     createSwapChainFramebuffers();
+
+    recreate_swap_chain_extended();
 }
 
 void Application::cleanupSwapChain()
@@ -864,11 +970,15 @@ void Application::createSwapChainRenderPass()
 
 void Application::createDescriptorPool()
 {
-    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    std::array<VkDescriptorPoolSize, 4> poolSizes{};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     poolSizes[0].descriptorCount = static_cast<uint32_t>(1000);
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     poolSizes[1].descriptorCount = static_cast<uint32_t>(1000);
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = static_cast<uint32_t>(1000);
+    poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[3].descriptorCount = static_cast<uint32_t>(1000);
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -884,6 +994,6 @@ void Application::createDescriptorPool()
 
 void Application::createDepthResources()
 {
-    helper->createImage(swapChainExtent.width, swapChainExtent.height, 1, 1, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
+    helper->createImage(swapChainExtent.width, swapChainExtent.height, 1, 1, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depthImage, depthImageMemory);
     depthImageView = helper->createImageView(depthImage, 0, 1, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
 }
\ No newline at end of file
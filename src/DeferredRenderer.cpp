@@ -0,0 +1,547 @@
+#include "DeferredRenderer.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+DeferredRenderer::DeferredRenderer(std::shared_ptr<Helper> helper, VkImageView depthView, VkExtent2D extent, VkRenderPass swapChainRenderPass) :
+    helper(helper), extent(extent)
+{
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = 0.0f;
+
+    if (vkCreateSampler(helper->device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture sampler!");
+    }
+
+    createRenderPasses();
+    createImages(depthView);
+    createDescriptorSets();
+    writeDescriptorSets(depthView);
+    createCompositePipeline(swapChainRenderPass);
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+    destroyShadingPipeline();
+
+    vkDestroyPipeline(helper->device, compositePipeline, nullptr);
+    vkDestroyPipelineLayout(helper->device, compositePipelineLayout, nullptr);
+
+    std::array<VkDescriptorSet, 2> descriptorSets = { shadingDescriptorSet, compositeDescriptorSet };
+    vkFreeDescriptorSets(helper->device, helper->descriptorPool, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data());
+    vkDestroyDescriptorSetLayout(helper->device, shadingDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(helper->device, compositeDescriptorSetLayout, nullptr);
+
+    destroyImages();
+    vkDestroySampler(helper->device, sampler, nullptr);
+    vkDestroyRenderPass(helper->device, geometryRenderPass, nullptr);
+    vkDestroyRenderPass(helper->device, geometryLoadRenderPass, nullptr);
+}
+
+void DeferredRenderer::resize(VkImageView depthView, VkExtent2D extent)
+{
+    this->extent = extent;
+
+    destroyImages();
+    createImages(depthView);
+    writeDescriptorSets(depthView);
+}
+
+void DeferredRenderer::createRenderPasses()
+{
+    VkAttachmentDescription albedoAttachment{};
+    albedoAttachment.format = ALBEDO_FORMAT;
+    albedoAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    albedoAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    albedoAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    albedoAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    albedoAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    albedoAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    albedoAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkAttachmentDescription normalAttachment = albedoAttachment;
+    normalAttachment.format = NORMAL_FORMAT;
+
+    VkAttachmentDescription depthAttachment = albedoAttachment;
+    depthAttachment.format = VK_FORMAT_D32_SFLOAT;
+
+    std::array<VkAttachmentReference, 2> colorAttachmentRefs{};
+    colorAttachmentRefs[0].attachment = 0;
+    colorAttachmentRefs[0].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachmentRefs[1].attachment = 1;
+    colorAttachmentRefs[1].layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 2;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = static_cast<uint32_t>(colorAttachmentRefs.size());
+    subpass.pColorAttachments = colorAttachmentRefs.data();
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+    // Waits for the shading pass and the depth pyramid to stop reading the G-buffer
+    VkSubpassDependency dependency1{};
+    dependency1.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency1.dstSubpass = 0;
+    dependency1.srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependency1.srcAccessMask = 0;
+    dependency1.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency1.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    VkSubpassDependency dependency2{};
+    dependency2.srcSubpass = 0;
+    dependency2.dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependency2.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency2.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency2.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    dependency2.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    std::array<VkSubpassDependency, 2> dependencies = { dependency1, dependency2 };
+
+    std::array<VkAttachmentDescription, 3> attachments = { albedoAttachment, normalAttachment, depthAttachment };
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+
+    if (vkCreateRenderPass(helper->device, &renderPassInfo, nullptr, &geometryRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render pass!");
+    }
+
+    for (VkAttachmentDescription& attachment : attachments)
+    {
+        attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachment.initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+
+    if (vkCreateRenderPass(helper->device, &renderPassInfo, nullptr, &geometryLoadRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render pass!");
+    }
+}
+
+void DeferredRenderer::createImages(VkImageView depthView)
+{
+    helper->createImage(extent.width, extent.height, 1, 1, ALBEDO_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, albedoImage, albedoImageMemory);
+    albedoImageView = helper->createImageView(albedoImage, 0, 1, ALBEDO_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+    helper->setNameOfObject(VK_OBJECT_TYPE_IMAGE, (uint64_t)albedoImage, "DeferredRenderer::Albedo Image");
+
+    helper->createImage(extent.width, extent.height, 1, 1, NORMAL_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, normalImage, normalImageMemory);
+    normalImageView = helper->createImageView(normalImage, 0, 1, NORMAL_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+    helper->setNameOfObject(VK_OBJECT_TYPE_IMAGE, (uint64_t)normalImage, "DeferredRenderer::Normal Image");
+
+    helper->createImage(extent.width, extent.height, 1, 1, COLOR_FORMAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage, colorImageMemory);
+    colorImageView = helper->createImageView(colorImage, 0, 1, COLOR_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+    helper->setNameOfObject(VK_OBJECT_TYPE_IMAGE, (uint64_t)colorImage, "DeferredRenderer::Color Image");
+
+    helper->createImage(std::max((extent.width + 1) / 2, 1u), std::max((extent.height + 1) / 2, 1u), 1, 1, AMBIENT_OCCLUSION_FORMAT, VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ambientOcclusionImage, ambientOcclusionImageMemory);
+    ambientOcclusionImageView = helper->createImageView(ambientOcclusionImage, 0, 1, AMBIENT_OCCLUSION_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT);
+    helper->setNameOfObject(VK_OBJECT_TYPE_IMAGE, (uint64_t)ambientOcclusionImage, "DeferredRenderer::Ambient Occlusion Image");
+
+    std::array<VkImageView, 3> attachments = { albedoImageView, normalImageView, depthView };
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = geometryRenderPass;
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    framebufferInfo.pAttachments = attachments.data();
+    framebufferInfo.width = extent.width;
+    framebufferInfo.height = extent.height;
+    framebufferInfo.layers = 1;
+
+    if (vkCreateFramebuffer(helper->device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create framebuffer!");
+    }
+}
+
+void DeferredRenderer::destroyImages()
+{
+    vkDestroyFramebuffer(helper->device, framebuffer, nullptr);
+
+    vkDestroyImageView(helper->device, albedoImageView, nullptr);
+    vkDestroyImage(helper->device, albedoImage, nullptr);
+    vkFreeMemory(helper->device, albedoImageMemory, nullptr);
+
+    vkDestroyImageView(helper->device, normalImageView, nullptr);
+    vkDestroyImage(helper->device, normalImage, nullptr);
+    vkFreeMemory(helper->device, normalImageMemory, nullptr);
+
+    vkDestroyImageView(helper->device, colorImageView, nullptr);
+    vkDestroyImage(helper->device, colorImage, nullptr);
+    vkFreeMemory(helper->device, colorImageMemory, nullptr);
+
+    vkDestroyImageView(helper->device, ambientOcclusionImageView, nullptr);
+    vkDestroyImage(helper->device, ambientOcclusionImage, nullptr);
+    vkFreeMemory(helper->device, ambientOcclusionImageMemory, nullptr);
+}
+
+void DeferredRenderer::createDescriptorSets()
+{
+    // Albedo, normal and depth, then the shaded image and the reduced resolution occlusion
+    std::array<VkDescriptorSetLayoutBinding, 5> shadingBindings{};
+    for (uint32_t i = 0; i < shadingBindings.size(); i++)
+    {
+        shadingBindings[i].binding = i;
+        shadingBindings[i].descriptorType = i < 3 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        shadingBindings[i].descriptorCount = 1;
+        shadingBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        shadingBindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(shadingBindings.size());
+    layoutInfo.pBindings = shadingBindings.data();
+
+    if (vkCreateDescriptorSetLayout(helper->device, &layoutInfo, nullptr, &shadingDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+
+    VkDescriptorSetLayoutBinding compositeBinding{};
+    compositeBinding.binding = 0;
+    compositeBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    compositeBinding.descriptorCount = 1;
+    compositeBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    compositeBinding.pImmutableSamplers = nullptr;
+
+    layoutInfo.bindingCount = 1;
+    layoutInfo.pBindings = &compositeBinding;
+
+    if (vkCreateDescriptorSetLayout(helper->device, &layoutInfo, nullptr, &compositeDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+
+    std::array<VkDescriptorSetLayout, 2> layouts = { shadingDescriptorSetLayout, compositeDescriptorSetLayout };
+    std::array<VkDescriptorSet, 2> descriptorSets{};
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = helper->descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocInfo.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(helper->device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    shadingDescriptorSet = descriptorSets[0];
+    compositeDescriptorSet = descriptorSets[1];
+}
+
+void DeferredRenderer::writeDescriptorSets(VkImageView depthView)
+{
+    std::array<VkDescriptorImageInfo, 5> imageInfos{};
+    imageInfos[0] = { sampler, albedoImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    imageInfos[1] = { sampler, normalImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    imageInfos[2] = { sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    // The shaded image stays in VK_IMAGE_LAYOUT_GENERAL, it is written by the shading pass and sampled by the composite
+    imageInfos[3] = { VK_NULL_HANDLE, colorImageView, VK_IMAGE_LAYOUT_GENERAL };
+    imageInfos[4] = { VK_NULL_HANDLE, ambientOcclusionImageView, VK_IMAGE_LAYOUT_GENERAL };
+    VkDescriptorImageInfo compositeImageInfo = { sampler, colorImageView, VK_IMAGE_LAYOUT_GENERAL };
+
+    std::array<VkWriteDescriptorSet, 6> descriptorWrites{};
+    for (uint32_t i = 0; i < imageInfos.size(); i++)
+    {
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].dstSet = shadingDescriptorSet;
+        descriptorWrites[i].dstBinding = i;
+        descriptorWrites[i].dstArrayElement = 0;
+        descriptorWrites[i].descriptorType = i < 3 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].pImageInfo = &imageInfos[i];
+    }
+
+    descriptorWrites[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[5].dstSet = compositeDescriptorSet;
+    descriptorWrites[5].dstBinding = 0;
+    descriptorWrites[5].dstArrayElement = 0;
+    descriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[5].descriptorCount = 1;
+    descriptorWrites[5].pImageInfo = &compositeImageInfo;
+
+    vkUpdateDescriptorSets(helper->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+void DeferredRenderer::createShadingPipeline(const std::vector<VkDescriptorSetLayout>& sceneLayouts)
+{
+    // The G-buffer takes set 1, the draw batch's set in the main pass
+    std::vector<VkDescriptorSetLayout> layouts = sceneLayouts;
+    layouts.insert(layouts.begin() + 1, shadingDescriptorSetLayout);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DeferredShadingPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
+    pipelineLayoutInfo.pSetLayouts = layouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(helper->device, &pipelineLayoutInfo, nullptr, &shadingPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    shadingPipeline = createComputePipeline("shaders/deferredShading.comp.spv");
+    ambientOcclusionPipeline = createComputePipeline("shaders/ambientOcclusion.comp.spv");
+}
+
+VkPipeline DeferredRenderer::createComputePipeline(const std::string& shaderPath)
+{
+    auto computeShaderCode = helper->readFile(shaderPath);
+    VkShaderModule computeShaderModule = helper->createShaderModule(computeShaderCode);
+
+    VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
+    computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    computeShaderStageInfo.module = computeShaderModule;
+    computeShaderStageInfo.pName = "main";
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = computeShaderStageInfo;
+    pipelineInfo.layout = shadingPipelineLayout;
+
+    VkPipeline pipeline;
+    if (vkCreateComputePipelines(helper->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+
+    vkDestroyShaderModule(helper->device, computeShaderModule, nullptr);
+    return pipeline;
+}
+
+void DeferredRenderer::destroyShadingPipeline()
+{
+    if (shadingPipeline == VK_NULL_HANDLE)
+        return;
+
+    vkDestroyPipeline(helper->device, shadingPipeline, nullptr);
+    vkDestroyPipeline(helper->device, ambientOcclusionPipeline, nullptr);
+    vkDestroyPipelineLayout(helper->device, shadingPipelineLayout, nullptr);
+    shadingPipeline = VK_NULL_HANDLE;
+    ambientOcclusionPipeline = VK_NULL_HANDLE;
+    shadingPipelineLayout = VK_NULL_HANDLE;
+}
+
+void DeferredRenderer::createCompositePipeline(VkRenderPass swapChainRenderPass)
+{
+    auto vertShaderCode = helper->readFile("shaders/composite.vert.spv");
+    auto fragShaderCode = helper->readFile("shaders/composite.frag.spv");
+    VkShaderModule vertShaderModule = helper->createShaderModule(vertShaderCode);
+    VkShaderModule fragShaderModule = helper->createShaderModule(fragShaderCode);
+
+    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
+    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vertShaderStageInfo.module = vertShaderModule;
+    vertShaderStageInfo.pName = "main";
+
+    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
+    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    fragShaderStageInfo.module = fragShaderModule;
+    fragShaderStageInfo.pName = "main";
+    VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
+
+    // A single triangle covering the screen, generated from the vertex index
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    std::vector<VkDynamicState> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_FALSE;
+    depthStencil.depthWriteEnable = VK_FALSE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.stencilTestEnable = VK_FALSE;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &compositeDescriptorSetLayout;
+
+    if (vkCreatePipelineLayout(helper->device, &pipelineLayoutInfo, nullptr, &compositePipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = compositePipelineLayout;
+    pipelineInfo.renderPass = swapChainRenderPass;
+    pipelineInfo.subpass = 0;
+
+    if (vkCreateGraphicsPipelines(helper->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &compositePipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create graphics pipeline!");
+    }
+
+    vkDestroyShaderModule(helper->device, vertShaderModule, nullptr);
+    vkDestroyShaderModule(helper->device, fragShaderModule, nullptr);
+}
+
+void DeferredRenderer::beginGeometryPass(VkCommandBuffer commandBuffer, bool clear)
+{
+    std::array<VkClearValue, 3> clearValues{};
+    clearValues[0].color = { {0.0f, 0.0f, 0.0f, 0.0f} };
+    clearValues[1].color = { {0.0f, 0.0f, 0.0f, 0.0f} };
+    clearValues[2].depthStencil = { 1.0f, 0 };
+
+    VkRenderPassBeginInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = clear ? geometryRenderPass : geometryLoadRenderPass;
+    renderPassInfo.framebuffer = framebuffer;
+    renderPassInfo.renderArea.offset = { 0, 0 };
+    renderPassInfo.renderArea.extent = extent;
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = { 0, 0 };
+    scissor.extent = extent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void DeferredRenderer::endGeometryPass(VkCommandBuffer commandBuffer)
+{
+    vkCmdEndRenderPass(commandBuffer);
+}
+
+void DeferredRenderer::shade(VkCommandBuffer commandBuffer, const std::vector<VkDescriptorSet>& sceneSets, const DeferredShadingPushConstants& pushConstants)
+{
+    DeferredShadingPushConstants constants = pushConstants;
+    constants.ambientOcclusionScale = std::min(std::max(ambientOcclusionScale, 1u), static_cast<uint32_t>(MAX_AMBIENT_OCCLUSION_SCALE));
+
+    // Both images are written again, the last frame's composite and shading have to be done reading them
+    std::array<VkImageMemoryBarrier, 2> imageBarriers{};
+    for (VkImageMemoryBarrier& imageBarrier : imageBarriers)
+    {
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.srcAccessMask = 0;
+        imageBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    }
+    imageBarriers[0].image = colorImage;
+    imageBarriers[1].image = ambientOcclusionImage;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+
+    std::vector<VkDescriptorSet> descriptorSets = sceneSets;
+    descriptorSets.insert(descriptorSets.begin() + 1, shadingDescriptorSet);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, shadingPipelineLayout, 0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
+    vkCmdPushConstants(commandBuffer, shadingPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DeferredShadingPushConstants), &constants);
+
+    if (constants.ambientOcclusionEnabled && constants.ambientOcclusionScale > 1)
+    {
+        uint32_t width = (extent.width + constants.ambientOcclusionScale - 1) / constants.ambientOcclusionScale;
+        uint32_t height = (extent.height + constants.ambientOcclusionScale - 1) / constants.ambientOcclusionScale;
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, ambientOcclusionPipeline);
+        vkCmdDispatch(commandBuffer, (width + TILE_SIZE - 1) / TILE_SIZE, (height + TILE_SIZE - 1) / TILE_SIZE, 1);
+
+        VkMemoryBarrier memoryBarrier{};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, shadingPipeline);
+    vkCmdDispatch(commandBuffer, (extent.width + TILE_SIZE - 1) / TILE_SIZE, (extent.height + TILE_SIZE - 1) / TILE_SIZE, 1);
+
+    imageBarriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    imageBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarriers[0]);
+}
+
+void DeferredRenderer::composite(VkCommandBuffer commandBuffer)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, compositePipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, compositePipelineLayout, 0, 1, &compositeDescriptorSet, 0, nullptr);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+}
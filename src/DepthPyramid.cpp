@@ -0,0 +1,232 @@
+#include "DepthPyramid.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+DepthPyramid::DepthPyramid(std::shared_ptr<Helper> helper, VkImageView depthView, VkExtent2D depthExtent) :
+    helper(helper), depthExtent(depthExtent)
+{
+    createImage();
+    createDescriptorSets(depthView);
+    createPipeline();
+}
+
+DepthPyramid::~DepthPyramid()
+{
+    vkDestroyPipeline(helper->device, pipeline, nullptr);
+    vkDestroyPipelineLayout(helper->device, pipelineLayout, nullptr);
+
+    vkFreeDescriptorSets(helper->device, helper->descriptorPool, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data());
+    vkDestroyDescriptorSetLayout(helper->device, descriptorSetLayout, nullptr);
+
+    vkDestroySampler(helper->device, sampler, nullptr);
+    for (VkImageView levelView : levelViews)
+    {
+        vkDestroyImageView(helper->device, levelView, nullptr);
+    }
+    vkDestroyImageView(helper->device, view, nullptr);
+    vkDestroyImage(helper->device, image, nullptr);
+    vkFreeMemory(helper->device, memory, nullptr);
+}
+
+void DepthPyramid::createImage()
+{
+    // Powers of two halve exactly, so the mip sizes Vulkan gives every level are the rounded up ones
+    auto nextPowerOfTwo = [](uint32_t size)
+    {
+        uint32_t powerOfTwo = 1;
+        while (powerOfTwo < size)
+            powerOfTwo *= 2;
+        return powerOfTwo;
+    };
+
+    VkExtent2D extent = { nextPowerOfTwo((depthExtent.width + 1) / 2), nextPowerOfTwo((depthExtent.height + 1) / 2) };
+
+    uint32_t levelCount = 1;
+    while ((std::max(extent.width, extent.height) >> levelCount) > 0)
+        levelCount++;
+
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        levelExtents.push_back({ std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u) });
+    }
+
+    helper->createImage(levelExtents[0].width, levelExtents[0].height, 1, levelCount, VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+    view = helper->createImageView(image, 0, levelCount, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        levelViews.push_back(helper->createImageView(image, level, 1, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT));
+    }
+
+    helper->setNameOfObject(VK_OBJECT_TYPE_IMAGE, (uint64_t)image, "DepthPyramid::Image");
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(helper->device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create texture sampler!");
+    }
+}
+
+void DepthPyramid::createDescriptorSets(VkImageView depthView)
+{
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[0].pImmutableSamplers = nullptr;
+
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(helper->device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+
+    descriptorSets.resize(levelViews.size());
+    std::vector<VkDescriptorSetLayout> layouts(levelViews.size(), descriptorSetLayout);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = helper->descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocInfo.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(helper->device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    for (size_t level = 0; level < levelViews.size(); level++)
+    {
+        VkDescriptorImageInfo sourceInfo{};
+        sourceInfo.sampler = sampler;
+        sourceInfo.imageView = level == 0 ? depthView : levelViews[level - 1];
+        sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorImageInfo destinationInfo{};
+        destinationInfo.imageView = levelViews[level];
+        destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
+        descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[0].dstSet = descriptorSets[level];
+        descriptorWrites[0].dstBinding = 0;
+        descriptorWrites[0].dstArrayElement = 0;
+        descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrites[0].descriptorCount = 1;
+        descriptorWrites[0].pImageInfo = &sourceInfo;
+
+        descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[1].dstSet = descriptorSets[level];
+        descriptorWrites[1].dstBinding = 1;
+        descriptorWrites[1].dstArrayElement = 0;
+        descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        descriptorWrites[1].descriptorCount = 1;
+        descriptorWrites[1].pImageInfo = &destinationInfo;
+
+        vkUpdateDescriptorSets(helper->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+    }
+}
+
+void DepthPyramid::createPipeline()
+{
+    auto computeShaderCode = helper->readFile("shaders/depthPyramid.comp.spv");
+    VkShaderModule computeShaderModule = helper->createShaderModule(computeShaderCode);
+
+    VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
+    computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    computeShaderStageInfo.module = computeShaderModule;
+    computeShaderStageInfo.pName = "main";
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+
+    if (vkCreatePipelineLayout(helper->device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = computeShaderStageInfo;
+    pipelineInfo.layout = pipelineLayout;
+
+    if (vkCreateComputePipelines(helper->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+
+    vkDestroyShaderModule(helper->device, computeShaderModule, nullptr);
+}
+
+void DepthPyramid::build(VkCommandBuffer commandBuffer)
+{
+    // Every level is written again, the previous contents can be discarded once the last reads finished
+    VkImageMemoryBarrier imageBarrier{};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarrier.srcAccessMask = 0;
+    imageBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = image;
+    imageBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, static_cast<uint32_t>(levelViews.size()), 0, 1 };
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    for (size_t level = 0; level < levelViews.size(); level++)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[level], 0, nullptr);
+        vkCmdDispatch(commandBuffer, (levelExtents[level].width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (levelExtents[level].height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+        // The next level, or the culling pass after the last one, reads what was just written
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+}
+
+VkImageView DepthPyramid::getView() const
+{
+    return view;
+}
+
+VkSampler DepthPyramid::getSampler() const
+{
+    return sampler;
+}
+
+uint32_t DepthPyramid::getLevelCount() const
+{
+    return static_cast<uint32_t>(levelViews.size());
+}
+
+VkExtent2D DepthPyramid::getDepthExtent() const
+{
+    return depthExtent;
+}
@@ -0,0 +1,525 @@
+#include "DrawBatch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+
+DrawBatch::DrawBatch(std::shared_ptr<Helper> helper) : helper(helper)
+{
+    createDescriptorSetLayout(*helper);
+
+    placeholder = helper->textureCache->getPlaceholder();
+    sampler = helper->textureCache->getSampler(10);
+
+    createFrameResources();
+}
+
+DrawBatch::~DrawBatch()
+{
+    for (FrameResources& frame : frames)
+    {
+        destroyBuffers(frame);
+    }
+
+    // Frees the sets with it
+    vkDestroyDescriptorPool(helper->device, descriptorPool, nullptr);
+}
+
+void DrawBatch::createDescriptorSetLayout(Helper& helper)
+{
+    if (descriptorSetLayoutCreated)
+        return;
+
+    descriptorSetLayoutCreated = true;
+
+    // A few samplers of the fragment stage are taken by other sets
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(helper.physicalDevice, &properties);
+    uint32_t deviceLimit = std::min(properties.limits.maxPerStageDescriptorSamplers, properties.limits.maxPerStageDescriptorSampledImages);
+    textureCapacity = std::min(MAX_TEXTURES, deviceLimit > 8 ? deviceLimit - 8 : 1);
+
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[0].pImmutableSamplers = nullptr;
+
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[1].descriptorCount = textureCapacity;
+    bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    bindings[1].pImmutableSamplers = nullptr;
+
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    bindings[2].pImmutableSamplers = nullptr;
+
+    bindings[3].binding = 3;
+    bindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[3].descriptorCount = 1;
+    bindings[3].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[3].pImmutableSamplers = nullptr;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(helper.device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+}
+
+void DrawBatch::destroyDescriptorSetLayout(Helper& helper)
+{
+    if (descriptorSetLayoutCreated)
+    {
+        vkDestroyDescriptorSetLayout(helper.device, descriptorSetLayout, nullptr);
+        descriptorSetLayoutCreated = false;
+    }
+}
+
+void DrawBatch::createFrameResources()
+{
+    uint32_t frameCount = static_cast<uint32_t>(helper->MAX_FRAMES_IN_FLIGHT);
+
+    // Own pool, the texture arrays would use up most of the shared one
+    std::array<VkDescriptorPoolSize, 2> poolSizes{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = frameCount * 3;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = frameCount * textureCapacity;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = frameCount;
+
+    if (vkCreateDescriptorPool(helper->device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor pool!");
+    }
+
+    frames.resize(frameCount);
+
+    std::vector<VkDescriptorSetLayout> layouts(frameCount, descriptorSetLayout);
+    std::vector<VkDescriptorSet> descriptorSets(frameCount);
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = frameCount;
+    allocInfo.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(helper->device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    for (uint32_t i = 0; i < frameCount; i++)
+    {
+        FrameResources& frame = frames[i];
+        frame.descriptorSet = descriptorSets[i];
+        frame.slotTextures.resize(textureCapacity);
+        frame.slotViews.resize(textureCapacity, VK_NULL_HANDLE);
+
+        createDrawBuffer(frame, 256);
+        createCommandBuffer(frame, 1024);
+        createInstanceBuffer(frame, 1024);
+    }
+}
+
+void DrawBatch::createDrawBuffer(FrameResources& frame, uint32_t capacity)
+{
+    VkDeviceSize size = sizeof(DrawData) * capacity;
+    helper->createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.drawBuffer, frame.drawBufferMemory);
+    vkMapMemory(helper->device, frame.drawBufferMemory, 0, size, 0, &frame.drawBufferMapped);
+    frame.drawCapacity = capacity;
+
+    helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)frame.drawBuffer, "DrawBatch::Draw Data Buffer");
+
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = frame.drawBuffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = frame.descriptorSet;
+    descriptorWrite.dstBinding = 0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(helper->device, 1, &descriptorWrite, 0, nullptr);
+
+    frame.resourcesChanged = true;
+}
+
+void DrawBatch::createCommandBuffer(FrameResources& frame, uint32_t capacity)
+{
+    VkDeviceSize size = sizeof(VkDrawIndexedIndirectCommand) * capacity;
+    helper->createBuffer(size, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.commandBuffer, frame.commandBufferMemory);
+    vkMapMemory(helper->device, frame.commandBufferMemory, 0, size, 0, &frame.commandBufferMapped);
+    frame.commandCapacity = capacity;
+
+    helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)frame.commandBuffer, "DrawBatch::Draw Command Buffer");
+
+    frame.resourcesChanged = true;
+}
+
+void DrawBatch::createInstanceBuffer(FrameResources& frame, uint32_t capacity)
+{
+    VkDeviceSize size = sizeof(uint32_t) * capacity;
+    helper->createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.instanceBuffer, frame.instanceBufferMemory);
+    vkMapMemory(helper->device, frame.instanceBufferMemory, 0, size, 0, &frame.instanceBufferMapped);
+    frame.instanceCapacity = capacity;
+
+    helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)frame.instanceBuffer, "DrawBatch::Instance Buffer");
+
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = frame.instanceBuffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = frame.descriptorSet;
+    descriptorWrite.dstBinding = 2;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(helper->device, 1, &descriptorWrite, 0, nullptr);
+
+    frame.resourcesChanged = true;
+}
+
+void DrawBatch::destroyBuffers(FrameResources& frame)
+{
+    vkDestroyBuffer(helper->device, frame.drawBuffer, nullptr);
+    vkFreeMemory(helper->device, frame.drawBufferMemory, nullptr);
+    vkDestroyBuffer(helper->device, frame.commandBuffer, nullptr);
+    vkFreeMemory(helper->device, frame.commandBufferMemory, nullptr);
+    vkDestroyBuffer(helper->device, frame.instanceBuffer, nullptr);
+    vkFreeMemory(helper->device, frame.instanceBufferMemory, nullptr);
+}
+
+void DrawBatch::begin(uint32_t currentFrame)
+{
+    this->currentFrame = currentFrame;
+
+    draws.clear();
+    for (auto& passInstances : instances)
+    {
+        passInstances.clear();
+    }
+
+    textures.clear();
+    textureSlots.clear();
+    textures.push_back(placeholder);
+}
+
+uint32_t DrawBatch::addDraw(uint32_t transform, const std::shared_ptr<Texture>& texture)
+{
+    DrawData draw{};
+    draw.transformIndex = transform;
+    draw.textureIndex = 0;
+    draw.textureFeedbackSlot = texture ? texture->feedbackSlot : UINT32_MAX;
+    draw.textureBaseMip = texture ? texture->baseMip : 0;
+
+    if (texture)
+    {
+        auto it = textureSlots.find(texture.get());
+        if (it != textureSlots.end())
+        {
+            draw.textureIndex = it->second;
+        }
+        else if (textures.size() < textureCapacity)
+        {
+            // Past the capacity the placeholder stands in
+            draw.textureIndex = static_cast<uint32_t>(textures.size());
+            textureSlots[texture.get()] = draw.textureIndex;
+            textures.push_back(texture);
+        }
+    }
+
+    draws.push_back(draw);
+    return static_cast<uint32_t>(draws.size() - 1);
+}
+
+void DrawBatch::addCommand(DrawBatchPass pass, uint32_t drawIndex, const Mesh& mesh, const MeshLod& lod)
+{
+    if (lod.indexCount == 0 || !mesh.geometry.isValid())
+        return;
+
+    Instance instance{};
+    instance.block = mesh.geometry.block;
+    instance.firstIndex = mesh.firstIndex + lod.firstIndex;
+    instance.indexCount = lod.indexCount;
+    instance.vertexOffset = mesh.vertexOffset;
+    instance.drawIndex = drawIndex;
+
+    instances[pass].push_back(instance);
+}
+
+void DrawBatch::buildCommands(DrawBatchPass pass)
+{
+    std::vector<Instance>& passInstances = instances[pass];
+
+    // Sorting by geometry puts the instances of a mesh level next to each other and the commands of a block in one run
+    std::sort(passInstances.begin(), passInstances.end(), [](const Instance& a, const Instance& b)
+    {
+        return std::tie(a.block, a.firstIndex, a.indexCount, a.vertexOffset, a.drawIndex) < std::tie(b.block, b.firstIndex, b.indexCount, b.vertexOffset, b.drawIndex);
+    });
+
+    firstCommands[pass] = static_cast<uint32_t>(commands.size());
+    runs[pass].clear();
+
+    for (size_t i = 0; i < passInstances.size(); i++)
+    {
+        const Instance& instance = passInstances[i];
+        const Instance* previous = i > 0 ? &passInstances[i - 1] : nullptr;
+
+        bool sameGeometry = previous && previous->block == instance.block && previous->firstIndex == instance.firstIndex &&
+            previous->indexCount == instance.indexCount && previous->vertexOffset == instance.vertexOffset;
+
+        if (instancing && sameGeometry)
+        {
+            commands.back().instanceCount++;
+        }
+        else
+        {
+            VkDrawIndexedIndirectCommand command{};
+            command.indexCount = instance.indexCount;
+            command.instanceCount = 1;
+            command.firstIndex = instance.firstIndex;
+            command.vertexOffset = instance.vertexOffset;
+            command.firstInstance = static_cast<uint32_t>(instanceDrawIndices.size());
+            commands.push_back(command);
+
+            uint32_t commandIndex = static_cast<uint32_t>(commands.size()) - 1 - firstCommands[pass];
+            if (runs[pass].empty() || runs[pass].back().block != instance.block)
+                runs[pass].push_back({ instance.block, commandIndex, 0 });
+            runs[pass].back().commandCount++;
+        }
+
+        instanceDrawIndices.push_back(instance.drawIndex);
+    }
+
+    commandCounts[pass] = static_cast<uint32_t>(commands.size()) - firstCommands[pass];
+}
+
+void DrawBatch::end()
+{
+    FrameResources& frame = frames[currentFrame];
+
+    // Draws first, each pointing at itself
+    instanceDrawIndices.resize(draws.size());
+    for (uint32_t i = 0; i < draws.size(); i++)
+    {
+        instanceDrawIndices[i] = i;
+    }
+
+    commands.clear();
+    buildCommands(DRAW_BATCH_SHADOW_PASS);
+    buildCommands(DRAW_BATCH_VOXELIZATION_PASS);
+    buildCommands(DRAW_BATCH_MAIN_PASS);
+
+    // The frame's previous buffers are no longer in use, so they can be replaced right away
+    if (draws.size() > frame.drawCapacity)
+    {
+        uint32_t capacity = frame.drawCapacity;
+        while (capacity < draws.size())
+            capacity *= 2;
+
+        vkDestroyBuffer(helper->device, frame.drawBuffer, nullptr);
+        vkFreeMemory(helper->device, frame.drawBufferMemory, nullptr);
+        createDrawBuffer(frame, capacity);
+    }
+
+    if (commands.size() > frame.commandCapacity)
+    {
+        uint32_t capacity = frame.commandCapacity;
+        while (capacity < commands.size())
+            capacity *= 2;
+
+        vkDestroyBuffer(helper->device, frame.commandBuffer, nullptr);
+        vkFreeMemory(helper->device, frame.commandBufferMemory, nullptr);
+        createCommandBuffer(frame, capacity);
+    }
+
+    if (instanceDrawIndices.size() > frame.instanceCapacity)
+    {
+        uint32_t capacity = frame.instanceCapacity;
+        while (capacity < instanceDrawIndices.size())
+            capacity *= 2;
+
+        vkDestroyBuffer(helper->device, frame.instanceBuffer, nullptr);
+        vkFreeMemory(helper->device, frame.instanceBufferMemory, nullptr);
+        createInstanceBuffer(frame, capacity);
+    }
+
+    memcpy(frame.drawBufferMapped, draws.data(), sizeof(DrawData) * draws.size());
+    memcpy(frame.commandBufferMapped, commands.data(), sizeof(VkDrawIndexedIndirectCommand) * commands.size());
+    memcpy(frame.instanceBufferMapped, instanceDrawIndices.data(), sizeof(uint32_t) * instanceDrawIndices.size());
+
+    updateTextures(frame);
+    updateTransformBuffer(frame);
+    updatePassVersions(frame);
+}
+
+void DrawBatch::updateTransformBuffer(FrameResources& frame)
+{
+    VkBuffer transformBuffer = helper->transforms->getBuffer(currentFrame);
+    if (frame.transformBuffer == transformBuffer)
+        return;
+
+    frame.transformBuffer = transformBuffer;
+
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = transformBuffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = frame.descriptorSet;
+    descriptorWrite.dstBinding = 3;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(helper->device, 1, &descriptorWrite, 0, nullptr);
+
+    frame.resourcesChanged = true;
+}
+
+void DrawBatch::updatePassVersions(FrameResources& frame)
+{
+    // Blocks destroyed and created again may come back with the same handle
+    uint64_t arenaGeneration = helper->geometryArena->getGeneration();
+    if (frame.arenaGeneration != arenaGeneration)
+    {
+        frame.arenaGeneration = arenaGeneration;
+        frame.resourcesChanged = true;
+    }
+
+    for (uint32_t pass = 0; pass < DRAW_BATCH_PASS_COUNT; pass++)
+    {
+        const std::vector<Run>& passRuns = runs[pass];
+        const std::vector<Run>& recordedRuns = frame.recordedRuns[pass];
+
+        bool runsChanged = passRuns.size() != recordedRuns.size() || frame.recordedFirstCommands[pass] != firstCommands[pass];
+        for (size_t i = 0; !runsChanged && i < passRuns.size(); i++)
+        {
+            runsChanged = passRuns[i].block != recordedRuns[i].block || passRuns[i].firstCommand != recordedRuns[i].firstCommand ||
+                passRuns[i].commandCount != recordedRuns[i].commandCount;
+        }
+
+        if (runsChanged || frame.resourcesChanged)
+        {
+            frame.recordedRuns[pass] = passRuns;
+            frame.recordedFirstCommands[pass] = firstCommands[pass];
+            frame.passVersions[pass]++;
+        }
+    }
+
+    frame.resourcesChanged = false;
+}
+
+void DrawBatch::updateTextures(FrameResources& frame)
+{
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    std::vector<VkWriteDescriptorSet> descriptorWrites;
+    imageInfos.reserve(textureCapacity);
+    descriptorWrites.reserve(textureCapacity);
+
+    // Unused slots fall back to the placeholder, which keeps every descriptor valid
+    for (uint32_t slot = 0; slot < textureCapacity; slot++)
+    {
+        const std::shared_ptr<Texture>& texture = slot < textures.size() ? textures[slot] : placeholder;
+        if (frame.slotViews[slot] == texture->view && frame.slotTextures[slot] == texture)
+            continue;
+
+        frame.slotTextures[slot] = texture;
+        frame.slotViews[slot] = texture->view;
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = texture->view;
+        imageInfo.sampler = sampler;
+        imageInfos.push_back(imageInfo);
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = frame.descriptorSet;
+        descriptorWrite.dstBinding = 1;
+        descriptorWrite.dstArrayElement = slot;
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.pImageInfo = &imageInfos.back();
+        descriptorWrites.push_back(descriptorWrite);
+    }
+
+    if (!descriptorWrites.empty())
+    {
+        vkUpdateDescriptorSets(helper->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        frame.resourcesChanged = true;
+    }
+}
+
+void DrawBatch::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set, VkPipelineBindPoint bindPoint)
+{
+    vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, set, 1, &frames[currentFrame].descriptorSet, 0, nullptr);
+}
+
+void DrawBatch::draw(VkCommandBuffer commandBuffer, DrawBatchPass pass)
+{
+    for (const Run& run : runs[pass])
+    {
+        VkBuffer buffer = helper->geometryArena->getBuffer(run.block);
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer, &offset);
+        vkCmdBindIndexBuffer(commandBuffer, buffer, 0, VK_INDEX_TYPE_UINT32);
+
+        VkDeviceSize commandOffset = sizeof(VkDrawIndexedIndirectCommand) * (firstCommands[pass] + run.firstCommand);
+        vkCmdDrawIndexedIndirect(commandBuffer, frames[currentFrame].commandBuffer, commandOffset, run.commandCount, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+uint32_t DrawBatch::getDrawCount() const
+{
+    return static_cast<uint32_t>(draws.size());
+}
+
+uint32_t DrawBatch::getTextureCount() const
+{
+    return static_cast<uint32_t>(textures.size());
+}
+
+uint32_t DrawBatch::getMultiDrawCount(DrawBatchPass pass) const
+{
+    return static_cast<uint32_t>(runs[pass].size());
+}
+
+uint32_t DrawBatch::getCommandCount(DrawBatchPass pass) const
+{
+    return commandCounts[pass];
+}
+
+uint32_t DrawBatch::getInstanceCount(DrawBatchPass pass) const
+{
+    return static_cast<uint32_t>(instances[pass].size());
+}
+
+uint64_t DrawBatch::getPassVersion(DrawBatchPass pass) const
+{
+    return frames[currentFrame].passVersions[pass];
+}
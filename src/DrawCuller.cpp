@@ -0,0 +1,427 @@
+#include "DrawCuller.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+DrawCuller::DrawCuller(std::shared_ptr<Helper> helper, VkImageView depthView, VkExtent2D depthExtent) : helper(helper)
+{
+    createDescriptorSetLayout(*helper);
+    depthPyramid = std::make_unique<DepthPyramid>(helper, depthView, depthExtent);
+    createVisibilityBuffer(1024);
+    createFrameResources();
+    createPipeline();
+}
+
+DrawCuller::~DrawCuller()
+{
+    for (FrameResources& frame : frames)
+    {
+        destroyDrawBuffers(frame);
+        destroyCountBuffer(frame);
+        vkFreeDescriptorSets(helper->device, helper->descriptorPool, 1, &frame.descriptorSet);
+    }
+
+    for (RetiredBuffer& retired : retiredVisibilityBuffers)
+    {
+        vkDestroyBuffer(helper->device, retired.buffer, nullptr);
+        vkFreeMemory(helper->device, retired.memory, nullptr);
+    }
+    vkDestroyBuffer(helper->device, visibilityBuffer, nullptr);
+    vkFreeMemory(helper->device, visibilityBufferMemory, nullptr);
+
+    vkDestroyPipeline(helper->device, pipeline, nullptr);
+    vkDestroyPipelineLayout(helper->device, pipelineLayout, nullptr);
+}
+
+void DrawCuller::createDescriptorSetLayout(Helper& helper)
+{
+    if (descriptorSetLayoutCreated)
+        return;
+
+    descriptorSetLayoutCreated = true;
+
+    std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+    for (uint32_t i = 0; i < bindings.size(); i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        bindings[i].pImmutableSamplers = nullptr;
+    }
+    bindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    if (vkCreateDescriptorSetLayout(helper.device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+}
+
+void DrawCuller::destroyDescriptorSetLayout(Helper& helper)
+{
+    if (descriptorSetLayoutCreated)
+    {
+        vkDestroyDescriptorSetLayout(helper.device, descriptorSetLayout, nullptr);
+        descriptorSetLayoutCreated = false;
+    }
+}
+
+void DrawCuller::createFrameResources()
+{
+    frames.resize(helper->MAX_FRAMES_IN_FLIGHT);
+
+    std::vector<VkDescriptorSetLayout> layouts(frames.size(), descriptorSetLayout);
+    std::vector<VkDescriptorSet> descriptorSets(frames.size());
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = helper->descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocInfo.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(helper->device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate descriptor sets!");
+    }
+
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        frames[i].descriptorSet = descriptorSets[i];
+        createDrawBuffers(frames[i], 1024);
+        createCountBuffer(frames[i], 64);
+        writeDescriptorSet(frames[i]);
+        writeDepthPyramidDescriptor(frames[i]);
+    }
+}
+
+void DrawCuller::createDrawBuffers(FrameResources& frame, uint32_t capacity)
+{
+    VkDeviceSize inputSize = sizeof(DrawCullInput) * capacity;
+    helper->createBuffer(inputSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.inputBuffer, frame.inputBufferMemory);
+    vkMapMemory(helper->device, frame.inputBufferMemory, 0, inputSize, 0, &frame.inputBufferMapped);
+
+    VkDeviceSize commandSize = sizeof(VkDrawIndexedIndirectCommand) * capacity * DRAW_CULL_PHASE_COUNT;
+    helper->createBuffer(commandSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.commandBuffer, frame.commandBufferMemory);
+
+    frame.drawCapacity = capacity;
+
+    helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)frame.inputBuffer, "DrawCuller::Input Buffer");
+    helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)frame.commandBuffer, "DrawCuller::Draw Command Buffer");
+}
+
+void DrawCuller::createCountBuffer(FrameResources& frame, uint32_t capacity)
+{
+    VkDeviceSize size = sizeof(uint32_t) * capacity * DRAW_CULL_PHASE_COUNT;
+    helper->createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.countBuffer, frame.countBufferMemory);
+    frame.runCapacity = capacity;
+
+    helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)frame.countBuffer, "DrawCuller::Draw Count Buffer");
+}
+
+void DrawCuller::createVisibilityBuffer(uint32_t capacity)
+{
+    VkDeviceSize size = sizeof(uint32_t) * capacity;
+    helper->createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, visibilityBuffer, visibilityBufferMemory);
+    visibilityCapacity = capacity;
+
+    // Nothing counts as visible yet, the second phase tests every draw of the first frame
+    void* data;
+    vkMapMemory(helper->device, visibilityBufferMemory, 0, size, 0, &data);
+    memset(data, 0, size);
+    vkUnmapMemory(helper->device, visibilityBufferMemory);
+
+    helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)visibilityBuffer, "DrawCuller::Visibility Buffer");
+}
+
+void DrawCuller::destroyDrawBuffers(FrameResources& frame)
+{
+    vkDestroyBuffer(helper->device, frame.inputBuffer, nullptr);
+    vkFreeMemory(helper->device, frame.inputBufferMemory, nullptr);
+    vkDestroyBuffer(helper->device, frame.commandBuffer, nullptr);
+    vkFreeMemory(helper->device, frame.commandBufferMemory, nullptr);
+}
+
+void DrawCuller::destroyCountBuffer(FrameResources& frame)
+{
+    vkDestroyBuffer(helper->device, frame.countBuffer, nullptr);
+    vkFreeMemory(helper->device, frame.countBufferMemory, nullptr);
+}
+
+void DrawCuller::writeDescriptorSet(FrameResources& frame)
+{
+    std::array<VkDescriptorBufferInfo, 4> bufferInfos{};
+    bufferInfos[0].buffer = frame.inputBuffer;
+    bufferInfos[1].buffer = frame.commandBuffer;
+    bufferInfos[2].buffer = frame.countBuffer;
+    bufferInfos[3].buffer = visibilityBuffer;
+
+    std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
+    for (uint32_t i = 0; i < descriptorWrites.size(); i++)
+    {
+        bufferInfos[i].offset = 0;
+        bufferInfos[i].range = VK_WHOLE_SIZE;
+
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].dstSet = frame.descriptorSet;
+        descriptorWrites[i].dstBinding = i;
+        descriptorWrites[i].dstArrayElement = 0;
+        descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    vkUpdateDescriptorSets(helper->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+    frame.visibilityBuffer = visibilityBuffer;
+}
+
+void DrawCuller::writeDepthPyramidDescriptor(FrameResources& frame)
+{
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.sampler = depthPyramid->getSampler();
+    imageInfo.imageView = depthPyramid->getView();
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = frame.descriptorSet;
+    descriptorWrite.dstBinding = 4;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(helper->device, 1, &descriptorWrite, 0, nullptr);
+}
+
+void DrawCuller::createPipeline()
+{
+    auto computeShaderCode = helper->readFile("shaders/drawCull.comp.spv");
+    VkShaderModule computeShaderModule = helper->createShaderModule(computeShaderCode);
+
+    VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
+    computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    computeShaderStageInfo.module = computeShaderModule;
+    computeShaderStageInfo.pName = "main";
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawCullPushConstants);
+
+    // The DrawBatch set provides the draws' transform indices and the matrices
+    std::vector<VkDescriptorSetLayout> layouts = { DrawBatch::descriptorSetLayout, descriptorSetLayout };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
+    pipelineLayoutInfo.pSetLayouts = layouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(helper->device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = computeShaderStageInfo;
+    pipelineInfo.layout = pipelineLayout;
+
+    if (vkCreateComputePipelines(helper->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+
+    vkDestroyShaderModule(helper->device, computeShaderModule, nullptr);
+}
+
+void DrawCuller::resize(VkImageView depthView, VkExtent2D depthExtent)
+{
+    depthPyramid = std::make_unique<DepthPyramid>(helper, depthView, depthExtent);
+
+    for (FrameResources& frame : frames)
+    {
+        writeDepthPyramidDescriptor(frame);
+    }
+}
+
+void DrawCuller::begin(uint32_t currentFrame)
+{
+    this->currentFrame = currentFrame;
+
+    inputs.clear();
+    runs.clear();
+    visibilityCount = 0;
+
+    for (auto it = retiredVisibilityBuffers.begin(); it != retiredVisibilityBuffers.end();)
+    {
+        if (--it->framesLeft > 0)
+        {
+            it++;
+            continue;
+        }
+
+        vkDestroyBuffer(helper->device, it->buffer, nullptr);
+        vkFreeMemory(helper->device, it->memory, nullptr);
+        it = retiredVisibilityBuffers.erase(it);
+    }
+}
+
+void DrawCuller::addDraw(uint32_t drawIndex, const Mesh& mesh, const MeshLod& lod)
+{
+    if (lod.indexCount == 0 || !mesh.geometry.isValid())
+        return;
+
+    // Draws come in draw list order, which already groups them by block
+    uint32_t drawCount = static_cast<uint32_t>(inputs.size());
+    if (runs.empty() || runs.back().block != mesh.geometry.block)
+        runs.push_back({ mesh.geometry.block, drawCount, 0 });
+    runs.back().commandCount++;
+
+    DrawCullInput input{};
+    input.boundsMin = mesh.boundsMin;
+    input.drawIndex = drawIndex;
+    input.boundsMax = mesh.boundsMax;
+    input.run = static_cast<uint32_t>(runs.size() - 1);
+    input.indexCount = lod.indexCount;
+    input.firstIndex = mesh.firstIndex + lod.firstIndex;
+    input.vertexOffset = mesh.vertexOffset;
+    input.firstCommand = runs.back().firstCommand;
+
+    inputs.push_back(input);
+    visibilityCount = std::max(visibilityCount, drawIndex + 1);
+}
+
+void DrawCuller::end()
+{
+    FrameResources& frame = frames[currentFrame];
+
+    // The frame's previous buffers are no longer in use, so they can be replaced right away
+    bool buffersReplaced = false;
+    if (inputs.size() > frame.drawCapacity)
+    {
+        uint32_t capacity = frame.drawCapacity;
+        while (capacity < inputs.size())
+            capacity *= 2;
+
+        destroyDrawBuffers(frame);
+        createDrawBuffers(frame, capacity);
+        buffersReplaced = true;
+    }
+
+    if (runs.size() > frame.runCapacity)
+    {
+        uint32_t capacity = frame.runCapacity;
+        while (capacity < runs.size())
+            capacity *= 2;
+
+        destroyCountBuffer(frame);
+        createCountBuffer(frame, capacity);
+        buffersReplaced = true;
+    }
+
+    // The other frames may still be reading the visibility buffer
+    if (visibilityCount > visibilityCapacity)
+    {
+        uint32_t capacity = visibilityCapacity;
+        while (capacity < visibilityCount)
+            capacity *= 2;
+
+        retiredVisibilityBuffers.push_back({ visibilityBuffer, visibilityBufferMemory, static_cast<uint32_t>(helper->MAX_FRAMES_IN_FLIGHT) });
+        createVisibilityBuffer(capacity);
+    }
+
+    if (buffersReplaced || frame.visibilityBuffer != visibilityBuffer)
+        writeDescriptorSet(frame);
+
+    memcpy(frame.inputBufferMapped, inputs.data(), sizeof(DrawCullInput) * inputs.size());
+}
+
+void DrawCuller::dispatch(VkCommandBuffer commandBuffer, DrawBatch& drawBatch, const glm::mat4& viewProjection, DrawCullPhase phase)
+{
+    FrameResources& frame = frames[currentFrame];
+
+    DrawCullPushConstants pushConstants{};
+    pushConstants.viewProjection = viewProjection;
+    pushConstants.depthExtent = glm::vec2(depthPyramid->getDepthExtent().width, depthPyramid->getDepthExtent().height);
+    pushConstants.inputCount = static_cast<uint32_t>(inputs.size());
+    pushConstants.phase = phase;
+    pushConstants.commandOffset = frame.drawCapacity * phase;
+    pushConstants.countOffset = frame.runCapacity * phase;
+    pushConstants.occlusionCulling = occlusionCulling ? VK_TRUE : VK_FALSE;
+    pushConstants.depthPyramidLevelCount = depthPyramid->getLevelCount();
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    drawBatch.bind(commandBuffer, pipelineLayout, 0, VK_PIPELINE_BIND_POINT_COMPUTE);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 1, 1, &frame.descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DrawCullPushConstants), &pushConstants);
+
+    vkCmdDispatch(commandBuffer, (pushConstants.inputCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+    // The second phase reads the visibility the first one was drawn with
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+void DrawCuller::cull(VkCommandBuffer commandBuffer, DrawBatch& drawBatch, const glm::mat4& viewProjection)
+{
+    if (inputs.empty())
+        return;
+
+    FrameResources& frame = frames[currentFrame];
+
+    // The counts of both phases
+    vkCmdFillBuffer(commandBuffer, frame.countBuffer, 0, VK_WHOLE_SIZE, 0);
+
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    dispatch(commandBuffer, drawBatch, viewProjection, DRAW_CULL_FIRST_PHASE);
+}
+
+void DrawCuller::cullOccluded(VkCommandBuffer commandBuffer, DrawBatch& drawBatch, const glm::mat4& viewProjection)
+{
+    if (inputs.empty())
+        return;
+
+    depthPyramid->build(commandBuffer);
+    dispatch(commandBuffer, drawBatch, viewProjection, DRAW_CULL_SECOND_PHASE);
+}
+
+void DrawCuller::draw(VkCommandBuffer commandBuffer, DrawCullPhase phase)
+{
+    FrameResources& frame = frames[currentFrame];
+
+    for (uint32_t i = 0; i < runs.size(); i++)
+    {
+        const Run& run = runs[i];
+
+        VkBuffer buffer = helper->geometryArena->getBuffer(run.block);
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer, &offset);
+        vkCmdBindIndexBuffer(commandBuffer, buffer, 0, VK_INDEX_TYPE_UINT32);
+
+        VkDeviceSize commandOffset = sizeof(VkDrawIndexedIndirectCommand) * (frame.drawCapacity * phase + run.firstCommand);
+        VkDeviceSize countOffset = sizeof(uint32_t) * (frame.runCapacity * phase + i);
+        vkCmdDrawIndexedIndirectCount(commandBuffer, frame.commandBuffer, commandOffset, frame.countBuffer, countOffset, run.commandCount, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+uint32_t DrawCuller::getDrawCount() const
+{
+    return static_cast<uint32_t>(inputs.size());
+}
@@ -0,0 +1,71 @@
+#include "DrawList.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace
+{
+    const Texture* getMaterial(const DrawListEntry& entry)
+    {
+        return entry.renderObject->model->textures[entry.mesh->materialIndex].get();
+    }
+}
+
+void DrawList::build(const std::vector<std::shared_ptr<RenderObject>>& renderObjects)
+{
+    entries.clear();
+
+    uint32_t drawIndex = 0;
+    for (uint32_t i = 0; i < renderObjects.size(); i++)
+    {
+        for (uint32_t j = 0; j < renderObjects[i]->model->meshes.size(); j++)
+        {
+            DrawListEntry entry{};
+            entry.renderObject = renderObjects[i].get();
+            entry.mesh = renderObjects[i]->model->meshes[j].get();
+            entry.renderObjectIndex = i;
+            entry.meshIndex = j;
+            entry.drawIndex = drawIndex++;
+            entries.push_back(entry);
+        }
+    }
+
+    // The geometry offset tells meshes apart, render objects only break ties to keep the order deterministic
+    std::sort(entries.begin(), entries.end(), [](const DrawListEntry& a, const DrawListEntry& b)
+    {
+        return std::make_tuple(a.mesh->geometry.block, a.mesh->geometry.offset, getMaterial(a), a.renderObjectIndex) <
+            std::make_tuple(b.mesh->geometry.block, b.mesh->geometry.offset, getMaterial(b), b.renderObjectIndex);
+    });
+
+    meshChangeCount = 0;
+    materialChangeCount = 0;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (i == 0 || entries[i].mesh != entries[i - 1].mesh)
+            meshChangeCount++;
+        if (i == 0 || getMaterial(entries[i]) != getMaterial(entries[i - 1]))
+            materialChangeCount++;
+    }
+
+    buildCount++;
+}
+
+const std::vector<DrawListEntry>& DrawList::getEntries() const
+{
+    return entries;
+}
+
+uint32_t DrawList::getMeshChangeCount() const
+{
+    return meshChangeCount;
+}
+
+uint32_t DrawList::getMaterialChangeCount() const
+{
+    return materialChangeCount;
+}
+
+uint32_t DrawList::getBuildCount() const
+{
+    return buildCount;
+}
@@ -0,0 +1,155 @@
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLER_SSE
+#endif
+
+void FrustumCuller::updateBounds(const DrawList& drawList)
+{
+    const std::vector<DrawListEntry>& entries = drawList.getEntries();
+
+    // Padded to a multiple of four with empty boxes at the origin, the SSE path reads whole groups
+    size_t paddedCount = (entries.size() + 3) / 4 * 4;
+    for (std::vector<float>* values : { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ })
+    {
+        values->assign(paddedCount, 0.0f);
+    }
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const Mesh& mesh = *entries[i].mesh;
+        const glm::mat4& model = entries[i].renderObject->getModelMatrix();
+
+        glm::vec3 center = glm::vec3(model * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+
+        // Extent of the transformed box along each world axis
+        glm::vec3 localExtent = (mesh.boundsMax - mesh.boundsMin) * 0.5f;
+        glm::mat3 absolute = glm::mat3(model);
+        for (int column = 0; column < 3; column++)
+        {
+            absolute[column] = glm::abs(absolute[column]);
+        }
+        glm::vec3 extent = absolute * localExtent;
+
+        centerX[i] = center.x;
+        centerY[i] = center.y;
+        centerZ[i] = center.z;
+        extentX[i] = extent.x;
+        extentY[i] = extent.y;
+        extentZ[i] = extent.z;
+    }
+}
+
+std::array<glm::vec4, 6> FrustumCuller::extractPlanes(const glm::mat4& viewProjection)
+{
+    glm::vec4 row0 = glm::vec4(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+    glm::vec4 row1 = glm::vec4(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+    glm::vec4 row2 = glm::vec4(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+    glm::vec4 row3 = glm::vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+    return { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row2, row3 - row2 };
+}
+
+void FrustumCuller::cull(const DrawList& drawList, const glm::mat4& viewProjection, bool transformsChanged, const SceneBvh* bvh)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    uint32_t entryCount = static_cast<uint32_t>(drawList.getEntries().size());
+    visible.assign(entryCount, 1);
+    visibleCount = entryCount;
+
+    if (enabled && bvh)
+    {
+        visibleEntries.clear();
+        bvh->queryFrustum(extractPlanes(viewProjection), visibleEntries);
+
+        std::fill(visible.begin(), visible.end(), 0);
+        for (uint32_t entry : visibleEntries)
+        {
+            visible[entry] = 1;
+        }
+        visibleCount = static_cast<uint32_t>(visibleEntries.size());
+
+        // The boxes below are stale until the linear path runs again
+        drawListBuildCount = UINT32_MAX;
+    }
+    else if (enabled)
+    {
+        if (transformsChanged || drawListBuildCount != drawList.getBuildCount())
+        {
+            updateBounds(drawList);
+            drawListBuildCount = drawList.getBuildCount();
+        }
+
+        std::array<glm::vec4, 6> planes = extractPlanes(viewProjection);
+
+        visibleCount = 0;
+
+        for (uint32_t first = 0; first < entryCount; first += 4)
+        {
+#ifdef FRUSTUM_CULLER_SSE
+            __m128 cx = _mm_loadu_ps(&centerX[first]);
+            __m128 cy = _mm_loadu_ps(&centerY[first]);
+            __m128 cz = _mm_loadu_ps(&centerZ[first]);
+            __m128 ex = _mm_loadu_ps(&extentX[first]);
+            __m128 ey = _mm_loadu_ps(&extentY[first]);
+            __m128 ez = _mm_loadu_ps(&extentZ[first]);
+
+            // A box is outside once it lies entirely behind any plane
+            __m128 outside = _mm_setzero_ps();
+            for (const glm::vec4& plane : planes)
+            {
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+                    _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::abs(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(std::abs(plane.y)))),
+                    _mm_mul_ps(ez, _mm_set1_ps(std::abs(plane.z))));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+            }
+
+            int outsideMask = _mm_movemask_ps(outside);
+            for (uint32_t i = 0; i < 4 && first + i < entryCount; i++)
+            {
+                visible[first + i] = (outsideMask & (1 << i)) == 0;
+                visibleCount += visible[first + i];
+            }
+#else
+            for (uint32_t i = first; i < first + 4 && i < entryCount; i++)
+            {
+                bool outside = false;
+                for (const glm::vec4& plane : planes)
+                {
+                    float distance = centerX[i] * plane.x + centerY[i] * plane.y + centerZ[i] * plane.z + plane.w;
+                    float radius = extentX[i] * std::abs(plane.x) + extentY[i] * std::abs(plane.y) + extentZ[i] * std::abs(plane.z);
+                    outside = outside || distance + radius < 0.0f;
+                }
+
+                visible[i] = !outside;
+                visibleCount += visible[i];
+            }
+#endif
+        }
+    }
+
+    cullTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+bool FrustumCuller::isVisible(uint32_t entry) const
+{
+    return visible[entry] != 0;
+}
+
+uint32_t FrustumCuller::getVisibleCount() const
+{
+    return visibleCount;
+}
+
+float FrustumCuller::getCullTime() const
+{
+    return cullTime;
+}
@@ -0,0 +1,219 @@
+#include "GeometryArena.h"
+#include "Helper.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+GeometryArena::GeometryArena(Helper& helper) : helper(helper)
+{}
+
+GeometryArena::~GeometryArena()
+{
+    for (Block& block : blocks)
+    {
+        vkDestroyBuffer(helper.device, block.buffer, nullptr);
+        vkFreeMemory(helper.device, block.memory, nullptr);
+    }
+}
+
+VkDeviceSize GeometryArena::align(VkDeviceSize size)
+{
+    return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+GeometryAllocation GeometryArena::allocate(VkDeviceSize size)
+{
+    size = align(std::max<VkDeviceSize>(size, 1));
+
+    GeometryAllocation allocation = findRange(size, nullptr);
+    if (allocation.isValid())
+        return allocation;
+
+    // Meshes larger than a block get a block of their own
+    allocation.block = createBlock(std::max(size, blockSize));
+    allocation.offset = 0;
+    allocation.size = size;
+
+    Block& block = blocks[allocation.block];
+    if (block.size > size)
+        block.freeRanges[size] = block.size - size;
+    block.used = size;
+    return allocation;
+}
+
+GeometryAllocation GeometryArena::allocateBelow(VkDeviceSize size, const GeometryAllocation& limit)
+{
+    return findRange(align(std::max<VkDeviceSize>(size, 1)), &limit);
+}
+
+GeometryAllocation GeometryArena::findRange(VkDeviceSize size, const GeometryAllocation* limit)
+{
+    for (uint32_t i = 0; i < blocks.size(); i++)
+    {
+        if (limit && i > limit->block)
+            break;
+
+        Block& block = blocks[i];
+        for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it)
+        {
+            if (limit && i == limit->block && it->first >= limit->offset)
+                break;
+
+            if (it->second < size)
+                continue;
+
+            GeometryAllocation allocation;
+            allocation.block = i;
+            allocation.offset = it->first;
+            allocation.size = size;
+
+            VkDeviceSize remaining = it->second - size;
+            block.freeRanges.erase(it);
+            if (remaining > 0)
+                block.freeRanges[allocation.offset + size] = remaining;
+
+            block.used += size;
+            return allocation;
+        }
+    }
+
+    return GeometryAllocation();
+}
+
+void GeometryArena::free(const GeometryAllocation& allocation)
+{
+    if (!allocation.isValid())
+        return;
+
+    Block& block = blocks[allocation.block];
+    VkDeviceSize offset = allocation.offset;
+    VkDeviceSize size = allocation.size;
+
+    // Merge with the free ranges on either side
+    auto next = block.freeRanges.lower_bound(offset);
+    if (next != block.freeRanges.end() && offset + size == next->first)
+    {
+        size += next->second;
+        next = block.freeRanges.erase(next);
+    }
+    if (next != block.freeRanges.begin())
+    {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset)
+        {
+            offset = previous->first;
+            size += previous->second;
+            block.freeRanges.erase(previous);
+        }
+    }
+    block.freeRanges[offset] = size;
+
+    block.used -= allocation.size;
+    if (block.used > 0)
+        return;
+
+    vkDestroyBuffer(helper.device, block.buffer, nullptr);
+    vkFreeMemory(helper.device, block.memory, nullptr);
+    block = Block();
+    generation++;
+
+    while (!blocks.empty() && blocks.back().buffer == VK_NULL_HANDLE)
+    {
+        blocks.pop_back();
+    }
+}
+
+void GeometryArena::upload(const GeometryAllocation& allocation, VkDeviceSize offset, const void* data, VkDeviceSize size)
+{
+    if (size == 0)
+        return;
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    helper.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+    void* mapped;
+    vkMapMemory(helper.device, stagingBufferMemory, 0, size, 0, &mapped);
+    memcpy(mapped, data, (size_t)size);
+    vkUnmapMemory(helper.device, stagingBufferMemory);
+
+    VkCommandBuffer commandBuffer = helper.beginSingleTimeCommands();
+
+    VkBufferCopy copyRegion{};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = allocation.offset + offset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, blocks[allocation.block].buffer, 1, &copyRegion);
+
+    helper.endSingleTimeCommands(commandBuffer);
+
+    vkDestroyBuffer(helper.device, stagingBuffer, nullptr);
+    vkFreeMemory(helper.device, stagingBufferMemory, nullptr);
+}
+
+VkBuffer GeometryArena::getBuffer(uint32_t block) const
+{
+    return blocks[block].buffer;
+}
+
+uint32_t GeometryArena::getBlockCount() const
+{
+    uint32_t count = 0;
+    for (const Block& block : blocks)
+    {
+        if (block.buffer != VK_NULL_HANDLE)
+            count++;
+    }
+    return count;
+}
+
+VkDeviceSize GeometryArena::getAllocatedSize() const
+{
+    VkDeviceSize size = 0;
+    for (const Block& block : blocks)
+    {
+        size += block.size;
+    }
+    return size;
+}
+
+VkDeviceSize GeometryArena::getUsedSize() const
+{
+    VkDeviceSize size = 0;
+    for (const Block& block : blocks)
+    {
+        size += block.used;
+    }
+    return size;
+}
+
+uint64_t GeometryArena::getGeneration() const
+{
+    return generation;
+}
+
+uint32_t GeometryArena::createBlock(VkDeviceSize size)
+{
+    Block block;
+    block.size = size;
+    helper.createBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, block.buffer, block.memory);
+
+    // Creating the buffer may have evicted meshes and emptied blocks, so the free slot is looked for afterwards
+    uint32_t index = 0;
+    while (index < blocks.size() && blocks[index].buffer != VK_NULL_HANDLE)
+    {
+        index++;
+    }
+
+    if (index == blocks.size())
+        blocks.push_back(block);
+    else
+        blocks[index] = block;
+
+    helper.setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)block.buffer, "GeometryArena::Block " + std::to_string(index));
+    generation++;
+    return index;
+}
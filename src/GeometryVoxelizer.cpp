@@ -1,4 +1,5 @@
 #include "GeometryVoxelizer.h"
+#include "DrawBatch.h"
 
 GeometryVoxelizer::GeometryVoxelizer(std::shared_ptr<Helper> helper, uint32_t voxelsPerSide, glm::vec4 corner1, glm::vec4 corner2) : Voxelizer(helper, voxelsPerSide, corner1, corner2)
 {
@@ -161,20 +162,16 @@ void GeometryVoxelizer::createVoxelizationGraphicsPipeline()
     colorBlending.blendConstants[2] = 0.0f; // Optional
     colorBlending.blendConstants[3] = 0.0f; // Optional
 
-    // Push Constants
-    VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(glm::mat4);
+    // Pipeline layout, model matrices and textures come from the DrawBatch
+    DrawBatch::createDescriptorSetLayout(*helper);
 
-    // Pipeline layout
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    std::vector<VkDescriptorSetLayout> layouts = { voxelGridDescriptorSetLayout, Model::descriptorSetLayout, voxelTextureDescriptorSetLayout };
+    std::vector<VkDescriptorSetLayout> layouts = { voxelGridDescriptorSetLayout, DrawBatch::descriptorSetLayout, voxelTextureDescriptorSetLayout };
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = layouts.size();
     pipelineLayoutInfo.pSetLayouts = layouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
     if (vkCreatePipelineLayout(helper->device, &pipelineLayoutInfo, nullptr, &voxelGridPipelineLayout) != VK_SUCCESS) {
         throw std::runtime_error("failed to create pipeline layout!");
@@ -240,7 +237,7 @@ void GeometryVoxelizer::createVoxelizationRenderPassFrameBuffer()
 	}
 }
 
-void GeometryVoxelizer::beginVoxelization(VkCommandBuffer commandBuffer, uint32_t currentFrame)
+void GeometryVoxelizer::beginVoxelization(VkCommandBuffer commandBuffer, uint32_t currentFrame, VkSubpassContents contents)
 {
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -252,8 +249,14 @@ void GeometryVoxelizer::beginVoxelization(VkCommandBuffer commandBuffer, uint32_
     renderPassInfo.clearValueCount = 0;
     renderPassInfo.pClearValues = nullptr;
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
 
+    if (contents == VK_SUBPASS_CONTENTS_INLINE)
+        bindVoxelizationState(commandBuffer, currentFrame);
+}
+
+void GeometryVoxelizer::bindVoxelizationState(VkCommandBuffer commandBuffer, uint32_t currentFrame)
+{
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, voxelGridGraphicsPipeline);
 
     VkViewport viewport{};
@@ -1,6 +1,8 @@
 #include "Helper.h"
 
-Helper::Helper(int MAX_FRAMES_IN_FLIGHT) : MAX_FRAMES_IN_FLIGHT(MAX_FRAMES_IN_FLIGHT)
+Helper::Helper(int MAX_FRAMES_IN_FLIGHT) : MAX_FRAMES_IN_FLIGHT(MAX_FRAMES_IN_FLIGHT), threadPool(std::make_shared<ThreadPool>()),
+    residency(std::make_shared<ResidencyManager>(*this)), geometryArena(std::make_shared<GeometryArena>(*this)), textureCache(std::make_shared<TextureCache>(*this)),
+    transforms(std::make_shared<TransformSystem>(*this))
 {}
 
 VkCommandBuffer Helper::beginSingleTimeCommands()
@@ -38,6 +40,18 @@ void Helper::endSingleTimeCommands(VkCommandBuffer commandBuffer)
     vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 }
 
+VkResult Helper::allocateMemory(const VkMemoryAllocateInfo& allocInfo, VkDeviceMemory& memory)
+{
+    VkResult result = vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+
+    while (result == VK_ERROR_OUT_OF_DEVICE_MEMORY && residency && residency->makeRoom(allocInfo.allocationSize) > 0)
+    {
+        result = vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+    }
+
+    return result;
+}
+
 void Helper::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
 {
     VkBufferCreateInfo bufferInfo{};
@@ -58,7 +72,9 @@ void Helper::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryP
     allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
+    if (allocateMemory(allocInfo, bufferMemory) != VK_SUCCESS) {
+        vkDestroyBuffer(device, buffer, nullptr);
+        buffer = VK_NULL_HANDLE;
         throw std::runtime_error("failed to allocate buffer memory!");
     }
 
@@ -90,30 +106,82 @@ void Helper::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize siz
     endSingleTimeCommands(commandBuffer);
 }
 
-void Helper::createTextureImage(std::string path, VkImage& textureImage, VkDeviceMemory& textureImageMemory, VkImageView& textureImageView, uint32_t* mipLevels)
+void Helper::createDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
 {
-    int texWidth, texHeight, texChannels;
-    stbi_uc* pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
-    uint32_t levels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
-    if (mipLevels) *mipLevels = levels;
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingBufferMemory;
+    createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+    void* mapped;
+    vkMapMemory(device, stagingBufferMemory, 0, size, 0, &mapped);
+    memcpy(mapped, data, (size_t)size);
+    vkUnmapMemory(device, stagingBufferMemory);
+
+    try
+    {
+        createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, bufferMemory);
+    }
+    catch (const std::runtime_error&)
+    {
+        vkDestroyBuffer(device, stagingBuffer, nullptr);
+        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        throw;
+    }
+
+    copyBuffer(stagingBuffer, buffer, size);
+
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    vkFreeMemory(device, stagingBufferMemory, nullptr);
+}
+
+TextureData Helper::loadTextureData(const std::string& path)
+{
+    TextureData texture;
+    int texChannels;
+    stbi_uc* pixels = stbi_load(path.c_str(), &texture.width, &texture.height, &texChannels, STBI_rgb_alpha);
 
     if (!pixels) {
         throw std::runtime_error("failed to load texture image!");
     }
 
+    texture.pixels = std::shared_ptr<unsigned char>(pixels, stbi_image_free);
+    texture.fullWidth = texture.width;
+    texture.fullHeight = texture.height;
+    return texture;
+}
+
+void Helper::createTextureImage(std::string path, VkImage& textureImage, VkDeviceMemory& textureImageMemory, VkImageView& textureImageView, uint32_t* mipLevels)
+{
+    createTextureImage(loadTextureData(path), textureImage, textureImageMemory, textureImageView, mipLevels);
+}
+
+void Helper::createTextureImage(const TextureData& texture, VkImage& textureImage, VkDeviceMemory& textureImageMemory, VkImageView& textureImageView, uint32_t* mipLevels)
+{
+    int texWidth = texture.width;
+    int texHeight = texture.height;
+    VkDeviceSize imageSize = texWidth * texHeight * 4;
+    uint32_t levels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+    if (mipLevels) *mipLevels = levels;
+
     VkBuffer stagingBuffer;
     VkDeviceMemory stagingBufferMemory;
     createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
     void* data;
     vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
+    memcpy(data, texture.pixels.get(), static_cast<size_t>(imageSize));
     vkUnmapMemory(device, stagingBufferMemory);
 
-    stbi_image_free(pixels);
-
-    createImage(texWidth, texHeight, 1, (mipLevels ? levels : 1), VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+    try
+    {
+        createImage(texWidth, texHeight, 1, (mipLevels ? levels : 1), VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
+    }
+    catch (const std::runtime_error&)
+    {
+        vkDestroyBuffer(device, stagingBuffer, nullptr);
+        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        throw;
+    }
 
     // Transition image layout
     VkCommandBuffer commandBuffer = beginSingleTimeCommands();
@@ -250,7 +318,9 @@ void Helper::createImage(uint32_t width, uint32_t height, uint32_t depth, uint32
     allocInfo.allocationSize = memRequirements.size;
     allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
+    if (allocateMemory(allocInfo, imageMemory) != VK_SUCCESS) {
+        vkDestroyImage(device, image, nullptr);
+        image = VK_NULL_HANDLE;
         throw std::runtime_error("failed to allocate image memory!");
     }
 
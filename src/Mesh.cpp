@@ -1,196 +1,773 @@
 #include "Mesh.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 
 #include <stdexcept>
-
-Model::Model(std::string path, std::shared_ptr<Helper> helper) : 
-    helper(helper), path(path), directory(path.substr(0, path.find_last_of('/')))
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MESH_CONVERSION_SSE
+#endif
+
+namespace
 {
-    createDescriptorSetLayouts(*helper);
+    struct MeshCacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t flags;
+        uint32_t meshCount;
+        uint32_t postProcessFlags;
+        uint64_t sourceSize;
+        int64_t sourceWriteTime;
+    };
+
+    bool getSourceFileInfo(const std::string& path, uint64_t& size, int64_t& writeTime)
+    {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error)
+            return false;
 
-    Assimp::Importer importer;
+        auto time = std::filesystem::last_write_time(path, error);
+        if (error)
+            return false;
 
-    const aiScene* scene = importer.ReadFile(path,
-        aiProcess_CalcTangentSpace |
-        aiProcess_Triangulate |
-        aiProcess_JoinIdenticalVertices |
-        aiProcess_SortByPType);
+        writeTime = static_cast<int64_t>(time.time_since_epoch().count());
+        return true;
+    }
+}
 
-    if (nullptr == scene) {
-        throw std::runtime_error("Failed to load model");
+Model::Model(std::string path, std::shared_ptr<Helper> helper, ModelLoadOptions options) : 
+    helper(helper), path(path), directory(path.substr(0, path.find_last_of('/'))), options(options)
+{
+    if (options.asynchronous)
+    {
+        loadTask = helper->threadPool->submit([this]() { load(); });
+        return;
     }
 
-    // Populate vertices and indices
-    for (unsigned int i = 0; i < scene->mNumMeshes; i++) 
+    load();
+    update();
+}
+
+Model::~Model()
+{
+    cancelLoad = true;
+    if (loadTask.valid())
+        loadTask.wait();
+
+    // Models are only destroyed once no frame in flight uses them
+    vkDestroyBuffer(helper->device, meshletBuffer, nullptr);
+    vkFreeMemory(helper->device, meshletBufferMemory, nullptr);
+    vkDestroyBuffer(helper->device, meshletVertexBuffer, nullptr);
+    vkFreeMemory(helper->device, meshletVertexBufferMemory, nullptr);
+    vkDestroyBuffer(helper->device, meshletTriangleBuffer, nullptr);
+    vkFreeMemory(helper->device, meshletTriangleBufferMemory, nullptr);
+}
+
+void Model::load()
+{
+    try
     {
-		const aiMesh* mesh = scene->mMeshes[i];
-        uint32_t materialIndex = mesh->mMaterialIndex;
-        std::vector<Vertex> vertices;
-        std::vector<uint32_t> indices;
+        std::vector<MeshData> cached;
+        cacheHit = options.useMeshCache && loadMeshCache(cached);
 
-        for (unsigned int j = 0; j < mesh->mNumVertices; j++) 
-        {
-			Vertex vertex = {};
-			vertex.pos = glm::vec3(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z);
-			vertex.normal = glm::vec3(mesh->mNormals[j].x, mesh->mNormals[j].y, mesh->mNormals[j].z);
-            if (mesh->mTextureCoords[0]) {
-				vertex.texCoord = mesh->HasTextureCoords(0) ? glm::vec2(mesh->mTextureCoords[0][j].x, 1-mesh->mTextureCoords[0][j].y) : glm::vec2(0.0f, 0.0f);
-			}
-			vertices.push_back(vertex);
-		}
-
-        for (unsigned int j = 0; j < mesh->mNumFaces; j++) 
+        Assimp::Importer importer;
+
+        // Geometry comes from the cache on a hit so only the materials are needed from the source file
+        const aiScene* scene = importer.ReadFile(path, cacheHit ? 0 : options.postProcessFlags);
+
+        if (nullptr == scene) {
+            throw std::runtime_error("Failed to load model");
+        }
+
+        // Materials first, meshes can only be drawn once their material slot exists
+        std::vector<std::string> texturePaths(scene->mNumMaterials);
+        for (unsigned int i = 0; i < scene->mNumMaterials; i++)
         {
-			const aiFace& face = mesh->mFaces[j];
+            const aiMaterial* material = scene->mMaterials[i];
+
+            if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
+            {
+                aiString Path;
+
+                if (material->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) != AI_SUCCESS)
+                {
+                    throw std::runtime_error("Texture path retrieval failed");
+                }
 
-            if (face.mNumIndices != 3)
+                texturePaths[i] = directory + "/" + Path.data;
+            }
+            else
             {
-				throw std::runtime_error("Model not triangulated");
-			}
+                std::cout << "Material has no diffuse texture\n";
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(loadMutex);
+            materialTexturePaths = texturePaths;
+            materialsPublished = true;
+        }
 
-            for (unsigned int k = 0; k < face.mNumIndices; k++) 
+        // Meshes are independent, so conversion, optimization, simplification and meshlet building run in
+        // parallel. Each one is handed over as soon as it is done.
+        size_t meshCount = cacheHit ? cached.size() : scene->mNumMeshes;
+        helper->threadPool->parallelFor(meshCount, [&](size_t i)
+        {
+            if (cancelLoad)
+                return;
+
+            MeshData data;
+            if (cacheHit)
+            {
+                data = std::move(cached[i]);
+            }
+            else
             {
-				indices.push_back(face.mIndices[k]);
-			}
-		}
+                convertMesh(scene->mMeshes[i], data);
+                processMesh(data, options);
+            }
+            Mesh::buildMeshlets(data);
 
-        meshes.emplace_back(std::make_unique<Mesh>(helper, std::move(vertices), std::move(indices), materialIndex));
-	}
+            std::lock_guard<std::mutex> lock(loadMutex);
+            pendingMeshes.push_back(std::move(data));
+        });
 
-    // Populate materials
-    textureImages.resize(scene->mNumMaterials);
-    textureImagesMemory.resize(scene->mNumMaterials);
-    textureImageViews.resize(scene->mNumMaterials);
-    descriptorSets.resize(scene->mNumMaterials);
-    mipLevels.resize(scene->mNumMaterials);
+        // Textures last, the placeholder is good enough for a first frame. Every file is decoded once, and not
+        // at all if another model already has it resident.
+        std::vector<std::string> uniquePaths;
+        for (const std::string& texturePath : texturePaths)
+        {
+            if (!texturePath.empty() && std::find(uniquePaths.begin(), uniquePaths.end(), texturePath) == uniquePaths.end())
+                uniquePaths.push_back(texturePath);
+        }
 
-    helper->createSampler(textureSampler, 10);
+        helper->threadPool->parallelFor(uniquePaths.size(), [&](size_t i)
+        {
+            if (cancelLoad)
+                return;
+
+            TextureData texture;
+            if (!helper->textureCache->find(uniquePaths[i], getTextureLoadParams()))
+                texture = helper->textureCache->loadTextureData(uniquePaths[i], getTextureLoadParams());
 
-    for (unsigned int i = 0; i < scene->mNumMaterials; i++)
+            std::lock_guard<std::mutex> lock(loadMutex);
+            pendingTextures.emplace_back(uniquePaths[i], std::move(texture));
+        });
+    }
+    catch (...)
     {
-        const aiMaterial* material = scene->mMaterials[i];
+        std::lock_guard<std::mutex> lock(loadMutex);
+        loadException = std::current_exception();
+    }
+
+    std::lock_guard<std::mutex> lock(loadMutex);
+    loaderFinished = true;
+}
+
+bool Model::update(uint32_t uploadBudget)
+{
+    if (loaded)
+        return true;
+
+    // The synchronous path keeps going until everything is resident
+    while (true)
+    {
+        std::vector<MeshData> meshData;
+        std::vector<std::pair<std::string, TextureData>> decodedTextures;
+        bool finished;
 
-        if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0) 
         {
-            aiString Path;
+            std::lock_guard<std::mutex> lock(loadMutex);
+
+            if (loadException)
+                std::rethrow_exception(loadException);
 
-            if (material->GetTexture(aiTextureType_DIFFUSE, 0, &Path, NULL, NULL, NULL, NULL, NULL) == AI_SUCCESS) 
+            if (materialsPublished && !materialsCreated)
+                createMaterials();
+
+            while (!pendingMeshes.empty() && meshData.size() < uploadBudget)
             {
-                std::string FullPath = directory + "/" + Path.data;
-
-                helper->createTextureImage(FullPath, textureImages[i], textureImagesMemory[i], textureImageViews[i], &mipLevels[i]);
-
-                // Create descriptor set
-                VkDescriptorSetLayout layouts[] = { getDescriptorSetLayout() };
-                VkDescriptorSetAllocateInfo allocInfo = {};
-                allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-                allocInfo.descriptorPool = helper->descriptorPool;
-                allocInfo.descriptorSetCount = 1;
-                allocInfo.pSetLayouts = layouts;
-
-                if (vkAllocateDescriptorSets(helper->device, &allocInfo, &descriptorSets[i]) != VK_SUCCESS) {
-					throw std::runtime_error("Failed to allocate descriptor sets");
-				}
-
-                VkDescriptorImageInfo imageInfo = {};
-				imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				imageInfo.imageView = textureImageViews[i];
-				imageInfo.sampler = textureSampler;
-
-				VkWriteDescriptorSet descriptorWrite = {};
-				descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-				descriptorWrite.dstSet = descriptorSets[i];
-				descriptorWrite.dstBinding = 0;
-				descriptorWrite.dstArrayElement = 0;
-				descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-				descriptorWrite.descriptorCount = 1;
-				descriptorWrite.pImageInfo = &imageInfo;
-
-				vkUpdateDescriptorSets(helper->device, 1, &descriptorWrite, 0, nullptr);
+                meshData.push_back(std::move(pendingMeshes.back()));
+                pendingMeshes.pop_back();
             }
-            else
+
+            while (!pendingTextures.empty() && meshData.size() + decodedTextures.size() < uploadBudget)
             {
-                throw std::runtime_error("Texture path retrieval failed");
+                decodedTextures.push_back(std::move(pendingTextures.back()));
+                pendingTextures.pop_back();
             }
+
+            finished = loaderFinished && pendingMeshes.empty() && pendingTextures.empty();
         }
-        else
+
+        // GPU resources are created on this thread, the uploads share the graphics queue
+        for (MeshData& data : meshData)
         {
-            std::cout << "Material has no diffuse texture\n";
+            meshes.emplace_back(std::make_unique<Mesh>(helper, std::move(data)));
+            memorySize += meshes.back()->getBufferSize();
+        }
+
+        for (auto& [texturePath, data] : decodedTextures)
+        {
+            std::shared_ptr<Texture> texture = helper->textureCache->acquire(texturePath, getTextureLoadParams(), data);
+            memorySize += texture->memorySize;
+
+            for (size_t i = 0; i < materialTexturePaths.size(); i++)
+            {
+                if (materialTexturePaths[i] != texturePath)
+                    continue;
+
+                textures[i] = texture;
+            }
+        }
+
+        if (finished)
             break;
+
+        if (options.asynchronous)
+            return false;
+
+        std::this_thread::yield();
+    }
+
+    if (!cacheHit && options.useMeshCache)
+    {
+        saveMeshCache();
+    }
+
+    createMeshletBuffers();
+
+    loaded = true;
+    return true;
+}
+
+bool Model::isLoaded() const
+{
+    return loaded;
+}
+
+bool Model::makeResident()
+{
+    bool restored = false;
+    for (auto& mesh : meshes)
+    {
+        restored = mesh->makeResident() || restored;
+    }
+
+    for (auto& texture : textures)
+    {
+        if (texture)
+            helper->residency->markUsed(texture->residencyHandle);
+    }
+
+    return restored;
+}
+
+void Model::createMaterials()
+{
+    textures.resize(materialTexturePaths.size());
+    materialsCreated = true;
+}
+
+TextureLoadParams Model::getTextureLoadParams() const
+{
+    TextureLoadParams params;
+    params.streamed = options.streamTextures;
+    return params;
+}
+
+std::string Model::getMeshCachePath() const
+{
+    return path + ".meshcache";
+}
+
+bool Model::loadMeshCache(std::vector<MeshData>& meshData)
+{
+    MeshCacheHeader expected = {};
+    expected.magic = MESH_CACHE_MAGIC;
+    expected.version = MESH_CACHE_VERSION;
+    expected.flags = getMeshCacheFlags();
+    expected.postProcessFlags = options.postProcessFlags;
+
+    if (!getSourceFileInfo(path, expected.sourceSize, expected.sourceWriteTime))
+        return false;
+
+    std::ifstream file(getMeshCachePath(), std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    MeshCacheHeader header = {};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    if (!file ||
+        header.magic != expected.magic ||
+        header.version != expected.version ||
+        header.flags != expected.flags ||
+        header.postProcessFlags != expected.postProcessFlags ||
+        header.sourceSize != expected.sourceSize ||
+        header.sourceWriteTime != expected.sourceWriteTime)
+    {
+        return false;
+    }
+
+    std::error_code error;
+    uint64_t cacheSize = std::filesystem::file_size(getMeshCachePath(), error);
+    if (error)
+        return false;
+
+    // Counts are checked against the bytes left in the file before anything is allocated
+    const uint64_t meshHeaderSize = sizeof(uint32_t) * 4 + sizeof(glm::vec3) * 2;
+    if (header.meshCount > (cacheSize - sizeof(header)) / meshHeaderSize)
+        return false;
+
+    // Read everything before handing it out so that a truncated or corrupt file is just a cache miss
+    std::vector<MeshData> cached(header.meshCount);
+
+    for (MeshData& data : cached)
+    {
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+        uint32_t lodCount = 0;
+
+        file.read(reinterpret_cast<char*>(&data.materialIndex), sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(&vertexCount), sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(&indexCount), sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(&lodCount), sizeof(uint32_t));
+        file.read(reinterpret_cast<char*>(&data.boundsMin), sizeof(glm::vec3));
+        file.read(reinterpret_cast<char*>(&data.boundsMax), sizeof(glm::vec3));
+
+        if (!file || indexCount % 3 != 0 || lodCount > std::max(options.maxLodCount, 1u))
+            return false;
+
+        uint64_t dataSize = sizeof(Vertex) * static_cast<uint64_t>(vertexCount) + sizeof(uint32_t) * static_cast<uint64_t>(indexCount) + sizeof(MeshLod) * static_cast<uint64_t>(lodCount);
+        if (dataSize > cacheSize - static_cast<uint64_t>(file.tellg()))
+            return false;
+
+        data.vertices.resize(vertexCount);
+        data.indices.resize(indexCount);
+        data.lods.resize(lodCount);
+
+        file.read(reinterpret_cast<char*>(data.vertices.data()), sizeof(Vertex) * vertexCount);
+        file.read(reinterpret_cast<char*>(data.indices.data()), sizeof(uint32_t) * indexCount);
+        file.read(reinterpret_cast<char*>(data.lods.data()), sizeof(MeshLod) * lodCount);
+
+        if (!file)
+            return false;
+
+        for (uint32_t index : data.indices)
+        {
+            if (index >= vertexCount)
+                return false;
+        }
+
+        for (const MeshLod& lod : data.lods)
+        {
+            if (lod.firstIndex % 3 != 0 || lod.indexCount % 3 != 0 || static_cast<uint64_t>(lod.firstIndex) + lod.indexCount > indexCount)
+                return false;
         }
     }
 
+    meshData = std::move(cached);
+    return true;
 }
 
-Model::~Model()
+void Model::saveMeshCache() const
+{
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.flags = getMeshCacheFlags();
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    header.postProcessFlags = options.postProcessFlags;
+
+    if (!getSourceFileInfo(path, header.sourceSize, header.sourceWriteTime))
+        return;
+
+    std::ofstream file(getMeshCachePath(), std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not write mesh cache " << getMeshCachePath() << "\n";
+        return;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (const auto& mesh : meshes)
+    {
+        uint32_t vertexCount = static_cast<uint32_t>(mesh->vertices.size());
+        uint32_t indexCount = static_cast<uint32_t>(mesh->indices.size());
+        uint32_t lodCount = static_cast<uint32_t>(mesh->lods.size());
+
+        file.write(reinterpret_cast<const char*>(&mesh->materialIndex), sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(&vertexCount), sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(&indexCount), sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(&lodCount), sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(&mesh->boundsMin), sizeof(glm::vec3));
+        file.write(reinterpret_cast<const char*>(&mesh->boundsMax), sizeof(glm::vec3));
+        file.write(reinterpret_cast<const char*>(mesh->vertices.data()), sizeof(Vertex) * vertexCount);
+        file.write(reinterpret_cast<const char*>(mesh->indices.data()), sizeof(uint32_t) * indexCount);
+        file.write(reinterpret_cast<const char*>(mesh->lods.data()), sizeof(MeshLod) * lodCount);
+    }
+}
+
+uint32_t Model::getMeshCacheFlags() const
+{
+    // Any option that changes the cached geometry has to invalidate the cache
+    uint32_t flags = 0;
+    flags |= options.optimizeMeshes ? 1u << 0 : 0u;
+    flags |= options.generateLods ? 1u << 1 : 0u;
+    flags |= std::min(static_cast<uint32_t>(std::max(options.overdrawThreshold - 1.0f, 0.0f) * 32.0f + 0.5f), 63u) << 2;
+    flags |= (options.maxLodCount & 0xFFu) << 8;
+    flags |= (static_cast<uint32_t>(options.lodReductionRatio * 255.0f) & 0xFFu) << 16;
+    flags |= (static_cast<uint32_t>(options.lodMaxRelativeError * 255.0f) & 0xFFu) << 24;
+    return flags;
+}
+
+void Model::createMeshletBuffers()
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> meshletVertices;
+    std::vector<uint32_t> meshletTriangles;
+
+    for (auto& mesh : meshes)
+    {
+        mesh->meshletBufferOffset = static_cast<uint32_t>(meshlets.size());
+
+        uint32_t vertexBase = static_cast<uint32_t>(meshletVertices.size());
+        uint32_t triangleBase = static_cast<uint32_t>(meshletTriangles.size());
+
+        for (Meshlet meshlet : mesh->meshlets)
+        {
+            meshlet.vertexOffset += vertexBase;
+            meshlet.triangleOffset += triangleBase;
+            meshlets.push_back(meshlet);
+        }
+
+        meshletVertices.insert(meshletVertices.end(), mesh->meshletVertices.begin(), mesh->meshletVertices.end());
+        meshletTriangles.insert(meshletTriangles.end(), mesh->meshletTriangles.begin(), mesh->meshletTriangles.end());
+    }
+
+    // Keep the buffers valid for descriptor writes even for an empty model
+    if (meshlets.empty())
+        meshlets.push_back({});
+    if (meshletVertices.empty())
+        meshletVertices.push_back(0);
+    if (meshletTriangles.empty())
+        meshletTriangles.push_back(0);
+
+    memorySize += sizeof(Meshlet) * meshlets.size() + sizeof(uint32_t) * (meshletVertices.size() + meshletTriangles.size());
+
+    helper->createDeviceLocalBuffer(meshlets.data(), sizeof(Meshlet) * meshlets.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshletBuffer, meshletBufferMemory);
+    helper->createDeviceLocalBuffer(meshletVertices.data(), sizeof(uint32_t) * meshletVertices.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshletVertexBuffer, meshletVertexBufferMemory);
+    helper->createDeviceLocalBuffer(meshletTriangles.data(), sizeof(uint32_t) * meshletTriangles.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, meshletTriangleBuffer, meshletTriangleBufferMemory);
+
+    helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)meshletBuffer, "Model::Meshlet Buffer");
+    helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)meshletVertexBuffer, "Model::Meshlet Vertex Buffer");
+    helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)meshletTriangleBuffer, "Model::Meshlet Triangle Buffer");
+}
+
+void Model::convertMesh(const aiMesh* mesh, MeshData& data)
+{
+    static_assert(sizeof(Vertex) == 8 * sizeof(float), "the vertex copy writes whole vertices as two float4");
+
+    uint32_t vertexCount = mesh->mNumVertices;
+    data.materialIndex = mesh->mMaterialIndex;
+    data.vertices.resize(vertexCount);
+    data.indices.resize(static_cast<size_t>(mesh->mNumFaces) * 3);
+
+    const aiVector3D* positions = mesh->mVertices;
+    const aiVector3D* normals = mesh->mNormals;
+    const aiVector3D* texCoords = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0] : nullptr;
+
+    glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+    uint32_t j = 0;
+
+#if defined(MESH_CONVERSION_SSE) && !defined(ASSIMP_DOUBLE_PRECISION)
+    // Each aiVector3D is read as a float4, so the last vertex is left to the scalar loop to stay inside the arrays
+    if (normals && texCoords && vertexCount > 1)
+    {
+        const __m128 flipScale = _mm_setr_ps(1.0f, -1.0f, 0.0f, 0.0f);
+        const __m128 flipOffset = _mm_setr_ps(0.0f, 1.0f, 0.0f, 0.0f);
+        __m128 simdMin = _mm_set1_ps(std::numeric_limits<float>::max());
+        __m128 simdMax = _mm_set1_ps(-std::numeric_limits<float>::max());
+
+        for (; j + 1 < vertexCount; j++)
+        {
+            __m128 position = _mm_loadu_ps(&positions[j].x);
+            __m128 normal = _mm_loadu_ps(&normals[j].x);
+            __m128 texCoord = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&texCoords[j].x), flipScale), flipOffset);
+
+            // (px, py, pz, nx) and (ny, nz, u, 1 - v)
+            __m128 zx = _mm_shuffle_ps(position, normal, _MM_SHUFFLE(0, 0, 2, 2));
+            __m128 low = _mm_shuffle_ps(position, zx, _MM_SHUFFLE(2, 0, 1, 0));
+            __m128 high = _mm_shuffle_ps(normal, texCoord, _MM_SHUFFLE(1, 0, 2, 1));
+
+            float* vertex = reinterpret_cast<float*>(&data.vertices[j]);
+            _mm_storeu_ps(vertex, low);
+            _mm_storeu_ps(vertex + 4, high);
+
+            simdMin = _mm_min_ps(simdMin, position);
+            simdMax = _mm_max_ps(simdMax, position);
+        }
+
+        float lanes[4];
+        _mm_storeu_ps(lanes, simdMin);
+        boundsMin = glm::vec3(lanes[0], lanes[1], lanes[2]);
+        _mm_storeu_ps(lanes, simdMax);
+        boundsMax = glm::vec3(lanes[0], lanes[1], lanes[2]);
+    }
+#endif
+
+    for (; j < vertexCount; j++)
+    {
+        Vertex& vertex = data.vertices[j];
+        vertex.pos = glm::vec3(positions[j].x, positions[j].y, positions[j].z);
+        vertex.normal = normals ? glm::vec3(normals[j].x, normals[j].y, normals[j].z) : glm::vec3(0.0f);
+        vertex.texCoord = texCoords ? glm::vec2(texCoords[j].x, 1 - texCoords[j].y) : glm::vec2(0.0f, 0.0f);
+
+        boundsMin = glm::min(boundsMin, vertex.pos);
+        boundsMax = glm::max(boundsMax, vertex.pos);
+    }
+
+    if (vertexCount == 0)
+    {
+        boundsMin = glm::vec3(0.0f);
+        boundsMax = glm::vec3(0.0f);
+    }
+
+    data.boundsMin = boundsMin;
+    data.boundsMax = boundsMax;
+
+    uint32_t* indices = data.indices.data();
+    for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+    {
+        const aiFace& face = mesh->mFaces[f];
+
+        if (face.mNumIndices != 3)
+        {
+            throw std::runtime_error("Model not triangulated");
+        }
+
+        indices[f * 3 + 0] = face.mIndices[0];
+        indices[f * 3 + 1] = face.mIndices[1];
+        indices[f * 3 + 2] = face.mIndices[2];
+    }
+}
+
+void Model::processMesh(MeshData& data, const ModelLoadOptions& options)
 {
-    destroyDescriptorSetLayout(*helper);
+    if (options.optimizeMeshes)
+    {
+        MeshOptimizer::optimize(data.vertices, data.indices, options.overdrawThreshold);
+    }
 
-    for (unsigned int i = 0; i < textureImages.size(); i++)
+    if (options.generateLods)
     {
-        vkDestroyImageView(helper->device, textureImageViews[i], nullptr);
-        vkFreeMemory(helper->device, textureImagesMemory[i], nullptr);
-        vkDestroyImage(helper->device, textureImages[i], nullptr);
+        generateLods(data, options);
     }
+}
 
-    vkDestroySampler(helper->device, textureSampler, nullptr);
+void Model::generateLods(MeshData& data, const ModelLoadOptions& options)
+{
+    const size_t minimumIndexCount = 3 * 32;
+
+    const std::vector<Vertex>& vertices = data.vertices;
+    std::vector<uint32_t>& indices = data.indices;
+    std::vector<MeshLod>& lods = data.lods;
+
+    lods.clear();
+    lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f });
+
+    if (vertices.empty())
+        return;
+
+    float maxError = glm::length(data.boundsMax - data.boundsMin) * 0.5f * options.lodMaxRelativeError;
+
+    // Each level is simplified from the previous one, so the errors add up
+    std::vector<uint32_t> source = indices;
+    float error = 0.0f;
+
+    for (uint32_t level = 1; level < options.maxLodCount; level++)
+    {
+        size_t targetIndexCount = static_cast<size_t>(source.size() / 3 * options.lodReductionRatio) * 3;
+        if (targetIndexCount < minimumIndexCount)
+            break;
+
+        std::vector<uint32_t> lod;
+        float lodError = MeshSimplifier::simplify(vertices, source, lod, targetIndexCount, maxError - error);
+
+        // Not worth a level if the simplifier got stuck on locked vertices or the error budget
+        if (lod.empty() || lod.size() * 10 > source.size() * 9)
+            break;
+
+        error += lodError;
+        MeshOptimizer::optimizeVertexCache(lod, vertices.size());
+
+        lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lod.size()), error });
+        indices.insert(indices.end(), lod.begin(), lod.end());
+
+        source = std::move(lod);
+    }
 }
 
-Mesh::Mesh(std::shared_ptr<Helper> helper, std::vector<Vertex>&& vertices, std::vector<uint32_t>&& indices, uint32_t materialIndex)
-    : helper(helper), vertices(vertices), indices(indices), materialIndex(materialIndex)
+Mesh::Mesh(std::shared_ptr<Helper> helper, MeshData&& data)
+    : helper(helper), vertices(std::move(data.vertices)), indices(std::move(data.indices)), materialIndex(data.materialIndex), lods(std::move(data.lods)),
+    boundsMin(data.boundsMin), boundsMax(data.boundsMax),
+    meshlets(std::move(data.meshlets)), meshletVertices(std::move(data.meshletVertices)), meshletTriangles(std::move(data.meshletTriangles))
 {
+    if (lods.empty())
+    {
+        throw std::runtime_error("Mesh data has not been split into meshlets");
+    }
+
+    boundingSphereCenter = (boundsMin + boundsMax) * 0.5f;
+    boundingSphereRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+
     //std::cout << "Creaing mesh buffers\n";
-    createVertexBuffer();
-	createIndexBuffer();
+    GeometryAllocation allocation = helper->geometryArena->allocate(getBufferSize());
+    uploadGeometry(allocation);
+    setGeometry(allocation);
+    resident = true;
+
+    residencyHandle = helper->residency->add("Mesh", RESIDENCY_PRIORITY_HOST_BACKED, getBufferSize(), [this]() -> VkDeviceSize
+    {
+        if (!resident)
+            return 0;
+
+        // The residency manager waited for the device, so the range can go right away
+        this->helper->geometryArena->free(geometry);
+        geometry = GeometryAllocation();
+        resident = false;
+        return getBufferSize();
+    },
+    [this]() -> VkDeviceSize
+    {
+        if (!resident)
+            return 0;
+
+        return relocateGeometry();
+    });
 }
 
 Mesh::~Mesh()
 {
     //std::cout << "Destroying mesh buffers\n";
-    vkDestroyBuffer(helper->device, vertexBuffer, nullptr);
-    vkFreeMemory(helper->device, vertexBufferMemory, nullptr);
-
-    vkDestroyBuffer(helper->device, indexBuffer, nullptr);
-    vkFreeMemory(helper->device, indexBufferMemory, nullptr);
+    helper->residency->remove(residencyHandle);
+    helper->geometryArena->free(geometry);
 }
 
-void Mesh::createVertexBuffer()
+bool Mesh::makeResident()
 {
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+    helper->residency->markUsed(residencyHandle);
+
+    if (resident)
+    {
+        bool replaced = geometryReplaced;
+        geometryReplaced = false;
+        return replaced;
+    }
+
+    GeometryAllocation allocation = helper->geometryArena->allocate(getBufferSize());
+    uploadGeometry(allocation);
+    setGeometry(allocation);
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    helper->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    resident = true;
+    helper->residency->setSize(residencyHandle, getBufferSize());
+    return true;
+}
 
-    void* data;
-    vkMapMemory(helper->device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices.data(), (size_t)bufferSize);
-    vkUnmapMemory(helper->device, stagingBufferMemory);
+VkDeviceSize Mesh::getBufferSize() const
+{
+    return getIndexDataOffset() + sizeof(uint32_t) * indices.size();
+}
 
-    helper->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
+VkBuffer Mesh::getBuffer() const
+{
+    return helper->geometryArena->getBuffer(geometry.block);
+}
 
-    helper->copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+VkDeviceSize Mesh::getIndexDataOffset() const
+{
+    return GeometryArena::align(sizeof(Vertex) * vertices.size());
+}
 
-    vkDestroyBuffer(helper->device, stagingBuffer, nullptr);
-    vkFreeMemory(helper->device, stagingBufferMemory, nullptr);
+void Mesh::uploadGeometry(const GeometryAllocation& allocation)
+{
+    try
+    {
+        helper->geometryArena->upload(allocation, 0, vertices.data(), sizeof(Vertex) * vertices.size());
+        helper->geometryArena->upload(allocation, getIndexDataOffset(), indices.data(), sizeof(uint32_t) * indices.size());
+    }
+    catch (const std::runtime_error&)
+    {
+        helper->geometryArena->free(allocation);
+        throw;
+    }
 }
 
-void Mesh::createIndexBuffer()
+void Mesh::setGeometry(const GeometryAllocation& allocation)
 {
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+    geometry = allocation;
+    vertexOffset = static_cast<int32_t>(allocation.offset / sizeof(Vertex));
+    firstIndex = static_cast<uint32_t>((allocation.offset + getIndexDataOffset()) / sizeof(uint32_t));
+}
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    helper->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+VkDeviceSize Mesh::relocateGeometry()
+{
+    // Moving only pays off towards the start of the arena, which lets the blocks at its end empty out
+    std::shared_ptr<GeometryArena> arena = helper->geometryArena;
+    GeometryAllocation allocation = arena->allocateBelow(getBufferSize(), geometry);
+    if (!allocation.isValid())
+        return 0;
 
-    void* data;
-    vkMapMemory(helper->device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), (size_t)bufferSize);
-    vkUnmapMemory(helper->device, stagingBufferMemory);
+    // Uploaded again from the host copy, which is cheaper to arrange than a GPU copy of a live range
+    uploadGeometry(allocation);
 
-    helper->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+    // Frames in flight may still read the old range
+    helper->residency->retire([arena, old = geometry]()
+    {
+        arena->free(old);
+    });
 
-    helper->copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+    setGeometry(allocation);
+    geometryReplaced = true;
+    return getBufferSize();
+}
+
+const MeshLod& Mesh::selectLod(float maxError) const
+{
+    size_t selected = 0;
+    for (size_t i = 1; i < lods.size() && lods[i].error <= maxError; i++)
+    {
+        selected = i;
+    }
+    return lods[selected];
+}
+
+void Mesh::buildMeshlets(MeshData& data)
+{
+    if (data.lods.empty())
+    {
+        data.lods.push_back({ 0, static_cast<uint32_t>(data.indices.size()), 0.0f });
+    }
+
+    data.meshlets.clear();
+    data.meshletVertices.clear();
+    data.meshletTriangles.clear();
 
-    vkDestroyBuffer(helper->device, stagingBuffer, nullptr);
-    vkFreeMemory(helper->device, stagingBufferMemory, nullptr);
-}
\ No newline at end of file
+    for (MeshLod& lod : data.lods)
+    {
+        lod.meshletOffset = static_cast<uint32_t>(data.meshlets.size());
+        MeshletBuilder::build(data.vertices, data.indices, lod.firstIndex, lod.indexCount, data.meshlets, data.meshletVertices, data.meshletTriangles);
+        lod.meshletCount = static_cast<uint32_t>(data.meshlets.size()) - lod.meshletOffset;
+    }
+}
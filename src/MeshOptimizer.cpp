@@ -0,0 +1,396 @@
+#include "MeshOptimizer.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void MeshOptimizer::optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, float overdrawThreshold)
+{
+    if (indices.size() < 3 || vertices.empty())
+        return;
+
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices, overdrawThreshold);
+    optimizeVertexFetch(vertices, indices);
+}
+
+float MeshOptimizer::vertexScore(int cachePosition, uint32_t remainingValence)
+{
+    const float cacheDecayPower = 1.5f;
+    const float lastTriangleScore = 0.75f;
+    const float valenceBoostScale = 2.0f;
+    const float valenceBoostPower = 0.5f;
+
+    // No triangles left to emit for this vertex
+    if (remainingValence == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+
+    if (cachePosition >= 0)
+    {
+        // The last triangle's vertices get a fixed score so that strips do not just ping-pong
+        if (cachePosition < 3)
+        {
+            score = lastTriangleScore;
+        }
+        else
+        {
+            float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler, cacheDecayPower);
+        }
+    }
+
+    // Favour vertices with few triangles left so that they are finished off early
+    score += valenceBoostScale * std::pow(static_cast<float>(remainingValence), -valenceBoostPower);
+
+    return score;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Vertex to triangle adjacency
+    std::vector<uint32_t> valence(vertexCount, 0);
+    for (uint32_t index : indices)
+    {
+        valence[index]++;
+    }
+
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + valence[v];
+    }
+
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (size_t k = 0; k < 3; k++)
+        {
+            adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+        }
+    }
+
+    // Initial scores
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        vertexScores[v] = vertexScore(-1, valence[v]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        triangleScores[t] = vertexScores[indices[t * 3 + 0]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> newCache;
+    cache.reserve(VERTEX_CACHE_SIZE + 3);
+    newCache.reserve(VERTEX_CACHE_SIZE + 3);
+
+    size_t deadEndCursor = 0;
+    int64_t bestTriangle = -1;
+
+    while (result.size() < indices.size())
+    {
+        // Nothing adjacent to the cache, restart from the next triangle that has not been emitted
+        if (bestTriangle < 0)
+        {
+            while (deadEndCursor < triangleCount && emitted[deadEndCursor])
+                deadEndCursor++;
+
+            if (deadEndCursor == triangleCount)
+                break;
+
+            bestTriangle = static_cast<int64_t>(deadEndCursor);
+        }
+
+        uint32_t triangle = static_cast<uint32_t>(bestTriangle);
+        uint32_t a = indices[triangle * 3 + 0];
+        uint32_t b = indices[triangle * 3 + 1];
+        uint32_t c = indices[triangle * 3 + 2];
+
+        emitted[triangle] = true;
+        result.push_back(a);
+        result.push_back(b);
+        result.push_back(c);
+
+        // Remove the emitted triangle from the live adjacency of its vertices
+        for (uint32_t v : { a, b, c })
+        {
+            uint32_t* list = &adjacency[adjacencyOffsets[v]];
+            uint32_t count = valence[v];
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (list[i] == triangle)
+                {
+                    std::swap(list[i], list[count - 1]);
+                    break;
+                }
+            }
+
+            valence[v]--;
+        }
+
+        // Move the triangle's vertices to the front of the LRU cache
+        newCache.clear();
+        newCache.push_back(a);
+        newCache.push_back(b);
+        newCache.push_back(c);
+
+        for (uint32_t v : cache)
+        {
+            if (v != a && v != b && v != c)
+                newCache.push_back(v);
+        }
+
+        for (size_t i = 0; i < newCache.size(); i++)
+        {
+            uint32_t v = newCache[i];
+            cachePositions[v] = i < VERTEX_CACHE_SIZE ? static_cast<int>(i) : -1;
+
+            float score = vertexScore(cachePositions[v], valence[v]);
+            float delta = score - vertexScores[v];
+            vertexScores[v] = score;
+
+            for (uint32_t j = 0; j < valence[v]; j++)
+            {
+                triangleScores[adjacency[adjacencyOffsets[v] + j]] += delta;
+            }
+        }
+
+        if (newCache.size() > VERTEX_CACHE_SIZE)
+            newCache.resize(VERTEX_CACHE_SIZE);
+
+        std::swap(cache, newCache);
+
+        // Pick the best triangle that touches the cache
+        bestTriangle = -1;
+        float bestScore = -std::numeric_limits<float>::max();
+
+        for (uint32_t v : cache)
+        {
+            for (uint32_t j = 0; j < valence[v]; j++)
+            {
+                uint32_t candidate = adjacency[adjacencyOffsets[v] + j];
+                if (triangleScores[candidate] > bestScore)
+                {
+                    bestScore = triangleScores[candidate];
+                    bestTriangle = candidate;
+                }
+            }
+        }
+    }
+
+    indices.swap(result);
+}
+
+float MeshOptimizer::calculateACMR(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return 0.0f;
+
+    // A vertex is in the FIFO cache if fewer than cacheSize misses happened since it was loaded
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t timestamp = cacheSize + 1;
+    size_t misses = 0;
+
+    for (uint32_t index : indices)
+    {
+        if (timestamp - timestamps[index] > cacheSize)
+        {
+            timestamps[index] = timestamp++;
+            misses++;
+        }
+    }
+
+    return static_cast<float>(misses) / static_cast<float>(triangleCount);
+}
+
+void MeshOptimizer::generateClusterBoundaries(const std::vector<uint32_t>& indices, size_t vertexCount, float threshold, std::vector<uint32_t>& clusters)
+{
+    size_t triangleCount = indices.size() / 3;
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t timestamp = SIMULATED_CACHE_SIZE + 1;
+
+    auto fetch = [&](uint32_t triangle) -> uint32_t
+    {
+        uint32_t misses = 0;
+        for (size_t k = 0; k < 3; k++)
+        {
+            uint32_t v = indices[triangle * 3 + k];
+            if (timestamp - timestamps[v] > SIMULATED_CACHE_SIZE)
+            {
+                timestamps[v] = timestamp++;
+                misses++;
+            }
+        }
+        return misses;
+    };
+
+    auto flush = [&]()
+    {
+        timestamp += SIMULATED_CACHE_SIZE + 1;
+    };
+
+    // Hard boundaries are where the cache optimizer had to jump to an unconnected triangle
+    std::vector<uint32_t> hardBoundaries;
+    for (uint32_t t = 0; t < triangleCount; t++)
+    {
+        if (fetch(t) == 3)
+            hardBoundaries.push_back(t);
+    }
+
+    if (hardBoundaries.empty() || hardBoundaries[0] != 0)
+        hardBoundaries.insert(hardBoundaries.begin(), 0);
+
+    // Soft boundaries split hard clusters wherever doing so costs little cache efficiency
+    for (size_t h = 0; h < hardBoundaries.size(); h++)
+    {
+        uint32_t start = hardBoundaries[h];
+        uint32_t end = h + 1 < hardBoundaries.size() ? hardBoundaries[h + 1] : static_cast<uint32_t>(triangleCount);
+
+        flush();
+        uint32_t clusterMisses = 0;
+        for (uint32_t t = start; t < end; t++)
+        {
+            clusterMisses += fetch(t);
+        }
+
+        float clusterThreshold = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+        flush();
+        clusters.push_back(start);
+
+        uint32_t runningMisses = 0;
+        uint32_t runningSize = 0;
+
+        for (uint32_t t = start; t < end; t++)
+        {
+            runningMisses += fetch(t);
+            runningSize++;
+
+            if (t + 1 < end && runningMisses <= clusterThreshold * runningSize)
+            {
+                clusters.push_back(t + 1);
+                runningMisses = 0;
+                runningSize = 0;
+                flush();
+            }
+        }
+    }
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    std::vector<uint32_t> clusters;
+    generateClusterBoundaries(indices, vertices.size(), threshold, clusters);
+
+    glm::vec3 meshCentroid = glm::vec3(0.0f);
+    for (uint32_t index : indices)
+    {
+        meshCentroid += vertices[index].pos;
+    }
+    meshCentroid /= static_cast<float>(indices.size());
+
+    struct ClusterSortData
+    {
+        float key;
+        uint32_t cluster;
+    };
+
+    std::vector<ClusterSortData> sortData(clusters.size());
+
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        uint32_t start = clusters[c];
+        uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : static_cast<uint32_t>(triangleCount);
+
+        glm::vec3 centroid = glm::vec3(0.0f);
+        glm::vec3 normal = glm::vec3(0.0f);
+        float area = 0.0f;
+
+        for (uint32_t t = start; t < end; t++)
+        {
+            const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = glm::length(n);
+
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            normal += n;
+            area += triangleArea;
+        }
+
+        centroid = area > 0.0f ? centroid / area : vertices[indices[start * 3]].pos;
+
+        float normalLength = glm::length(normal);
+        normal = normalLength > 0.0f ? normal / normalLength : glm::vec3(0.0f);
+
+        // Clusters facing away from the mesh center are likely occluders, draw them first
+        sortData[c].key = glm::dot(centroid - meshCentroid, normal);
+        sortData[c].cluster = static_cast<uint32_t>(c);
+    }
+
+    std::stable_sort(sortData.begin(), sortData.end(), [](const ClusterSortData& lhs, const ClusterSortData& rhs)
+    {
+        return lhs.key > rhs.key;
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    for (const ClusterSortData& data : sortData)
+    {
+        uint32_t start = clusters[data.cluster];
+        uint32_t end = data.cluster + 1 < clusters.size() ? clusters[data.cluster + 1] : static_cast<uint32_t>(triangleCount);
+
+        result.insert(result.end(), indices.begin() + start * 3, indices.begin() + end * 3);
+    }
+
+    indices.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+    const uint32_t unused = std::numeric_limits<uint32_t>::max();
+
+    std::vector<uint32_t> remap(vertices.size(), unused);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+
+    // Vertices are laid out in the order they are first referenced, unreferenced ones are dropped
+    for (uint32_t& index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = static_cast<uint32_t>(result.size());
+            result.push_back(vertices[index]);
+        }
+
+        index = remap[index];
+    }
+
+    vertices.swap(result);
+}
@@ -0,0 +1,307 @@
+#include "MeshSimplifier.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+    struct Quadric
+    {
+        float a2 = 0, b2 = 0, c2 = 0, d2 = 0;
+        float ab = 0, ac = 0, ad = 0;
+        float bc = 0, bd = 0, cd = 0;
+        float weight = 0;
+
+        static Quadric fromPlane(const glm::vec3& n, float d, float weight)
+        {
+            Quadric q;
+            q.a2 = n.x * n.x * weight;
+            q.b2 = n.y * n.y * weight;
+            q.c2 = n.z * n.z * weight;
+            q.d2 = d * d * weight;
+            q.ab = n.x * n.y * weight;
+            q.ac = n.x * n.z * weight;
+            q.ad = n.x * d * weight;
+            q.bc = n.y * n.z * weight;
+            q.bd = n.y * d * weight;
+            q.cd = n.z * d * weight;
+            q.weight = weight;
+            return q;
+        }
+
+        Quadric& operator+=(const Quadric& other)
+        {
+            a2 += other.a2; b2 += other.b2; c2 += other.c2; d2 += other.d2;
+            ab += other.ab; ac += other.ac; ad += other.ad;
+            bc += other.bc; bd += other.bd; cd += other.cd;
+            weight += other.weight;
+            return *this;
+        }
+
+        // Weighted mean of the squared distances to the accumulated planes
+        float evaluate(const glm::vec3& p) const
+        {
+            float rx = a2 * p.x + ab * p.y + ac * p.z + ad;
+            float ry = ab * p.x + b2 * p.y + bc * p.z + bd;
+            float rz = ac * p.x + bc * p.y + c2 * p.z + cd;
+            float error = p.x * rx + p.y * ry + p.z * rz + ad * p.x + bd * p.y + cd * p.z + d2;
+
+            return weight > 0.0f ? std::fabs(error) / weight : 0.0f;
+        }
+    };
+
+    struct PositionHash
+    {
+        size_t operator()(const glm::vec3& p) const
+        {
+            uint32_t bits[3];
+            std::memcpy(bits, &p, sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+
+    struct Collapse
+    {
+        uint32_t from;
+        uint32_t to;
+        float error;
+    };
+
+    uint64_t edgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+    }
+}
+
+float MeshSimplifier::simplify(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, std::vector<uint32_t>& result, size_t targetIndexCount, float targetError)
+{
+    result = indices;
+
+    size_t vertexCount = vertices.size();
+    if (result.size() <= targetIndexCount || vertexCount == 0)
+        return 0.0f;
+
+    // Vertices sharing a position are split on some attribute, moving them would open a seam
+    std::unordered_map<glm::vec3, uint32_t, PositionHash> positionGroups;
+    std::vector<uint32_t> positionGroup(vertexCount);
+    std::vector<uint32_t> positionGroupSize;
+
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        auto it = positionGroups.emplace(vertices[v].pos, static_cast<uint32_t>(positionGroupSize.size()));
+        if (it.second)
+            positionGroupSize.push_back(0);
+
+        positionGroup[v] = it.first->second;
+        positionGroupSize[it.first->second]++;
+    }
+
+    std::vector<bool> locked(vertexCount, false);
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        locked[v] = positionGroupSize[positionGroup[v]] > 1;
+    }
+
+    // Open and non-manifold edges stay where they are
+    std::unordered_map<uint64_t, uint32_t> edgeCounts;
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        for (size_t k = 0; k < 3; k++)
+        {
+            edgeCounts[edgeKey(positionGroup[result[i + k]], positionGroup[result[i + (k + 1) % 3]])]++;
+        }
+    }
+
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        for (size_t k = 0; k < 3; k++)
+        {
+            uint32_t a = result[i + k];
+            uint32_t b = result[i + (k + 1) % 3];
+
+            if (edgeCounts[edgeKey(positionGroup[a], positionGroup[b])] != 2)
+            {
+                locked[a] = true;
+                locked[b] = true;
+            }
+        }
+    }
+
+    // Area weighted plane quadrics
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+        const glm::vec3& p0 = vertices[result[i + 0]].pos;
+        const glm::vec3& p1 = vertices[result[i + 1]].pos;
+        const glm::vec3& p2 = vertices[result[i + 2]].pos;
+
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(n);
+        if (length == 0.0f)
+            continue;
+
+        n /= length;
+        Quadric q = Quadric::fromPlane(n, -glm::dot(n, p0), length * 0.5f);
+
+        quadrics[result[i + 0]] += q;
+        quadrics[result[i + 1]] += q;
+        quadrics[result[i + 2]] += q;
+    }
+
+    float errorLimit = targetError * targetError;
+    float resultError = 0.0f;
+
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<bool> touched(vertexCount);
+
+    while (result.size() > targetIndexCount)
+    {
+        // Vertex to triangle adjacency of the current index buffer
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (uint32_t index : result)
+        {
+            adjacencyOffsets[index + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        }
+
+        adjacency.resize(result.size());
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < result.size(); i++)
+        {
+            adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+
+        // Both directions of every edge are candidates, cheapest first
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (size_t k = 0; k < 3; k++)
+            {
+                uint32_t a = result[i + k];
+                uint32_t b = result[i + (k + 1) % 3];
+
+                for (int direction = 0; direction < 2; direction++)
+                {
+                    uint32_t from = direction == 0 ? a : b;
+                    uint32_t to = direction == 0 ? b : a;
+
+                    if (locked[from])
+                        continue;
+
+                    Quadric q = quadrics[from];
+                    q += quadrics[to];
+                    collapses.push_back({ from, to, q.evaluate(vertices[to].pos) });
+                }
+            }
+        }
+
+        if (collapses.empty())
+            break;
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs)
+        {
+            return lhs.error < rhs.error;
+        });
+
+        std::iota(remap.begin(), remap.end(), 0);
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+        size_t trianglesRemoved = 0;
+        size_t collapseCount = 0;
+
+        for (const Collapse& collapse : collapses)
+        {
+            if (collapse.error > errorLimit || trianglesRemoved >= trianglesToRemove)
+                break;
+
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            // Reject collapses that flip any of the remaining triangles around the removed vertex
+            const glm::vec3& target = vertices[collapse.to].pos;
+            bool flipped = false;
+            size_t removedHere = 0;
+
+            for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; j++)
+            {
+                const uint32_t* triangle = &result[adjacency[j] * 3];
+
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                {
+                    removedHere++;
+                    continue;
+                }
+
+                glm::vec3 p[3];
+                glm::vec3 q[3];
+                for (size_t k = 0; k < 3; k++)
+                {
+                    p[k] = vertices[triangle[k]].pos;
+                    q[k] = triangle[k] == collapse.from ? target : p[k];
+                }
+
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+
+                if (glm::dot(before, after) <= 0.0f)
+                {
+                    flipped = true;
+                    break;
+                }
+            }
+
+            if (flipped)
+                continue;
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+
+            // Keep the one-ring fixed for the rest of this pass so flip checks stay valid
+            for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; j++)
+            {
+                const uint32_t* triangle = &result[adjacency[j] * 3];
+                touched[triangle[0]] = true;
+                touched[triangle[1]] = true;
+                touched[triangle[2]] = true;
+            }
+
+            trianglesRemoved += removedHere;
+            resultError = std::max(resultError, collapse.error);
+            collapseCount++;
+        }
+
+        if (collapseCount == 0)
+            break;
+
+        // Apply the collapses and drop the triangles that became degenerate
+        size_t writeIndex = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            uint32_t a = remap[result[i + 0]];
+            uint32_t b = remap[result[i + 1]];
+            uint32_t c = remap[result[i + 2]];
+
+            if (a == b || b == c || a == c)
+                continue;
+
+            result[writeIndex++] = a;
+            result[writeIndex++] = b;
+            result[writeIndex++] = c;
+        }
+
+        result.resize(writeIndex);
+    }
+
+    return std::sqrt(resultError);
+}
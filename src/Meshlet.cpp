@@ -0,0 +1,131 @@
+#include "Meshlet.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+void MeshletBuilder::build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t firstIndex, uint32_t indexCount,
+    std::vector<Meshlet>& meshlets, std::vector<uint32_t>& meshletVertices, std::vector<uint32_t>& meshletTriangles)
+{
+    const uint8_t unused = 0xFF;
+
+    // Local index of each vertex in the meshlet being built
+    std::vector<uint8_t> localIndices(vertices.size(), unused);
+
+    Meshlet meshlet = {};
+    meshlet.vertexOffset = static_cast<uint32_t>(meshletVertices.size());
+    meshlet.triangleOffset = static_cast<uint32_t>(meshletTriangles.size());
+
+    auto flush = [&]()
+    {
+        if (meshlet.triangleCount == 0)
+            return;
+
+        computeBounds(vertices, meshlet, meshletVertices, meshletTriangles);
+        meshlets.push_back(meshlet);
+
+        for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+        {
+            localIndices[meshletVertices[meshlet.vertexOffset + i]] = unused;
+        }
+
+        meshlet = {};
+        meshlet.vertexOffset = static_cast<uint32_t>(meshletVertices.size());
+        meshlet.triangleOffset = static_cast<uint32_t>(meshletTriangles.size());
+    };
+
+    // The index order is already tuned for the vertex cache, so consecutive triangles share most of their vertices
+    for (uint32_t i = firstIndex; i + 2 < firstIndex + indexCount; i += 3)
+    {
+        uint32_t a = indices[i + 0];
+        uint32_t b = indices[i + 1];
+        uint32_t c = indices[i + 2];
+
+        uint32_t newVertices = (localIndices[a] == unused) + (localIndices[b] == unused) + (localIndices[c] == unused);
+
+        if (meshlet.vertexCount + newVertices > MAX_VERTICES || meshlet.triangleCount + 1 > MAX_TRIANGLES)
+        {
+            flush();
+        }
+
+        uint32_t packed = 0;
+        uint32_t corner = 0;
+        for (uint32_t v : { a, b, c })
+        {
+            if (localIndices[v] == unused)
+            {
+                localIndices[v] = static_cast<uint8_t>(meshlet.vertexCount++);
+                meshletVertices.push_back(v);
+            }
+
+            packed |= static_cast<uint32_t>(localIndices[v]) << (8 * corner++);
+        }
+
+        meshletTriangles.push_back(packed);
+        meshlet.triangleCount++;
+    }
+
+    flush();
+}
+
+void MeshletBuilder::computeBounds(const std::vector<Vertex>& vertices, Meshlet& meshlet, const std::vector<uint32_t>& meshletVertices, const std::vector<uint32_t>& meshletTriangles)
+{
+    // Bounding sphere around the box center
+    glm::vec3 boundsMin = vertices[meshletVertices[meshlet.vertexOffset]].pos;
+    glm::vec3 boundsMax = boundsMin;
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+    {
+        const glm::vec3& p = vertices[meshletVertices[meshlet.vertexOffset + i]].pos;
+        boundsMin = glm::min(boundsMin, p);
+        boundsMax = glm::max(boundsMax, p);
+    }
+
+    glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < meshlet.vertexCount; i++)
+    {
+        radius = std::max(radius, glm::length(vertices[meshletVertices[meshlet.vertexOffset + i]].pos - center));
+    }
+
+    meshlet.boundingSphere = glm::vec4(center, radius);
+
+    // Normal cone
+    std::vector<glm::vec3> normals;
+    normals.reserve(meshlet.triangleCount);
+
+    glm::vec3 axis = glm::vec3(0.0f);
+    for (uint32_t i = 0; i < meshlet.triangleCount; i++)
+    {
+        uint32_t packed = meshletTriangles[meshlet.triangleOffset + i];
+        const glm::vec3& p0 = vertices[meshletVertices[meshlet.vertexOffset + ((packed >> 0) & 0xFF)]].pos;
+        const glm::vec3& p1 = vertices[meshletVertices[meshlet.vertexOffset + ((packed >> 8) & 0xFF)]].pos;
+        const glm::vec3& p2 = vertices[meshletVertices[meshlet.vertexOffset + ((packed >> 16) & 0xFF)]].pos;
+
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(n);
+        if (length == 0.0f)
+            continue;
+
+        normals.push_back(n / length);
+        axis += normals.back();
+    }
+
+    float axisLength = glm::length(axis);
+    if (normals.empty() || axisLength < 1e-6f)
+    {
+        meshlet.cone = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        return;
+    }
+
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (const glm::vec3& n : normals)
+    {
+        minDot = std::min(minDot, glm::dot(axis, n));
+    }
+
+    // A cone wider than a hemisphere can never be entirely backfacing, 1 disables the test
+    float cutoff = minDot <= 0.0f ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+    meshlet.cone = glm::vec4(axis, cutoff);
+}
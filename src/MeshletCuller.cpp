@@ -0,0 +1,446 @@
+#include "MeshletCuller.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+MeshletCuller::MeshletCuller(std::shared_ptr<Helper> helper, const std::vector<std::shared_ptr<RenderObject>>& renderObjects) :
+    helper(helper), useMeshShaders(helper->meshShaderSupported)
+{
+    createDescriptorSetLayouts(*helper);
+
+    // One draw slot per mesh per render object, each with room for the mesh's full detail level
+    std::vector<VkDrawIndexedIndirectCommand> drawCommands;
+    VkDeviceSize indexCount = 0;
+
+    drawIndices.resize(renderObjects.size());
+    for (size_t i = 0; i < renderObjects.size(); i++)
+    {
+        for (auto& mesh : renderObjects[i]->model->meshes)
+        {
+            VkDrawIndexedIndirectCommand command{};
+            command.indexCount = 0;
+            command.instanceCount = 1;
+            command.firstIndex = static_cast<uint32_t>(indexCount);
+            command.vertexOffset = mesh->vertexOffset;
+            command.firstInstance = static_cast<uint32_t>(drawCommands.size());
+
+            if (blockRuns.empty() || blockRuns.back().block != mesh->geometry.block)
+                blockRuns.push_back({ mesh->geometry.block, command.firstInstance, 0 });
+            blockRuns.back().drawCount++;
+
+            drawIndices[i].push_back(static_cast<uint32_t>(drawCommands.size()));
+            drawCommands.push_back(command);
+            indexCount += mesh->lods[0].indexCount;
+        }
+    }
+
+    drawCount = static_cast<uint32_t>(drawCommands.size());
+
+    createPassResources(drawCommands, indexCount);
+    createMeshDescriptorSets(renderObjects);
+    createCullPipeline();
+}
+
+MeshletCuller::~MeshletCuller()
+{
+    for (auto& pass : passes)
+    {
+        for (size_t i = 0; i < pass.uniformBuffers.size(); i++)
+        {
+            vkDestroyBuffer(helper->device, pass.uniformBuffers[i], nullptr);
+            vkFreeMemory(helper->device, pass.uniformBuffersMemory[i], nullptr);
+            vkDestroyBuffer(helper->device, pass.indexBuffers[i], nullptr);
+            vkFreeMemory(helper->device, pass.indexBuffersMemory[i], nullptr);
+            vkDestroyBuffer(helper->device, pass.drawCommandBuffers[i], nullptr);
+            vkFreeMemory(helper->device, pass.drawCommandBuffersMemory[i], nullptr);
+        }
+
+        if (!pass.descriptorSets.empty())
+            vkFreeDescriptorSets(helper->device, helper->descriptorPool, static_cast<uint32_t>(pass.descriptorSets.size()), pass.descriptorSets.data());
+    }
+
+    for (auto& [mesh, descriptorSet] : meshDescriptorSets)
+    {
+        vkFreeDescriptorSets(helper->device, helper->descriptorPool, 1, &descriptorSet);
+    }
+
+    vkDestroyBuffer(helper->device, drawCommandTemplateBuffer, nullptr);
+    vkFreeMemory(helper->device, drawCommandTemplateBufferMemory, nullptr);
+
+    vkDestroyPipeline(helper->device, cullPipeline, nullptr);
+    vkDestroyPipelineLayout(helper->device, cullPipelineLayout, nullptr);
+}
+
+void MeshletCuller::createDescriptorSetLayouts(Helper& helper)
+{
+    if (descriptorSetLayoutsCreated)
+        return;
+
+    descriptorSetLayoutsCreated = true;
+
+    VkShaderStageFlags stages = VK_SHADER_STAGE_COMPUTE_BIT;
+    if (helper.meshShaderSupported)
+        stages |= VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+
+    // Meshlet data
+    std::array<VkDescriptorSetLayoutBinding, 4> meshletBindings{};
+    for (uint32_t i = 0; i < meshletBindings.size(); i++)
+    {
+        meshletBindings[i].binding = i;
+        meshletBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        meshletBindings[i].descriptorCount = 1;
+        meshletBindings[i].stageFlags = stages;
+        meshletBindings[i].pImmutableSamplers = nullptr;
+    }
+
+    VkDescriptorSetLayoutCreateInfo meshletLayoutInfo{};
+    meshletLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    meshletLayoutInfo.bindingCount = static_cast<uint32_t>(meshletBindings.size());
+    meshletLayoutInfo.pBindings = meshletBindings.data();
+
+    if (vkCreateDescriptorSetLayout(helper.device, &meshletLayoutInfo, nullptr, &meshletDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+
+    // Culling UBO, compacted indices and indirect draws
+    std::array<VkDescriptorSetLayoutBinding, 3> cullingBindings{};
+    cullingBindings[0].binding = 0;
+    cullingBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    cullingBindings[0].descriptorCount = 1;
+    cullingBindings[0].stageFlags = stages;
+
+    cullingBindings[1].binding = 1;
+    cullingBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    cullingBindings[1].descriptorCount = 1;
+    cullingBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    cullingBindings[2].binding = 2;
+    cullingBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    cullingBindings[2].descriptorCount = 1;
+    cullingBindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo cullingLayoutInfo{};
+    cullingLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    cullingLayoutInfo.bindingCount = static_cast<uint32_t>(cullingBindings.size());
+    cullingLayoutInfo.pBindings = cullingBindings.data();
+
+    if (vkCreateDescriptorSetLayout(helper.device, &cullingLayoutInfo, nullptr, &cullingDescriptorSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create descriptor set layout!");
+    }
+}
+
+void MeshletCuller::destroyDescriptorSetLayouts(Helper& helper)
+{
+    if (descriptorSetLayoutsCreated)
+    {
+        vkDestroyDescriptorSetLayout(helper.device, meshletDescriptorSetLayout, nullptr);
+        vkDestroyDescriptorSetLayout(helper.device, cullingDescriptorSetLayout, nullptr);
+        descriptorSetLayoutsCreated = false;
+    }
+}
+
+void MeshletCuller::createPassResources(const std::vector<VkDrawIndexedIndirectCommand>& drawCommands, VkDeviceSize indexCount)
+{
+    VkDeviceSize drawCommandsSize = sizeof(VkDrawIndexedIndirectCommand) * std::max<size_t>(drawCommands.size(), 1);
+    VkDeviceSize indexBufferSize = sizeof(uint32_t) * std::max<VkDeviceSize>(indexCount, 1);
+
+    std::vector<VkDrawIndexedIndirectCommand> templateCommands = drawCommands;
+    if (templateCommands.empty())
+        templateCommands.push_back({});
+
+    helper->createDeviceLocalBuffer(templateCommands.data(), drawCommandsSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, drawCommandTemplateBuffer, drawCommandTemplateBufferMemory);
+
+    for (auto& pass : passes)
+    {
+        pass.uniformBuffers.resize(helper->MAX_FRAMES_IN_FLIGHT);
+        pass.uniformBuffersMemory.resize(helper->MAX_FRAMES_IN_FLIGHT);
+        pass.uniformBuffersMapped.resize(helper->MAX_FRAMES_IN_FLIGHT);
+        pass.indexBuffers.resize(helper->MAX_FRAMES_IN_FLIGHT);
+        pass.indexBuffersMemory.resize(helper->MAX_FRAMES_IN_FLIGHT);
+        pass.drawCommandBuffers.resize(helper->MAX_FRAMES_IN_FLIGHT);
+        pass.drawCommandBuffersMemory.resize(helper->MAX_FRAMES_IN_FLIGHT);
+        pass.descriptorSets.resize(helper->MAX_FRAMES_IN_FLIGHT);
+
+        for (size_t i = 0; i < helper->MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            helper->createBuffer(sizeof(MeshletCullingUBO), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, pass.uniformBuffers[i], pass.uniformBuffersMemory[i]);
+            vkMapMemory(helper->device, pass.uniformBuffersMemory[i], 0, sizeof(MeshletCullingUBO), 0, &pass.uniformBuffersMapped[i]);
+
+            // The compute fallback writes these, the mesh shader path only needs the UBO
+            helper->createBuffer(indexBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pass.indexBuffers[i], pass.indexBuffersMemory[i]);
+            helper->createBuffer(drawCommandsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pass.drawCommandBuffers[i], pass.drawCommandBuffersMemory[i]);
+
+            helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)pass.indexBuffers[i], "MeshletCuller::Compacted Index Buffer");
+            helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)pass.drawCommandBuffers[i], "MeshletCuller::Draw Command Buffer");
+        }
+
+        std::vector<VkDescriptorSetLayout> layouts(helper->MAX_FRAMES_IN_FLIGHT, cullingDescriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = helper->descriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+        allocInfo.pSetLayouts = layouts.data();
+
+        if (vkAllocateDescriptorSets(helper->device, &allocInfo, pass.descriptorSets.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate descriptor sets!");
+        }
+
+        for (size_t i = 0; i < helper->MAX_FRAMES_IN_FLIGHT; i++)
+        {
+            VkDescriptorBufferInfo uboInfo{};
+            uboInfo.buffer = pass.uniformBuffers[i];
+            uboInfo.offset = 0;
+            uboInfo.range = sizeof(MeshletCullingUBO);
+
+            VkDescriptorBufferInfo indexInfo{};
+            indexInfo.buffer = pass.indexBuffers[i];
+            indexInfo.offset = 0;
+            indexInfo.range = VK_WHOLE_SIZE;
+
+            VkDescriptorBufferInfo drawInfo{};
+            drawInfo.buffer = pass.drawCommandBuffers[i];
+            drawInfo.offset = 0;
+            drawInfo.range = VK_WHOLE_SIZE;
+
+            std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+            for (uint32_t j = 0; j < descriptorWrites.size(); j++)
+            {
+                descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[j].dstSet = pass.descriptorSets[i];
+                descriptorWrites[j].dstBinding = j;
+                descriptorWrites[j].dstArrayElement = 0;
+                descriptorWrites[j].descriptorCount = 1;
+                descriptorWrites[j].descriptorType = j == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            }
+            descriptorWrites[0].pBufferInfo = &uboInfo;
+            descriptorWrites[1].pBufferInfo = &indexInfo;
+            descriptorWrites[2].pBufferInfo = &drawInfo;
+
+            vkUpdateDescriptorSets(helper->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+        }
+    }
+}
+
+void MeshletCuller::createMeshDescriptorSets(const std::vector<std::shared_ptr<RenderObject>>& renderObjects)
+{
+    for (auto& renderObject : renderObjects)
+    {
+        Model& model = *renderObject->model;
+
+        for (auto& mesh : model.meshes)
+        {
+            if (meshDescriptorSets.count(mesh.get()))
+                continue;
+
+            VkDescriptorSetAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = helper->descriptorPool;
+            allocInfo.descriptorSetCount = 1;
+            allocInfo.pSetLayouts = &meshletDescriptorSetLayout;
+
+            VkDescriptorSet descriptorSet;
+            if (vkAllocateDescriptorSets(helper->device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+                throw std::runtime_error("failed to allocate descriptor sets!");
+            }
+
+            std::array<VkDescriptorBufferInfo, 4> bufferInfos{};
+            bufferInfos[1].buffer = model.meshletBuffer;
+            bufferInfos[2].buffer = model.meshletVertexBuffer;
+            bufferInfos[3].buffer = model.meshletTriangleBuffer;
+            for (uint32_t i = 1; i < bufferInfos.size(); i++)
+            {
+                bufferInfos[i].offset = 0;
+                bufferInfos[i].range = VK_WHOLE_SIZE;
+            }
+
+            // The mesh's vertices within its geometry arena block
+            bufferInfos[0].buffer = mesh->getBuffer();
+            bufferInfos[0].offset = mesh->geometry.offset;
+            bufferInfos[0].range = std::max<VkDeviceSize>(sizeof(Vertex) * mesh->vertices.size(), sizeof(Vertex));
+
+            std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
+            for (uint32_t i = 0; i < descriptorWrites.size(); i++)
+            {
+
+                descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[i].dstSet = descriptorSet;
+                descriptorWrites[i].dstBinding = i;
+                descriptorWrites[i].dstArrayElement = 0;
+                descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorWrites[i].descriptorCount = 1;
+                descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+            }
+
+            vkUpdateDescriptorSets(helper->device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+            meshDescriptorSets[mesh.get()] = descriptorSet;
+        }
+    }
+}
+
+void MeshletCuller::createCullPipeline()
+{
+    auto computeShaderCode = helper->readFile("shaders/meshletCull.comp.spv");
+    VkShaderModule computeShaderModule = helper->createShaderModule(computeShaderCode);
+
+    VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
+    computeShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    computeShaderStageInfo.module = computeShaderModule;
+    computeShaderStageInfo.pName = "main";
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(MeshletCullPushConstants);
+
+    std::vector<VkDescriptorSetLayout> layouts = { meshletDescriptorSetLayout, cullingDescriptorSetLayout };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(layouts.size());
+    pipelineLayoutInfo.pSetLayouts = layouts.data();
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(helper->device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = computeShaderStageInfo;
+    pipelineInfo.layout = cullPipelineLayout;
+
+    if (vkCreateComputePipelines(helper->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &cullPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create compute pipeline!");
+    }
+
+    vkDestroyShaderModule(helper->device, computeShaderModule, nullptr);
+}
+
+void MeshletCuller::updateCullingData(MeshletCullingPass pass, uint32_t currentFrame, const glm::mat4& viewProjection, glm::vec3 viewPosition, glm::vec3 viewDirection, bool orthographic)
+{
+    MeshletCullingUBO ubo{};
+
+    // Gribb-Hartmann plane extraction, depth is in the 0..1 range
+    glm::vec4 row0 = glm::vec4(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+    glm::vec4 row1 = glm::vec4(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+    glm::vec4 row2 = glm::vec4(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+    glm::vec4 row3 = glm::vec4(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+    ubo.frustumPlanes[0] = row3 + row0;
+    ubo.frustumPlanes[1] = row3 - row0;
+    ubo.frustumPlanes[2] = row3 + row1;
+    ubo.frustumPlanes[3] = row3 - row1;
+    ubo.frustumPlanes[4] = row2;
+    ubo.frustumPlanes[5] = row3 - row2;
+
+    for (glm::vec4& plane : ubo.frustumPlanes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+
+    ubo.viewPosition = glm::vec4(viewPosition, 1.0f);
+    ubo.viewDirection = glm::vec4(glm::normalize(viewDirection), orthographic ? 1.0f : 0.0f);
+
+    memcpy(passes[pass].uniformBuffersMapped[currentFrame], &ubo, sizeof(ubo));
+}
+
+void MeshletCuller::beginCulling(VkCommandBuffer commandBuffer, MeshletCullingPass pass, uint32_t currentFrame)
+{
+    PassResources& resources = passes[pass];
+
+    // Reset the draw commands to zero indices at each slot's start
+    VkBufferCopy copyRegion{};
+    copyRegion.size = sizeof(VkDrawIndexedIndirectCommand) * std::max<uint32_t>(drawCount, 1);
+    vkCmdCopyBuffer(commandBuffer, drawCommandTemplateBuffer, resources.drawCommandBuffers[currentFrame], 1, &copyRegion);
+
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 1, 1, &resources.descriptorSets[currentFrame], 0, nullptr);
+    boundMesh = nullptr;
+}
+
+void MeshletCuller::cullMesh(VkCommandBuffer commandBuffer, uint32_t renderObjectIndex, uint32_t meshIndex, RenderObject& renderObject, const Mesh& mesh, const MeshLod& lod)
+{
+    if (lod.meshletCount == 0)
+        return;
+
+    MeshletCullPushConstants pushConstants{};
+    pushConstants.model = renderObject.getModelMatrix();
+    pushConstants.meshletOffset = mesh.meshletBufferOffset + lod.meshletOffset;
+    pushConstants.meshletCount = lod.meshletCount;
+    pushConstants.scale = renderObject.getScale();
+    pushConstants.drawIndex = drawIndices[renderObjectIndex][meshIndex];
+
+    if (boundMesh != &mesh)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &meshDescriptorSets.at(&mesh), 0, nullptr);
+        boundMesh = &mesh;
+    }
+    vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(MeshletCullPushConstants), &pushConstants);
+
+    // One workgroup per meshlet
+    vkCmdDispatch(commandBuffer, lod.meshletCount, 1, 1);
+}
+
+void MeshletCuller::endCulling(VkCommandBuffer commandBuffer)
+{
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+void MeshletCuller::drawCompacted(VkCommandBuffer commandBuffer, MeshletCullingPass pass, uint32_t currentFrame)
+{
+    vkCmdBindIndexBuffer(commandBuffer, passes[pass].indexBuffers[currentFrame], 0, VK_INDEX_TYPE_UINT32);
+
+    for (const BlockRun& run : blockRuns)
+    {
+        VkBuffer vertexBuffer = helper->geometryArena->getBuffer(run.block);
+        VkDeviceSize vertexOffset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, &vertexOffset);
+
+        VkDeviceSize offset = sizeof(VkDrawIndexedIndirectCommand) * run.firstDraw;
+        vkCmdDrawIndexedIndirect(commandBuffer, passes[pass].drawCommandBuffers[currentFrame], offset, run.drawCount, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+void MeshletCuller::bindMeshShaderPass(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t firstSet, MeshletCullingPass pass, uint32_t currentFrame)
+{
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, firstSet + 1, 1, &passes[pass].descriptorSets[currentFrame], 0, nullptr);
+    boundMesh = nullptr;
+}
+
+void MeshletCuller::drawMeshlets(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t firstSet, uint32_t renderObjectIndex, uint32_t meshIndex, RenderObject& renderObject, const Mesh& mesh, const MeshLod& lod)
+{
+    if (lod.meshletCount == 0)
+        return;
+
+    MeshletDrawPushConstants pushConstants{};
+    pushConstants.meshletOffset = mesh.meshletBufferOffset + lod.meshletOffset;
+    pushConstants.meshletCount = lod.meshletCount;
+    pushConstants.scale = renderObject.getScale();
+    pushConstants.drawIndex = drawIndices[renderObjectIndex][meshIndex];
+
+    if (boundMesh != &mesh)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, firstSet, 1, &meshDescriptorSets.at(&mesh), 0, nullptr);
+        boundMesh = &mesh;
+    }
+    vkCmdPushConstants(commandBuffer, pipelineLayout, MESHLET_PUSH_CONSTANT_STAGES, MESHLET_PUSH_CONSTANT_OFFSET, sizeof(MeshletDrawPushConstants), &pushConstants);
+
+    // Each task workgroup culls TASK_WORKGROUP_SIZE meshlets and launches a mesh workgroup per visible one
+    helper->cmdDrawMeshTasksEXT(commandBuffer, (lod.meshletCount + TASK_WORKGROUP_SIZE - 1) / TASK_WORKGROUP_SIZE, 1, 1);
+}
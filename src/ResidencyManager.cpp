@@ -0,0 +1,264 @@
+#include "ResidencyManager.h"
+#include "Helper.h"
+
+#include <algorithm>
+#include <vector>
+
+ResidencyManager::ResidencyManager(Helper& helper) : helper(helper)
+{}
+
+ResidencyManager::Handle ResidencyManager::add(const std::string& name, ResidencyPriority priority, VkDeviceSize size, std::function<VkDeviceSize()> evict, std::function<VkDeviceSize()> relocate)
+{
+    Handle handle = nextHandle++;
+
+    // New resources count as used, whoever created them is about to use them
+    resources[handle] = { name, priority, size, frame, nextAllocation++, std::move(evict), std::move(relocate) };
+    return handle;
+}
+
+void ResidencyManager::remove(Handle handle)
+{
+    resources.erase(handle);
+}
+
+void ResidencyManager::setSize(Handle handle, VkDeviceSize size)
+{
+    auto it = resources.find(handle);
+    if (it == resources.end())
+        return;
+
+    // A restored resource has a new allocation
+    if (it->second.size == 0 && size > 0)
+        it->second.allocation = nextAllocation++;
+
+    it->second.size = size;
+}
+
+void ResidencyManager::markUsed(Handle handle)
+{
+    auto it = resources.find(handle);
+    if (it != resources.end())
+        it->second.lastUseFrame = frame;
+}
+
+void ResidencyManager::beginFrame()
+{
+    frame++;
+
+    for (auto it = retired.begin(); it != retired.end();)
+    {
+        if (--it->second > 0)
+        {
+            ++it;
+            continue;
+        }
+
+        it->first();
+        it = retired.erase(it);
+    }
+
+    VkDeviceSize overBudgetSize = getOverBudgetSize();
+    if (overBudgetSize > 0)
+        makeRoom(overBudgetSize, idleFrames);
+}
+
+VkDeviceSize ResidencyManager::makeRoom(VkDeviceSize size, uint32_t minIdleFrames)
+{
+    if (evicting)
+        return 0;
+
+    std::vector<std::pair<Handle, Resource*>> candidates;
+    for (auto& [handle, resource] : resources)
+    {
+        if (resource.size > 0 && resource.priority != RESIDENCY_PRIORITY_PINNED && resource.lastUseFrame + minIdleFrames <= frame)
+            candidates.emplace_back(handle, &resource);
+    }
+
+    if (candidates.empty())
+        return 0;
+
+    std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b)
+    {
+        if (a.second->priority != b.second->priority)
+            return a.second->priority < b.second->priority;
+        return a.second->lastUseFrame < b.second->lastUseFrame;
+    });
+
+    // Earlier frames may still use the candidates
+    vkDeviceWaitIdle(helper.device);
+
+    evicting = true;
+
+    VkDeviceSize freed = 0;
+    for (auto& [handle, resource] : candidates)
+    {
+        if (freed >= size)
+            break;
+
+        VkDeviceSize previousSize = resource->size;
+        VkDeviceSize resourceFreed = 0;
+        try
+        {
+            resourceFreed = resource->evict();
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Failed to evict " << resource->name << ": " << e.what() << std::endl;
+            continue;
+        }
+
+        if (resourceFreed == 0)
+            continue;
+
+        // Unless the callback already reported its new size
+        if (resource->size == previousSize)
+            resource->size -= std::min(resource->size, resourceFreed);
+        freed += resourceFreed;
+        evictionCount++;
+    }
+
+    evicting = false;
+
+    if (freed > 0)
+    {
+        lastEvictionFrame = frame;
+        requestDefragmentation();
+    }
+
+    return freed;
+}
+
+void ResidencyManager::retire(std::function<void()> destroy)
+{
+    retired.emplace_back(std::move(destroy), static_cast<uint32_t>(helper.MAX_FRAMES_IN_FLIGHT) + 1);
+}
+
+void ResidencyManager::destroyRetired()
+{
+    for (auto& [destroy, framesLeft] : retired)
+    {
+        destroy();
+    }
+    retired.clear();
+}
+
+void ResidencyManager::requestDefragmentation()
+{
+    defragmentationEnd = nextAllocation;
+}
+
+void ResidencyManager::defragment()
+{
+    if (!isDefragmenting())
+        return;
+
+    // Oldest allocations first, they are the ones surrounded by the holes
+    std::vector<Resource*> candidates;
+    for (auto& [handle, resource] : resources)
+    {
+        if (resource.relocate && resource.size > 0 && resource.allocation < defragmentationEnd)
+            candidates.push_back(&resource);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Resource* a, const Resource* b)
+    {
+        return a->allocation < b->allocation;
+    });
+
+    evicting = true;
+
+    VkDeviceSize moved = 0;
+    for (Resource* resource : candidates)
+    {
+        if (moved >= defragmentationBytesPerFrame)
+            break;
+
+        try
+        {
+            moved += resource->relocate();
+        }
+        catch (const std::exception& e)
+        {
+            // Not enough memory for a second copy, try again with the next request
+            std::cerr << "Failed to relocate " << resource->name << ": " << e.what() << std::endl;
+            defragmentationEnd = 0;
+            break;
+        }
+
+        resource->allocation = nextAllocation++;
+    }
+
+    evicting = false;
+
+    relocatedSize += moved;
+
+    if (moved == 0)
+        defragmentationEnd = 0;
+}
+
+bool ResidencyManager::isDefragmenting() const
+{
+    return defragmentationEnd > 0;
+}
+
+bool ResidencyManager::isUnderPressure() const
+{
+    return lastEvictionFrame > 0 && frame - lastEvictionFrame < pressureFrames;
+}
+
+VkDeviceSize ResidencyManager::getTrackedSize() const
+{
+    VkDeviceSize size = 0;
+    for (const auto& [handle, resource] : resources)
+    {
+        size += resource.size;
+    }
+    return size;
+}
+
+uint32_t ResidencyManager::getEvictedCount() const
+{
+    uint32_t count = 0;
+    for (const auto& [handle, resource] : resources)
+    {
+        if (resource.size == 0)
+            count++;
+    }
+    return count;
+}
+
+uint64_t ResidencyManager::getEvictionCount() const
+{
+    return evictionCount;
+}
+
+VkDeviceSize ResidencyManager::getRelocatedSize() const
+{
+    return relocatedSize;
+}
+
+VkDeviceSize ResidencyManager::getOverBudgetSize() const
+{
+    if (!helper.memoryBudgetSupported)
+        return 0;
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+    VkPhysicalDeviceMemoryProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budget;
+    vkGetPhysicalDeviceMemoryProperties2(helper.physicalDevice, &properties);
+
+    VkDeviceSize overBudgetSize = 0;
+    for (uint32_t i = 0; i < properties.memoryProperties.memoryHeapCount; i++)
+    {
+        if (!(properties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+            continue;
+
+        VkDeviceSize limit = static_cast<VkDeviceSize>(budget.heapBudget[i] * budgetFraction);
+        if (budget.heapUsage[i] > limit)
+            overBudgetSize = std::max(overBudgetSize, budget.heapUsage[i] - limit);
+    }
+    return overBudgetSize;
+}
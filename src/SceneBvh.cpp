@@ -0,0 +1,438 @@
+#include "SceneBvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    // Slab test, entryDistance is where the ray enters the box
+    bool intersectBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& entryDistance)
+    {
+        glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+        glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+
+        entryDistance = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float exitDistance = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+        return entryDistance <= exitDistance;
+    }
+
+    // Moller-Trumbore, the distance is in units of the direction's length
+    bool intersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, float& distance)
+    {
+        glm::vec3 edge1 = v1 - v0;
+        glm::vec3 edge2 = v2 - v0;
+        glm::vec3 p = glm::cross(direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (std::abs(determinant) < 1e-12f)
+            return false;
+
+        float inverseDeterminant = 1.0f / determinant;
+        glm::vec3 s = origin - v0;
+        float u = glm::dot(s, p) * inverseDeterminant;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+
+        glm::vec3 q = glm::cross(s, edge1);
+        float v = glm::dot(direction, q) * inverseDeterminant;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+
+        distance = glm::dot(edge2, q) * inverseDeterminant;
+        return distance >= 0.0f;
+    }
+}
+
+void SceneBvh::update(const DrawList& drawList, bool transformsChanged)
+{
+    this->drawList = &drawList;
+
+    if (drawListBuildCount != drawList.getBuildCount())
+    {
+        updateEntryBounds();
+        build();
+        drawListBuildCount = drawList.getBuildCount();
+    }
+    else if (transformsChanged)
+    {
+        updateEntryBounds();
+        refit();
+    }
+}
+
+void SceneBvh::updateEntryBounds()
+{
+    const std::vector<DrawListEntry>& entries = drawList->getEntries();
+    entryMin.resize(entries.size());
+    entryMax.resize(entries.size());
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const Mesh& mesh = *entries[i].mesh;
+        const glm::mat4& model = entries[i].renderObject->getModelMatrix();
+
+        glm::vec3 center = glm::vec3(model * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+        glm::vec3 localExtent = (mesh.boundsMax - mesh.boundsMin) * 0.5f;
+        glm::vec3 extent = glm::abs(glm::vec3(model[0])) * localExtent.x + glm::abs(glm::vec3(model[1])) * localExtent.y + glm::abs(glm::vec3(model[2])) * localExtent.z;
+
+        entryMin[i] = center - extent;
+        entryMax[i] = center + extent;
+    }
+}
+
+void SceneBvh::build()
+{
+    uint32_t entryCount = static_cast<uint32_t>(entryMin.size());
+
+    items.resize(entryCount);
+    for (uint32_t i = 0; i < entryCount; i++)
+    {
+        items[i] = i;
+    }
+
+    nodes.clear();
+    buildCount++;
+    if (entryCount == 0)
+        return;
+
+    nodes.reserve(2 * entryCount);
+    nodes.push_back({ glm::vec3(0.0f), 0, glm::vec3(0.0f), entryCount });
+
+    // Nodes waiting to be split, with the first of their items
+    std::vector<std::pair<uint32_t, uint32_t>> pending = { { 0, 0 } };
+    while (!pending.empty())
+    {
+        uint32_t nodeIndex = pending.back().first;
+        uint32_t first = pending.back().second;
+        pending.pop_back();
+
+        uint32_t count = nodes[nodeIndex].itemCount;
+
+        glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+        glm::vec3 centroidMin = boundsMin;
+        glm::vec3 centroidMax = boundsMax;
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            boundsMin = glm::min(boundsMin, entryMin[items[i]]);
+            boundsMax = glm::max(boundsMax, entryMax[items[i]]);
+            glm::vec3 centroid = (entryMin[items[i]] + entryMax[items[i]]) * 0.5f;
+            centroidMin = glm::min(centroidMin, centroid);
+            centroidMax = glm::max(centroidMax, centroid);
+        }
+
+        nodes[nodeIndex].boundsMin = boundsMin;
+        nodes[nodeIndex].boundsMax = boundsMax;
+        nodes[nodeIndex].firstChildOrItem = first;
+
+        if (count <= MAX_LEAF_SIZE)
+            continue;
+
+        glm::vec3 centroidExtent = centroidMax - centroidMin;
+        int axis = 0;
+        if (centroidExtent.y > centroidExtent[axis])
+            axis = 1;
+        if (centroidExtent.z > centroidExtent[axis])
+            axis = 2;
+
+        uint32_t half = count / 2;
+        std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count, [&](uint32_t a, uint32_t b)
+        {
+            return entryMin[a][axis] + entryMax[a][axis] < entryMin[b][axis] + entryMax[b][axis];
+        });
+
+        uint32_t left = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({ glm::vec3(0.0f), 0, glm::vec3(0.0f), half });
+        nodes.push_back({ glm::vec3(0.0f), 0, glm::vec3(0.0f), count - half });
+
+        nodes[nodeIndex].firstChildOrItem = left;
+        nodes[nodeIndex].itemCount = 0;
+
+        pending.push_back({ left, first });
+        pending.push_back({ left + 1, first + half });
+    }
+}
+
+void SceneBvh::refit()
+{
+    refitCount++;
+
+    // Children always come after their parent
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        Node& node = nodes[i];
+        if (node.itemCount > 0)
+        {
+            node.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+            node.boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+            for (uint32_t j = node.firstChildOrItem; j < node.firstChildOrItem + node.itemCount; j++)
+            {
+                node.boundsMin = glm::min(node.boundsMin, entryMin[items[j]]);
+                node.boundsMax = glm::max(node.boundsMax, entryMax[items[j]]);
+            }
+        }
+        else
+        {
+            const Node& left = nodes[node.firstChildOrItem];
+            const Node& right = nodes[node.firstChildOrItem + 1];
+            node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+            node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+        }
+    }
+}
+
+void SceneBvh::collect(uint32_t node, std::vector<uint32_t>& entries) const
+{
+    std::vector<uint32_t> stack = { node };
+    while (!stack.empty())
+    {
+        const Node& current = nodes[stack.back()];
+        stack.pop_back();
+
+        if (current.itemCount > 0)
+        {
+            entries.insert(entries.end(), items.begin() + current.firstChildOrItem, items.begin() + current.firstChildOrItem + current.itemCount);
+            continue;
+        }
+
+        stack.push_back(current.firstChildOrItem);
+        stack.push_back(current.firstChildOrItem + 1);
+    }
+}
+
+template<typename Overlaps>
+void SceneBvh::query(const Overlaps& overlaps, std::vector<uint32_t>& entries) const
+{
+    if (nodes.empty())
+        return;
+
+    std::vector<uint32_t> stack = { 0 };
+    while (!stack.empty())
+    {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        if (!overlaps(node.boundsMin, node.boundsMax))
+            continue;
+
+        if (node.itemCount == 0)
+        {
+            stack.push_back(node.firstChildOrItem);
+            stack.push_back(node.firstChildOrItem + 1);
+            continue;
+        }
+
+        for (uint32_t i = node.firstChildOrItem; i < node.firstChildOrItem + node.itemCount; i++)
+        {
+            if (overlaps(entryMin[items[i]], entryMax[items[i]]))
+                entries.push_back(items[i]);
+        }
+    }
+}
+
+void SceneBvh::queryFrustum(const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& entries) const
+{
+    if (nodes.empty())
+        return;
+
+    // 0 outside, 1 intersecting, 2 inside
+    auto classify = [&](const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+
+        int result = 2;
+        for (const glm::vec4& plane : planes)
+        {
+            float distance = glm::dot(center, glm::vec3(plane)) + plane.w;
+            float radius = glm::dot(extent, glm::abs(glm::vec3(plane)));
+            if (distance + radius < 0.0f)
+                return 0;
+            if (distance - radius < 0.0f)
+                result = 1;
+        }
+        return result;
+    };
+
+    std::vector<uint32_t> stack = { 0 };
+    while (!stack.empty())
+    {
+        uint32_t nodeIndex = stack.back();
+        const Node& node = nodes[nodeIndex];
+        stack.pop_back();
+
+        int classification = classify(node.boundsMin, node.boundsMax);
+        if (classification == 0)
+            continue;
+
+        if (classification == 2)
+        {
+            collect(nodeIndex, entries);
+            continue;
+        }
+
+        if (node.itemCount == 0)
+        {
+            stack.push_back(node.firstChildOrItem);
+            stack.push_back(node.firstChildOrItem + 1);
+            continue;
+        }
+
+        for (uint32_t i = node.firstChildOrItem; i < node.firstChildOrItem + node.itemCount; i++)
+        {
+            if (classify(entryMin[items[i]], entryMax[items[i]]) != 0)
+                entries.push_back(items[i]);
+        }
+    }
+}
+
+void SceneBvh::queryBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, std::vector<uint32_t>& entries) const
+{
+    query([&](const glm::vec3& nodeMin, const glm::vec3& nodeMax)
+    {
+        return glm::all(glm::lessThanEqual(nodeMin, boundsMax)) && glm::all(glm::lessThanEqual(boundsMin, nodeMax));
+    }, entries);
+}
+
+void SceneBvh::querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& entries) const
+{
+    query([&](const glm::vec3& nodeMin, const glm::vec3& nodeMax)
+    {
+        glm::vec3 offset = center - glm::clamp(center, nodeMin, nodeMax);
+        return glm::dot(offset, offset) <= radius * radius;
+    }, entries);
+}
+
+void SceneBvh::queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<uint32_t>& entries) const
+{
+    glm::vec3 inverseDirection = 1.0f / direction;
+
+    query([&](const glm::vec3& nodeMin, const glm::vec3& nodeMax)
+    {
+        float entryDistance;
+        return intersectBox(nodeMin, nodeMax, origin, inverseDirection, maxDistance, entryDistance);
+    }, entries);
+}
+
+bool SceneBvh::intersectEntry(uint32_t entry, const glm::vec3& origin, const glm::vec3& direction, float& distance) const
+{
+    const DrawListEntry& drawListEntry = drawList->getEntries()[entry];
+    const Mesh& mesh = *drawListEntry.mesh;
+    if (mesh.lods.empty())
+        return false;
+
+    // Tested in model space, a point keeps its parameter along the ray under the transform
+    glm::mat4 inverseModel = glm::inverse(drawListEntry.renderObject->getModelMatrix());
+    glm::vec3 modelOrigin = glm::vec3(inverseModel * glm::vec4(origin, 1.0f));
+    glm::vec3 modelDirection = glm::vec3(inverseModel * glm::vec4(direction, 0.0f));
+
+    const MeshLod& lod = mesh.lods[0];
+    bool hit = false;
+    for (uint32_t i = lod.firstIndex; i + 2 < lod.firstIndex + lod.indexCount; i += 3)
+    {
+        float triangleDistance;
+        if (intersectTriangle(modelOrigin, modelDirection, mesh.vertices[mesh.indices[i]].pos, mesh.vertices[mesh.indices[i + 1]].pos, mesh.vertices[mesh.indices[i + 2]].pos, triangleDistance)
+            && triangleDistance < distance)
+        {
+            distance = triangleDistance;
+            hit = true;
+        }
+    }
+
+    return hit;
+}
+
+bool SceneBvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, SceneBvhHit& hit) const
+{
+    if (nodes.empty())
+        return false;
+
+    glm::vec3 inverseDirection = 1.0f / direction;
+    float nearest = maxDistance;
+    bool found = false;
+
+    std::vector<uint32_t> stack = { 0 };
+    while (!stack.empty())
+    {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        float entryDistance;
+        if (!intersectBox(node.boundsMin, node.boundsMax, origin, inverseDirection, nearest, entryDistance))
+            continue;
+
+        if (node.itemCount > 0)
+        {
+            for (uint32_t i = node.firstChildOrItem; i < node.firstChildOrItem + node.itemCount; i++)
+            {
+                if (!intersectBox(entryMin[items[i]], entryMax[items[i]], origin, inverseDirection, nearest, entryDistance))
+                    continue;
+
+                if (intersectEntry(items[i], origin, direction, nearest))
+                {
+                    hit.entry = items[i];
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        uint32_t nearChild = node.firstChildOrItem;
+        uint32_t farChild = node.firstChildOrItem + 1;
+        float nearDistance, farDistance;
+        bool nearHit = intersectBox(nodes[nearChild].boundsMin, nodes[nearChild].boundsMax, origin, inverseDirection, nearest, nearDistance);
+        bool farHit = intersectBox(nodes[farChild].boundsMin, nodes[farChild].boundsMax, origin, inverseDirection, nearest, farDistance);
+
+        if (nearHit && farHit && farDistance < nearDistance)
+        {
+            std::swap(nearChild, farChild);
+        }
+        else if (!nearHit)
+        {
+            nearChild = farChild;
+            nearHit = farHit;
+            farHit = false;
+        }
+
+        // The nearer child is visited first, a hit in it shortens the ray for the other one
+        if (farHit)
+            stack.push_back(farChild);
+        if (nearHit)
+            stack.push_back(nearChild);
+    }
+
+    if (found)
+    {
+        hit.distance = nearest;
+        hit.position = origin + direction * nearest;
+    }
+
+    return found;
+}
+
+glm::vec3 SceneBvh::getEntryBoundsMin(uint32_t entry) const
+{
+    return entryMin[entry];
+}
+
+glm::vec3 SceneBvh::getEntryBoundsMax(uint32_t entry) const
+{
+    return entryMax[entry];
+}
+
+uint32_t SceneBvh::getNodeCount() const
+{
+    return static_cast<uint32_t>(nodes.size());
+}
+
+uint32_t SceneBvh::getBuildCount() const
+{
+    return buildCount;
+}
+
+uint32_t SceneBvh::getRefitCount() const
+{
+    return refitCount;
+}
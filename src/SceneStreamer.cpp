@@ -0,0 +1,247 @@
+#include "SceneStreamer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+SceneStreamer::SceneStreamer(std::shared_ptr<Helper> helper, const std::string& manifestPath, SceneStreamingOptions options) :
+    helper(helper), options(options)
+{
+    // Cells only become visible once they are complete, the renderer's per mesh resources are built from them
+    this->options.modelOptions.asynchronous = true;
+
+    loadManifest(manifestPath);
+}
+
+SceneStreamer::~SceneStreamer()
+{
+    renderObjects.clear();
+    retiredCells.clear();
+    cells.clear();
+}
+
+void SceneStreamer::loadManifest(const std::string& manifestPath)
+{
+    std::ifstream file(manifestPath);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open scene manifest!");
+    }
+
+    std::string directory = manifestPath.substr(0, manifestPath.find_last_of('/'));
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream stream(line);
+
+        std::string keyword;
+        if (!(stream >> keyword) || keyword[0] == '#')
+            continue;
+
+        if (keyword != "cell") {
+            throw std::runtime_error("failed to parse scene manifest!");
+        }
+
+        SceneCell cell;
+        std::string path;
+        if (!(stream >> cell.boundsMin.x >> cell.boundsMin.y >> cell.boundsMin.z >> cell.boundsMax.x >> cell.boundsMax.y >> cell.boundsMax.z >> path)) {
+            throw std::runtime_error("failed to parse scene manifest!");
+        }
+
+        unsigned long long memorySize;
+        if (stream >> memorySize)
+            cell.memorySize = memorySize;
+
+        cell.path = directory + "/" + path;
+        cells.push_back(std::move(cell));
+    }
+}
+
+bool SceneStreamer::update(glm::vec3 cameraPosition, glm::vec3 voxelGridMin, glm::vec3 voxelGridMax)
+{
+    bool changed = false;
+
+    for (auto it = retiredCells.begin(); it != retiredCells.end();)
+    {
+        if (--it->framesLeft == 0)
+        {
+            it = retiredCells.erase(it);
+            // The cell's allocations leave holes between the ones around them
+            helper->residency->requestDefragmentation();
+        }
+        else
+            ++it;
+    }
+
+    // Cells inside the voxel grid are needed for the cone tracing, so they go first
+    auto priority = [&](const SceneCell& cell)
+    {
+        return intersects(cell, voxelGridMin, voxelGridMax) ? 0.0f : distanceToCell(cell, cameraPosition);
+    };
+
+    for (SceneCell& cell : cells)
+    {
+        if (!cell.model || cell.resident)
+            continue;
+
+        try
+        {
+            if (!cell.model->update(options.uploadsPerFrame))
+                continue;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Failed to stream " << cell.path << ": " << e.what() << std::endl;
+            cell.failed = true;
+            evict(cell);
+            continue;
+        }
+
+        cell.resident = true;
+        cell.memorySize = cell.model->memorySize;
+        cell.renderObject = std::make_shared<RenderObject>(helper, cell.model);
+        changed = true;
+    }
+
+    for (SceneCell& cell : cells)
+    {
+        if (cell.model && priority(cell) > options.unloadRadius)
+        {
+            changed |= cell.resident;
+            evict(cell);
+        }
+    }
+
+    std::vector<std::pair<float, SceneCell*>> candidates;
+    for (SceneCell& cell : cells)
+    {
+        if (cell.model || cell.failed)
+            continue;
+
+        float cellPriority = priority(cell);
+        if (cellPriority <= options.loadRadius)
+            candidates.emplace_back(cellPriority, &cell);
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    uint32_t loadingCount = getLoadingCellCount();
+    for (auto& [cellPriority, cell] : candidates)
+    {
+        if (loadingCount >= options.maxConcurrentLoads)
+            break;
+
+        // Make room by evicting cells that matter less than this one
+        while (getCommittedMemorySize() + cell->memorySize > options.memoryBudget)
+        {
+            SceneCell* victim = nullptr;
+            float victimPriority = cellPriority;
+            for (SceneCell& other : cells)
+            {
+                if (other.model && priority(other) > victimPriority)
+                {
+                    victim = &other;
+                    victimPriority = priority(other);
+                }
+            }
+
+            if (!victim)
+                break;
+
+            changed |= victim->resident;
+            evict(*victim);
+        }
+
+        // Everything left is closer, so nothing further down the list fits either
+        if (getCommittedMemorySize() + cell->memorySize > options.memoryBudget)
+            break;
+
+        startLoad(*cell);
+        loadingCount++;
+    }
+
+    if (changed)
+    {
+        renderObjects.clear();
+        for (SceneCell& cell : cells)
+        {
+            if (cell.resident)
+                renderObjects.push_back(cell.renderObject);
+        }
+    }
+
+    return changed;
+}
+
+const std::vector<std::shared_ptr<RenderObject>>& SceneStreamer::getRenderObjects() const
+{
+    return renderObjects;
+}
+
+VkDeviceSize SceneStreamer::getResidentMemorySize() const
+{
+    VkDeviceSize size = 0;
+    for (const SceneCell& cell : cells)
+    {
+        if (cell.resident)
+            size += cell.memorySize;
+    }
+    return size;
+}
+
+uint32_t SceneStreamer::getResidentCellCount() const
+{
+    return static_cast<uint32_t>(renderObjects.size());
+}
+
+uint32_t SceneStreamer::getLoadingCellCount() const
+{
+    uint32_t count = 0;
+    for (const SceneCell& cell : cells)
+    {
+        if (cell.model && !cell.resident)
+            count++;
+    }
+    return count;
+}
+
+void SceneStreamer::startLoad(SceneCell& cell)
+{
+    cell.model = std::make_shared<Model>(cell.path, helper, options.modelOptions);
+}
+
+void SceneStreamer::evict(SceneCell& cell)
+{
+    // The command buffers of the frames in flight may still reference the cell's buffers and descriptor sets
+    RetiredCell retired;
+    retired.model = std::move(cell.model);
+    retired.renderObject = std::move(cell.renderObject);
+    retired.framesLeft = static_cast<uint32_t>(helper->MAX_FRAMES_IN_FLIGHT) + 1;
+    retiredCells.push_back(std::move(retired));
+
+    cell.model.reset();
+    cell.renderObject.reset();
+    cell.resident = false;
+}
+
+VkDeviceSize SceneStreamer::getCommittedMemorySize() const
+{
+    VkDeviceSize size = 0;
+    for (const SceneCell& cell : cells)
+    {
+        if (cell.model)
+            size += cell.memorySize;
+    }
+    return size;
+}
+
+float SceneStreamer::distanceToCell(const SceneCell& cell, glm::vec3 point)
+{
+    glm::vec3 closest = glm::clamp(point, cell.boundsMin, cell.boundsMax);
+    return glm::length(point - closest);
+}
+
+bool SceneStreamer::intersects(const SceneCell& cell, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+    return glm::all(glm::lessThanEqual(cell.boundsMin, boundsMax)) && glm::all(glm::greaterThanEqual(cell.boundsMax, boundsMin));
+}
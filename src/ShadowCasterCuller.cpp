@@ -0,0 +1,120 @@
+#include "ShadowCasterCuller.h"
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <limits>
+
+void ShadowCasterCuller::cull(const DrawList& drawList, const SceneBvh& bvh, const glm::mat4& lightSpaceMatrix, const glm::mat4& cameraViewProjection)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    uint32_t entryCount = static_cast<uint32_t>(drawList.getEntries().size());
+    visible.assign(entryCount, 1);
+    casterCount = entryCount;
+    receiverCount = 0;
+
+    if (enabled)
+    {
+        std::array<glm::vec4, 6> lightPlanes = FrustumCuller::extractPlanes(lightSpaceMatrix);
+
+        std::fill(visible.begin(), visible.end(), 0);
+        casterCount = 0;
+
+        // Receivers have to be lit by the shadow map, so they are inside the light volume as well
+        receivers.clear();
+        if (receiverCulling)
+        {
+            std::vector<uint32_t> cameraVisible;
+            bvh.queryFrustum(FrustumCuller::extractPlanes(cameraViewProjection), cameraVisible);
+            std::vector<uint32_t> lightVisible;
+            bvh.queryFrustum(lightPlanes, lightVisible);
+
+            std::sort(cameraVisible.begin(), cameraVisible.end());
+            std::sort(lightVisible.begin(), lightVisible.end());
+            std::set_intersection(cameraVisible.begin(), cameraVisible.end(), lightVisible.begin(), lightVisible.end(), std::back_inserter(receivers));
+            receiverCount = static_cast<uint32_t>(receivers.size());
+
+            if (receivers.empty())
+            {
+                cullTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+                return;
+            }
+        }
+
+        glm::vec3 receiversMin = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 receiversMax = glm::vec3(std::numeric_limits<float>::lowest());
+        for (uint32_t entry : receivers)
+        {
+            glm::vec3 boundsMin, boundsMax;
+            getLightSpaceBounds(bvh, entry, lightSpaceMatrix, boundsMin, boundsMax);
+            receiversMin = glm::min(receiversMin, boundsMin);
+            receiversMax = glm::max(receiversMax, boundsMax);
+        }
+
+        // The light's near plane, depth is in the 0..1 range
+        if (extendTowardLight)
+            lightPlanes[4] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+        casters.clear();
+        bvh.queryFrustum(lightPlanes, casters);
+
+        for (uint32_t entry : casters)
+        {
+            if (receiverCulling)
+            {
+                glm::vec3 boundsMin, boundsMax;
+                getLightSpaceBounds(bvh, entry, lightSpaceMatrix, boundsMin, boundsMax);
+
+                // Shadows fall straight along the light's depth, away from it
+                bool overlaps = boundsMin.x <= receiversMax.x && boundsMax.x >= receiversMin.x &&
+                    boundsMin.y <= receiversMax.y && boundsMax.y >= receiversMin.y && boundsMin.z <= receiversMax.z;
+                if (!overlaps)
+                    continue;
+            }
+
+            visible[entry] = 1;
+            casterCount++;
+        }
+    }
+
+    cullTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void ShadowCasterCuller::getLightSpaceBounds(const SceneBvh& bvh, uint32_t entry, const glm::mat4& lightSpaceMatrix, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+    glm::vec3 worldMin = bvh.getEntryBoundsMin(entry);
+    glm::vec3 worldMax = bvh.getEntryBoundsMax(entry);
+
+    // The projection is orthographic, so transformed corners need no divide
+    boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec3 corner = glm::vec3((i & 1) ? worldMax.x : worldMin.x, (i & 2) ? worldMax.y : worldMin.y, (i & 4) ? worldMax.z : worldMin.z);
+        glm::vec3 light = glm::vec3(lightSpaceMatrix * glm::vec4(corner, 1.0f));
+        boundsMin = glm::min(boundsMin, light);
+        boundsMax = glm::max(boundsMax, light);
+    }
+}
+
+bool ShadowCasterCuller::isVisible(uint32_t entry) const
+{
+    return visible[entry] != 0;
+}
+
+uint32_t ShadowCasterCuller::getCasterCount() const
+{
+    return casterCount;
+}
+
+uint32_t ShadowCasterCuller::getReceiverCount() const
+{
+    return receiverCount;
+}
+
+float ShadowCasterCuller::getCullTime() const
+{
+    return cullTime;
+}
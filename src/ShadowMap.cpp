@@ -1,4 +1,6 @@
 #include "ShadowMap.h"
+#include "MeshletCuller.h"
+#include "DrawBatch.h"
 
 #include <stdexcept>
 
@@ -138,6 +140,11 @@ ShadowMap::~ShadowMap()
     vkDestroyShaderModule(helper->device, fragShaderModule, nullptr);
     vkDestroyPipeline(helper->device, graphicsPipeline, nullptr);
     vkDestroyPipelineLayout(helper->device, pipelineLayout, nullptr);
+    if (meshletPipeline != VK_NULL_HANDLE)
+    {
+        vkDestroyPipeline(helper->device, meshletPipeline, nullptr);
+        vkDestroyPipelineLayout(helper->device, meshletPipelineLayout, nullptr);
+    }
     vkDestroyDescriptorSetLayout(helper->device, descriptorSetLayout, nullptr);
     vkDestroyDescriptorSetLayout(helper->device, shadowMapDescriptorSetLayout, nullptr);
 }
@@ -150,6 +157,8 @@ void ShadowMap::createDescriptorSets()
 	layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 	layoutBinding.descriptorCount = 1;
 	layoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	if (helper->meshShaderSupported)
+		layoutBinding.stageFlags |= VK_SHADER_STAGE_MESH_BIT_EXT;
 	layoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
@@ -193,7 +202,7 @@ void ShadowMap::createDescriptorSets()
     samplerLayoutBinding.descriptorCount = 1;
     samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     samplerLayoutBinding.pImmutableSamplers = nullptr;
-    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
     VkDescriptorSetLayoutCreateInfo samplerLayoutInfo = {};
     samplerLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -357,20 +366,16 @@ void ShadowMap::createPipeline()
     colorBlending.blendConstants[2] = 0.0f; // Optional
     colorBlending.blendConstants[3] = 0.0f; // Optional
 
-    // Push Constants
-    VkPushConstantRange pushConstantRange{};
-    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    pushConstantRange.offset = 0;
-    pushConstantRange.size = sizeof(glm::mat4);
+    // Pipeline layout, the model matrices come from the DrawBatch
+    DrawBatch::createDescriptorSetLayout(*helper);
 
-    // Pipeline layout
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-    std::vector<VkDescriptorSetLayout> layouts = { descriptorSetLayout };
+    std::vector<VkDescriptorSetLayout> layouts = { descriptorSetLayout, DrawBatch::descriptorSetLayout };
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = layouts.size();
     pipelineLayoutInfo.pSetLayouts = layouts.data();
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
-    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+    pipelineLayoutInfo.pushConstantRangeCount = 0;
+    pipelineLayoutInfo.pPushConstantRanges = nullptr;
 
     if (vkCreatePipelineLayout(helper->device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
         throw std::runtime_error("failed to create pipeline layout!");
@@ -397,6 +402,61 @@ void ShadowMap::createPipeline()
     if (vkCreateGraphicsPipelines(helper->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline!");
     }
+
+    if (!helper->meshShaderSupported)
+        return;
+
+    // Meshlet pipeline, same state with the vertex stage replaced by task and mesh shaders
+    MeshletCuller::createDescriptorSetLayouts(*helper);
+
+    auto taskShaderCode = helper->readFile("shaders/meshletShadow.task.spv");
+    auto meshShaderCode = helper->readFile("shaders/meshletShadow.mesh.spv");
+    VkShaderModule taskShaderModule = helper->createShaderModule(taskShaderCode);
+    VkShaderModule meshShaderModule = helper->createShaderModule(meshShaderCode);
+
+    VkPipelineShaderStageCreateInfo taskShaderStageInfo{};
+    taskShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    taskShaderStageInfo.stage = VK_SHADER_STAGE_TASK_BIT_EXT;
+    taskShaderStageInfo.module = taskShaderModule;
+    taskShaderStageInfo.pName = "main";
+
+    VkPipelineShaderStageCreateInfo meshShaderStageInfo{};
+    meshShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    meshShaderStageInfo.stage = VK_SHADER_STAGE_MESH_BIT_EXT;
+    meshShaderStageInfo.module = meshShaderModule;
+    meshShaderStageInfo.pName = "main";
+    VkPipelineShaderStageCreateInfo meshletShaderStages[] = { taskShaderStageInfo, meshShaderStageInfo, fragShaderStageInfo };
+
+    VkPushConstantRange meshletPushConstantRange{};
+    meshletPushConstantRange.stageFlags = MeshletCuller::MESHLET_PUSH_CONSTANT_STAGES;
+    meshletPushConstantRange.offset = 0;
+    meshletPushConstantRange.size = MeshletCuller::MESHLET_PUSH_CONSTANT_OFFSET + sizeof(MeshletDrawPushConstants);
+
+    std::vector<VkDescriptorSetLayout> meshletLayouts = { descriptorSetLayout, MeshletCuller::meshletDescriptorSetLayout, MeshletCuller::cullingDescriptorSetLayout };
+
+    VkPipelineLayoutCreateInfo meshletPipelineLayoutInfo{};
+    meshletPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    meshletPipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(meshletLayouts.size());
+    meshletPipelineLayoutInfo.pSetLayouts = meshletLayouts.data();
+    meshletPipelineLayoutInfo.pushConstantRangeCount = 1;
+    meshletPipelineLayoutInfo.pPushConstantRanges = &meshletPushConstantRange;
+
+    if (vkCreatePipelineLayout(helper->device, &meshletPipelineLayoutInfo, nullptr, &meshletPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline layout!");
+    }
+
+    pipelineInfo.stageCount = 3;
+    pipelineInfo.pStages = meshletShaderStages;
+    pipelineInfo.pVertexInputState = nullptr;
+    pipelineInfo.pInputAssemblyState = nullptr;
+    pipelineInfo.layout = meshletPipelineLayout;
+
+    if (vkCreateGraphicsPipelines(helper->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &meshletPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create graphics pipeline!");
+    }
+
+    vkDestroyShaderModule(helper->device, taskShaderModule, nullptr);
+    vkDestroyShaderModule(helper->device, meshShaderModule, nullptr);
 }
 
 glm::mat4 ShadowMap::getLightSpaceMatrix()
@@ -406,7 +466,7 @@ glm::mat4 ShadowMap::getLightSpaceMatrix()
     return proj * view;
 }
 
-void ShadowMap::beginRender(VkCommandBuffer commandBuffer)
+void ShadowMap::beginRender(VkCommandBuffer commandBuffer, VkSubpassContents contents)
 {
     // Update uniform buffer
     ViewProjectionMatrices ubo{};
@@ -427,8 +487,14 @@ void ShadowMap::beginRender(VkCommandBuffer commandBuffer)
     renderPassInfo.clearValueCount = 1;
     renderPassInfo.pClearValues = &clearValue;
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, contents);
 
+    if (contents == VK_SUBPASS_CONTENTS_INLINE)
+        bindRenderState(commandBuffer);
+}
+
+void ShadowMap::bindRenderState(VkCommandBuffer commandBuffer)
+{
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 
     VkViewport viewport{};
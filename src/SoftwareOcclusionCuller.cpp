@@ -0,0 +1,363 @@
+#include "SoftwareOcclusionCuller.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SOFTWARE_OCCLUSION_CULLER_SSE
+#endif
+
+void SoftwareOcclusionCuller::cull(const DrawList& drawList, const FrustumCuller& frustumCuller, const glm::mat4& viewProjection, ThreadPool& threadPool)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    const std::vector<DrawListEntry>& entries = drawList.getEntries();
+    uint32_t entryCount = static_cast<uint32_t>(entries.size());
+
+    visible.resize(entryCount);
+    for (uint32_t i = 0; i < entryCount; i++)
+    {
+        visible[i] = frustumCuller.isVisible(i);
+    }
+
+    occluderCount = 0;
+    rasterizedTriangleCount = 0;
+    occludedCount = 0;
+
+    if (enabled && entryCount > 0)
+    {
+        std::vector<uint32_t> occluders;
+        selectOccluders(drawList, frustumCuller, viewProjection, occluders);
+        occluderCount = static_cast<uint32_t>(occluders.size());
+
+        occluderTriangles.resize(occluders.size());
+        threadPool.parallelFor(occluders.size(), [&](size_t i)
+        {
+            occluderTriangles[i].clear();
+            transformOccluder(entries[occluders[i]], viewProjection, occluderTriangles[i]);
+        });
+
+        for (size_t i = 0; i < occluders.size(); i++)
+        {
+            rasterizedTriangleCount += static_cast<uint32_t>(occluderTriangles[i].size());
+        }
+
+        // Bands cover whole tile rows, so each one also finishes the farthest depth of its tiles
+        const uint32_t bandHeight = TILE_SIZE * 2;
+        threadPool.parallelFor((HEIGHT + bandHeight - 1) / bandHeight, [&](size_t band)
+        {
+            uint32_t firstRow = static_cast<uint32_t>(band) * bandHeight;
+            rasterizeBand(firstRow, std::min(bandHeight, HEIGHT - firstRow));
+        });
+
+        const uint32_t chunkSize = 256;
+        threadPool.parallelFor((entryCount + chunkSize - 1) / chunkSize, [&](size_t chunk)
+        {
+            uint32_t first = static_cast<uint32_t>(chunk) * chunkSize;
+            for (uint32_t i = first; i < first + chunkSize && i < entryCount; i++)
+            {
+                if (!visible[i])
+                    continue;
+
+                const Mesh& mesh = *entries[i].mesh;
+                const glm::mat4& model = entries[i].renderObject->getModelMatrix();
+
+                glm::vec3 center = glm::vec3(model * glm::vec4((mesh.boundsMin + mesh.boundsMax) * 0.5f, 1.0f));
+                glm::vec3 localExtent = (mesh.boundsMax - mesh.boundsMin) * 0.5f;
+                glm::vec3 extent = glm::abs(glm::vec3(model[0])) * localExtent.x + glm::abs(glm::vec3(model[1])) * localExtent.y + glm::abs(glm::vec3(model[2])) * localExtent.z;
+
+                if (isBoxOccluded(center, extent, viewProjection))
+                    visible[i] = 0;
+            }
+        });
+
+        for (uint32_t i = 0; i < entryCount; i++)
+        {
+            occludedCount += frustumCuller.isVisible(i) && !visible[i];
+        }
+    }
+
+    cullTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void SoftwareOcclusionCuller::selectOccluders(const DrawList& drawList, const FrustumCuller& frustumCuller, const glm::mat4& viewProjection, std::vector<uint32_t>& occluders) const
+{
+    const std::vector<DrawListEntry>& entries = drawList.getEntries();
+
+    // Bounding sphere radius over distance, roughly the share of the screen the mesh covers
+    std::vector<std::pair<float, uint32_t>> candidates;
+    for (uint32_t i = 0; i < entries.size(); i++)
+    {
+        const Mesh& mesh = *entries[i].mesh;
+        if (!frustumCuller.isVisible(i) || mesh.lods.empty() || mesh.lods[0].indexCount == 0)
+            continue;
+
+        const glm::mat4& model = entries[i].renderObject->getModelMatrix();
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        float radius = mesh.boundingSphereRadius * scale;
+        float w = (viewProjection * model * glm::vec4(mesh.boundingSphereCenter, 1.0f)).w;
+
+        float size = radius / std::max(w, 1e-3f);
+        if (size > 0.05f)
+            candidates.push_back({ size, i });
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b)
+    {
+        return a.first > b.first;
+    });
+
+    uint32_t triangleCount = 0;
+    for (const auto& candidate : candidates)
+    {
+        if (occluders.size() >= maxOccluderCount)
+            break;
+
+        uint32_t occluderTriangleCount = entries[candidate.second].mesh->lods[0].indexCount / 3;
+        if (triangleCount + occluderTriangleCount > maxOccluderTriangleCount)
+            continue;
+
+        triangleCount += occluderTriangleCount;
+        occluders.push_back(candidate.second);
+    }
+}
+
+void SoftwareOcclusionCuller::transformOccluder(const DrawListEntry& entry, const glm::mat4& viewProjection, std::vector<ScreenTriangle>& triangles) const
+{
+    const Mesh& mesh = *entry.mesh;
+    // Simplified levels move vertices and can cover more than the mesh does, only full detail is conservative
+    const MeshLod& lod = mesh.lods[0];
+    glm::mat4 modelViewProjection = viewProjection * entry.renderObject->getModelMatrix();
+
+    for (uint32_t i = lod.firstIndex; i + 2 < lod.firstIndex + lod.indexCount; i += 3)
+    {
+        std::array<glm::vec3, 3> screen;
+        bool clipped = false;
+        for (int v = 0; v < 3; v++)
+        {
+            glm::vec4 clip = modelViewProjection * glm::vec4(mesh.vertices[mesh.indices[i + v]].pos, 1.0f);
+
+            // Dropping triangles that cross the near plane only ever hides less
+            if (clip.w < 1e-4f || clip.z < 0.0f)
+            {
+                clipped = true;
+                break;
+            }
+
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            screen[v] = glm::vec3((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT, ndc.z);
+        }
+
+        if (clipped)
+            continue;
+
+        float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+        if (std::abs(area) < 1e-6f)
+            continue;
+
+        // Both windings are kept, ordered so the inside of every edge is positive
+        if (area < 0.0f)
+            std::swap(screen[1], screen[2]);
+
+        float minY = std::min(screen[0].y, std::min(screen[1].y, screen[2].y));
+        float maxY = std::max(screen[0].y, std::max(screen[1].y, screen[2].y));
+        float minX = std::min(screen[0].x, std::min(screen[1].x, screen[2].x));
+        float maxX = std::max(screen[0].x, std::max(screen[1].x, screen[2].x));
+
+        ScreenTriangle triangle;
+        triangle.minY = std::max(static_cast<int32_t>(std::ceil(minY - 0.5f)), 0);
+        triangle.maxY = std::min(static_cast<int32_t>(std::floor(maxY - 0.5f)), static_cast<int32_t>(HEIGHT) - 1);
+        if (triangle.minY > triangle.maxY || maxX < 0.5f || minX > WIDTH - 0.5f)
+            continue;
+
+        triangle.x0 = screen[0].x;
+        triangle.y0 = screen[0].y;
+        triangle.x1 = screen[1].x;
+        triangle.y1 = screen[1].y;
+        triangle.x2 = screen[2].x;
+        triangle.y2 = screen[2].y;
+        triangle.depth = std::min(std::max(screen[0].z, std::max(screen[1].z, screen[2].z)), 1.0f);
+        triangles.push_back(triangle);
+    }
+}
+
+void SoftwareOcclusionCuller::rasterizeBand(uint32_t firstRow, uint32_t rowCount)
+{
+    std::fill(depthBuffer.begin() + firstRow * WIDTH, depthBuffer.begin() + (firstRow + rowCount) * WIDTH, 1.0f);
+
+    int32_t lastRow = static_cast<int32_t>(firstRow + rowCount) - 1;
+
+    for (const std::vector<ScreenTriangle>& triangles : occluderTriangles)
+    {
+        for (const ScreenTriangle& triangle : triangles)
+        {
+            int32_t startY = std::max(triangle.minY, static_cast<int32_t>(firstRow));
+            int32_t endY = std::min(triangle.maxY, lastRow);
+            if (startY > endY)
+                continue;
+
+            float minX = std::min(triangle.x0, std::min(triangle.x1, triangle.x2));
+            float maxX = std::max(triangle.x0, std::max(triangle.x1, triangle.x2));
+            // Rows are walked in groups of four pixels
+            int32_t startX = std::max(static_cast<int32_t>(std::ceil(minX - 0.5f)), 0) & ~3;
+            int32_t endX = std::min(static_cast<int32_t>(std::floor(maxX - 0.5f)), static_cast<int32_t>(WIDTH) - 1);
+
+            // Edge functions a * x + b * y + c, positive inside
+            std::array<float, 3> a = { triangle.y0 - triangle.y1, triangle.y1 - triangle.y2, triangle.y2 - triangle.y0 };
+            std::array<float, 3> b = { triangle.x1 - triangle.x0, triangle.x2 - triangle.x1, triangle.x0 - triangle.x2 };
+            std::array<float, 3> c = { -(a[0] * triangle.x0 + b[0] * triangle.y0), -(a[1] * triangle.x1 + b[1] * triangle.y1), -(a[2] * triangle.x2 + b[2] * triangle.y2) };
+
+            for (int32_t y = startY; y <= endY; y++)
+            {
+                float* row = &depthBuffer[y * WIDTH];
+                float pixelY = y + 0.5f;
+                float pixelX = startX + 0.5f;
+
+#ifdef SOFTWARE_OCCLUSION_CULLER_SSE
+                __m128 offsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+                __m128 edges[3];
+                __m128 steps[3];
+                for (int e = 0; e < 3; e++)
+                {
+                    edges[e] = _mm_add_ps(_mm_set1_ps(a[e] * pixelX + b[e] * pixelY + c[e]), _mm_mul_ps(_mm_set1_ps(a[e]), offsets));
+                    steps[e] = _mm_set1_ps(a[e] * 4.0f);
+                }
+                __m128 depth = _mm_set1_ps(triangle.depth);
+                __m128 zero = _mm_setzero_ps();
+
+                for (int32_t x = startX; x <= endX; x += 4)
+                {
+                    __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edges[0], zero), _mm_cmpge_ps(edges[1], zero)), _mm_cmpge_ps(edges[2], zero));
+                    if (_mm_movemask_ps(inside))
+                    {
+                        __m128 stored = _mm_loadu_ps(row + x);
+                        __m128 covered = _mm_or_ps(_mm_and_ps(inside, depth), _mm_andnot_ps(inside, stored));
+                        _mm_storeu_ps(row + x, _mm_min_ps(stored, covered));
+                    }
+
+                    for (int e = 0; e < 3; e++)
+                    {
+                        edges[e] = _mm_add_ps(edges[e], steps[e]);
+                    }
+                }
+#else
+                for (int32_t x = startX; x <= endX && x < static_cast<int32_t>(WIDTH); x++)
+                {
+                    float px = x + 0.5f;
+                    bool inside = true;
+                    for (int e = 0; e < 3; e++)
+                    {
+                        inside = inside && a[e] * px + b[e] * pixelY + c[e] >= 0.0f;
+                    }
+
+                    if (inside)
+                        row[x] = std::min(row[x], triangle.depth);
+                }
+#endif
+            }
+        }
+    }
+
+    for (uint32_t tileY = firstRow / TILE_SIZE; tileY < (firstRow + rowCount) / TILE_SIZE; tileY++)
+    {
+        for (uint32_t tileX = 0; tileX < TILES_X; tileX++)
+        {
+            float farthest = 0.0f;
+            for (uint32_t y = tileY * TILE_SIZE; y < (tileY + 1) * TILE_SIZE; y++)
+            {
+                for (uint32_t x = tileX * TILE_SIZE; x < (tileX + 1) * TILE_SIZE; x++)
+                {
+                    farthest = std::max(farthest, depthBuffer[y * WIDTH + x]);
+                }
+            }
+            tileDepth[tileY * TILES_X + tileX] = farthest;
+        }
+    }
+}
+
+bool SoftwareOcclusionCuller::isBoxOccluded(const glm::vec3& center, const glm::vec3& extent, const glm::mat4& viewProjection) const
+{
+    glm::vec2 minScreen = glm::vec2(std::numeric_limits<float>::max());
+    glm::vec2 maxScreen = glm::vec2(std::numeric_limits<float>::lowest());
+    float nearestDepth = 1.0f;
+
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec3 corner = center + extent * glm::vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f);
+        glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+
+        // Crossing the near plane, the projected box is meaningless
+        if (clip.w < 1e-4f || clip.z < 0.0f)
+            return false;
+
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        glm::vec2 screen = glm::vec2((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT);
+        minScreen = glm::min(minScreen, screen);
+        maxScreen = glm::max(maxScreen, screen);
+        nearestDepth = std::min(nearestDepth, ndc.z);
+    }
+
+    if (maxScreen.x < 0.0f || maxScreen.y < 0.0f || minScreen.x >= WIDTH || minScreen.y >= HEIGHT)
+        return false;
+
+    // Every pixel the box touches
+    int32_t minX = std::max(static_cast<int32_t>(std::floor(minScreen.x)), 0);
+    int32_t minY = std::max(static_cast<int32_t>(std::floor(minScreen.y)), 0);
+    int32_t maxX = std::min(static_cast<int32_t>(std::floor(maxScreen.x)), static_cast<int32_t>(WIDTH) - 1);
+    int32_t maxY = std::min(static_cast<int32_t>(std::floor(maxScreen.y)), static_cast<int32_t>(HEIGHT) - 1);
+
+    for (int32_t tileY = minY / TILE_SIZE; tileY <= maxY / static_cast<int32_t>(TILE_SIZE); tileY++)
+    {
+        for (int32_t tileX = minX / TILE_SIZE; tileX <= maxX / static_cast<int32_t>(TILE_SIZE); tileX++)
+        {
+            if (nearestDepth > tileDepth[tileY * TILES_X + tileX])
+                continue;
+
+            // Part of the tile lies behind the box, look at the pixels the box covers
+            int32_t startX = std::max(minX, tileX * static_cast<int32_t>(TILE_SIZE));
+            int32_t endX = std::min(maxX, (tileX + 1) * static_cast<int32_t>(TILE_SIZE) - 1);
+            int32_t startY = std::max(minY, tileY * static_cast<int32_t>(TILE_SIZE));
+            int32_t endY = std::min(maxY, (tileY + 1) * static_cast<int32_t>(TILE_SIZE) - 1);
+
+            for (int32_t y = startY; y <= endY; y++)
+            {
+                for (int32_t x = startX; x <= endX; x++)
+                {
+                    if (nearestDepth <= depthBuffer[y * WIDTH + x])
+                        return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool SoftwareOcclusionCuller::isVisible(uint32_t entry) const
+{
+    return visible[entry] != 0;
+}
+
+uint32_t SoftwareOcclusionCuller::getOccluderCount() const
+{
+    return occluderCount;
+}
+
+uint32_t SoftwareOcclusionCuller::getRasterizedTriangleCount() const
+{
+    return rasterizedTriangleCount;
+}
+
+uint32_t SoftwareOcclusionCuller::getOccludedCount() const
+{
+    return occludedCount;
+}
+
+float SoftwareOcclusionCuller::getCullTime() const
+{
+    return cullTime;
+}
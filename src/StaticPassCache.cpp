@@ -0,0 +1,103 @@
+#include "StaticPassCache.h"
+
+#include <stdexcept>
+
+StaticPassCache::StaticPassCache(std::shared_ptr<Helper> helper) : helper(helper)
+{
+    const char* passNames[STATIC_PASS_COUNT] = { "Shadow", "Voxelization" };
+
+    for (uint32_t pass = 0; pass < STATIC_PASS_COUNT; pass++)
+    {
+        std::vector<VkCommandBuffer> commandBuffers(helper->MAX_FRAMES_IN_FLIGHT);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = helper->commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+        if (vkAllocateCommandBuffers(helper->device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate secondary command buffers!");
+        }
+
+        recordings[pass].resize(commandBuffers.size());
+        for (size_t i = 0; i < commandBuffers.size(); i++)
+        {
+            recordings[pass][i].commandBuffer = commandBuffers[i];
+            helper->setNameOfObject(VK_OBJECT_TYPE_COMMAND_BUFFER, (uint64_t)commandBuffers[i], std::string("StaticPassCache::") + passNames[pass] + " " + std::to_string(i));
+        }
+    }
+}
+
+StaticPassCache::~StaticPassCache()
+{
+    for (auto& passRecordings : recordings)
+    {
+        for (Recording& recording : passRecordings)
+        {
+            vkFreeCommandBuffers(helper->device, helper->commandPool, 1, &recording.commandBuffer);
+        }
+    }
+}
+
+void StaticPassCache::execute(VkCommandBuffer commandBuffer, StaticPass pass, uint32_t currentFrame, uint64_t version, VkRenderPass renderPass,
+    VkFramebuffer framebuffer, const std::function<void(VkCommandBuffer)>& record)
+{
+    Recording& recording = recordings[pass][currentFrame];
+
+    if (recording.valid && recording.version == version)
+    {
+        reuseCount++;
+    }
+    else
+    {
+        // The pool resets buffers individually, beginning one resets it
+        VkCommandBufferInheritanceInfo inheritanceInfo{};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = renderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = framebuffer;
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        if (vkBeginCommandBuffer(recording.commandBuffer, &beginInfo) != VK_SUCCESS) {
+            throw std::runtime_error("failed to begin recording secondary command buffer!");
+        }
+
+        record(recording.commandBuffer);
+
+        if (vkEndCommandBuffer(recording.commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to record secondary command buffer!");
+        }
+
+        recording.valid = true;
+        recording.version = version;
+        recordCount++;
+    }
+
+    vkCmdExecuteCommands(commandBuffer, 1, &recording.commandBuffer);
+}
+
+void StaticPassCache::invalidate()
+{
+    for (auto& passRecordings : recordings)
+    {
+        for (Recording& recording : passRecordings)
+        {
+            recording.valid = false;
+        }
+    }
+}
+
+uint64_t StaticPassCache::getRecordCount() const
+{
+    return recordCount;
+}
+
+uint64_t StaticPassCache::getReuseCount() const
+{
+    return reuseCount;
+}
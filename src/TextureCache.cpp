@@ -0,0 +1,360 @@
+#include "TextureCache.h"
+#include "Helper.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+
+Texture::Texture(Helper& helper, const std::string& path, const TextureData& data, const TextureLoadParams& params) :
+    device(helper.device), path(path), params(params)
+{
+    fullWidth = data.fullWidth > 0 ? data.fullWidth : data.width;
+    fullHeight = data.fullHeight > 0 ? data.fullHeight : data.height;
+    fullMipLevels = TextureCache::getMipLevelCount(fullWidth, fullHeight);
+    streamingBaseMip = data.baseMip;
+
+    replace(helper, data);
+
+    residency = helper.residency;
+    residencyHandle = residency->add("Texture::" + path, params.streamed ? RESIDENCY_PRIORITY_STREAMED : RESIDENCY_PRIORITY_PINNED, memorySize,
+        [this, owner = &helper]() -> VkDeviceSize
+        {
+            // Textures that are not streamed are pinned, they keep no pixels to get their detail back from
+            if (!this->params.streamed || baseMip >= streamingBaseMip)
+                return 0;
+
+            // The residency manager waited for the device, so the old image can go right away
+            VkDeviceSize previousMemorySize = memorySize;
+            TextureImage old = shrink(*owner, streamingBaseMip);
+            vkDestroyImageView(device, old.view, nullptr);
+            vkFreeMemory(device, old.memory, nullptr);
+            vkDestroyImage(device, old.image, nullptr);
+
+            return previousMemorySize - memorySize;
+        },
+        [this, owner = &helper]() -> VkDeviceSize
+        {
+            // Copying every level into a new image moves the texture without touching the file
+            TextureImage old = shrink(*owner, baseMip);
+            residency->retire([device = device, old]()
+            {
+                vkDestroyImageView(device, old.view, nullptr);
+                vkFreeMemory(device, old.memory, nullptr);
+                vkDestroyImage(device, old.image, nullptr);
+            });
+
+            return memorySize;
+        });
+}
+
+Texture::~Texture()
+{
+    if (residency)
+        residency->remove(residencyHandle);
+
+    vkDestroyImageView(device, view, nullptr);
+    vkFreeMemory(device, memory, nullptr);
+    vkDestroyImage(device, image, nullptr);
+}
+
+TextureImage Texture::replace(Helper& helper, const TextureData& data)
+{
+    TextureImage old = { image, memory, view };
+
+    TextureImage next;
+    uint32_t newMipLevels = 1;
+    helper.createTextureImage(data, next.image, next.memory, next.view, params.generateMipmaps ? &newMipLevels : nullptr);
+
+    image = next.image;
+    memory = next.memory;
+    view = next.view;
+    helper.setNameOfObject(VK_OBJECT_TYPE_IMAGE, (uint64_t)image, "Texture::" + path);
+
+    width = data.width;
+    height = data.height;
+    baseMip = data.baseMip;
+    mipLevels = newMipLevels;
+    memorySize = params.generateMipmaps ? TextureCache::getMipChainSize(width, height) : static_cast<VkDeviceSize>(width) * height * 4;
+
+    if (residency)
+        residency->setSize(residencyHandle, memorySize);
+
+    return old;
+}
+
+TextureImage Texture::shrink(Helper& helper, uint32_t newBaseMip)
+{
+    TextureImage old = { image, memory, view };
+
+    uint32_t droppedLevels = newBaseMip - baseMip;
+    int newWidth = std::max(1, width >> droppedLevels);
+    int newHeight = std::max(1, height >> droppedLevels);
+    uint32_t newMipLevels = mipLevels - droppedLevels;
+
+    TextureImage next;
+    helper.createImage(newWidth, newHeight, 1, newMipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, next.image, next.memory);
+    image = next.image;
+    memory = next.memory;
+    helper.setNameOfObject(VK_OBJECT_TYPE_IMAGE, (uint64_t)image, "Texture::" + path);
+
+    VkCommandBuffer commandBuffer = helper.beginSingleTimeCommands();
+
+    std::array<VkImageMemoryBarrier, 2> barriers{};
+    for (auto& barrier : barriers)
+    {
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+    }
+
+    barriers[0].image = old.image;
+    barriers[0].subresourceRange.baseMipLevel = droppedLevels;
+    barriers[0].subresourceRange.levelCount = newMipLevels;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    barriers[1].image = image;
+    barriers[1].subresourceRange.baseMipLevel = 0;
+    barriers[1].subresourceRange.levelCount = newMipLevels;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].srcAccessMask = 0;
+    barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    std::vector<VkImageCopy> regions(newMipLevels);
+    for (uint32_t i = 0; i < newMipLevels; i++)
+    {
+        regions[i].srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, droppedLevels + i, 0, 1 };
+        regions[i].srcOffset = { 0, 0, 0 };
+        regions[i].dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+        regions[i].dstOffset = { 0, 0, 0 };
+        regions[i].extent = { static_cast<uint32_t>(std::max(1, newWidth >> i)), static_cast<uint32_t>(std::max(1, newHeight >> i)), 1 };
+    }
+
+    vkCmdCopyImage(commandBuffer, old.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+    // The old image goes back to sampling for the frames that still use it
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    helper.endSingleTimeCommands(commandBuffer);
+
+    view = helper.createImageView(image, 0, newMipLevels, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+
+    width = newWidth;
+    height = newHeight;
+    baseMip = newBaseMip;
+    mipLevels = newMipLevels;
+    memorySize = params.generateMipmaps ? TextureCache::getMipChainSize(width, height) : static_cast<VkDeviceSize>(width) * height * 4;
+
+    if (residency)
+        residency->setSize(residencyHandle, memorySize);
+
+    return old;
+}
+
+TextureCache::TextureCache(Helper& helper) : helper(helper)
+{}
+
+TextureCache::~TextureCache()
+{
+    for (auto& [maxLod, sampler] : samplers)
+    {
+        vkDestroySampler(helper.device, sampler, nullptr);
+    }
+}
+
+std::string TextureCache::getKey(const std::string& path, const TextureLoadParams& params)
+{
+    std::error_code error;
+    std::filesystem::path resolved = std::filesystem::weakly_canonical(path, error);
+
+    std::string key = error ? path : resolved.generic_string();
+    key += params.generateMipmaps ? "|mips" : "|nomips";
+    key += params.streamed ? "|streamed" : "";
+    return key;
+}
+
+uint32_t TextureCache::getMipLevelCount(int width, int height)
+{
+    return static_cast<uint32_t>(std::floor(std::log2(std::max(std::max(width, height), 1)))) + 1;
+}
+
+VkDeviceSize TextureCache::getMipChainSize(int width, int height)
+{
+    VkDeviceSize size = 0;
+    for (uint32_t level = 0; level < getMipLevelCount(width, height); level++)
+    {
+        size += static_cast<VkDeviceSize>(std::max(1, width >> level)) * std::max(1, height >> level) * 4;
+    }
+    return size;
+}
+
+void TextureCache::downsample(TextureData& data, uint32_t levels)
+{
+    for (uint32_t level = 0; level < levels && (data.width > 1 || data.height > 1); level++)
+    {
+        int width = std::max(1, data.width / 2);
+        int height = std::max(1, data.height / 2);
+
+        std::shared_ptr<unsigned char> pixels(new unsigned char[static_cast<size_t>(width) * height * 4], std::default_delete<unsigned char[]>());
+        const unsigned char* src = data.pixels.get();
+        unsigned char* dst = pixels.get();
+
+        for (int y = 0; y < height; y++)
+        {
+            int y0 = std::min(y * 2, data.height - 1);
+            int y1 = std::min(y * 2 + 1, data.height - 1);
+
+            for (int x = 0; x < width; x++)
+            {
+                int x0 = std::min(x * 2, data.width - 1);
+                int x1 = std::min(x * 2 + 1, data.width - 1);
+
+                for (int c = 0; c < 4; c++)
+                {
+                    unsigned int sum = src[(static_cast<size_t>(y0) * data.width + x0) * 4 + c] + src[(static_cast<size_t>(y0) * data.width + x1) * 4 + c]
+                        + src[(static_cast<size_t>(y1) * data.width + x0) * 4 + c] + src[(static_cast<size_t>(y1) * data.width + x1) * 4 + c];
+                    dst[(static_cast<size_t>(y) * width + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+
+        data.width = width;
+        data.height = height;
+        data.pixels = pixels;
+        data.baseMip++;
+    }
+}
+
+TextureData TextureCache::loadTextureData(const std::string& path, const TextureLoadParams& params)
+{
+    TextureData data = helper.loadTextureData(path);
+
+    if (params.streamed)
+    {
+        uint32_t levels = 0;
+        while (static_cast<uint32_t>(std::max(data.width >> levels, data.height >> levels)) > streamingBaseDimension)
+            levels++;
+
+        downsample(data, levels);
+    }
+
+    return data;
+}
+
+std::shared_ptr<Texture> TextureCache::find(const std::string& path, const TextureLoadParams& params)
+{
+    std::string key = getKey(path, params);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = textures.find(key);
+    return it != textures.end() ? it->second.lock() : nullptr;
+}
+
+std::shared_ptr<Texture> TextureCache::acquire(const std::string& path, const TextureLoadParams& params, const TextureData& data)
+{
+    std::string key = getKey(path, params);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = textures.find(key);
+        if (it != textures.end())
+        {
+            if (auto texture = it->second.lock())
+                return texture;
+        }
+    }
+
+    // Uploads only happen on the main thread, so nobody else can insert the key in the meantime
+    auto texture = std::make_shared<Texture>(helper, path, data.pixels ? data : loadTextureData(path, params), params);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    textures[key] = texture;
+
+    // Drop the entries of textures that were freed
+    for (auto it = textures.begin(); it != textures.end();)
+    {
+        if (it->second.expired())
+            it = textures.erase(it);
+        else
+            ++it;
+    }
+
+    return texture;
+}
+
+std::shared_ptr<Texture> TextureCache::getPlaceholder()
+{
+    if (auto texture = placeholder.lock())
+        return texture;
+
+    TextureData data;
+    data.width = 1;
+    data.height = 1;
+    data.pixels = std::shared_ptr<unsigned char>(new unsigned char[4] { 128, 128, 128, 255 }, std::default_delete<unsigned char[]>());
+
+    TextureLoadParams params;
+    params.generateMipmaps = false;
+
+    auto texture = std::make_shared<Texture>(helper, "Placeholder", data, params);
+
+    placeholder = texture;
+    return texture;
+}
+
+VkSampler TextureCache::getSampler(uint32_t maxLod)
+{
+    auto it = samplers.find(maxLod);
+    if (it != samplers.end())
+        return it->second;
+
+    VkSampler sampler;
+    helper.createSampler(sampler, maxLod);
+    samplers[maxLod] = sampler;
+    return sampler;
+}
+
+uint32_t TextureCache::getTextureCount()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint32_t count = 0;
+    for (auto& [key, texture] : textures)
+    {
+        if (!texture.expired())
+            count++;
+    }
+    return count;
+}
+
+std::vector<std::shared_ptr<Texture>> TextureCache::getStreamedTextures()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::vector<std::shared_ptr<Texture>> streamed;
+    for (auto& [key, weakTexture] : textures)
+    {
+        auto texture = weakTexture.lock();
+        if (texture && texture->params.streamed)
+            streamed.push_back(texture);
+    }
+    return streamed;
+}
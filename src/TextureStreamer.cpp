@@ -0,0 +1,249 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+TextureStreamer::TextureStreamer(std::shared_ptr<Helper> helper, TextureStreamingOptions options) :
+    helper(helper), options(options), slots(MAX_FEEDBACK_SLOTS)
+{
+    createFeedbackBuffers();
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    for (auto& request : requests)
+    {
+        request.task.wait();
+    }
+    requests.clear();
+
+    for (auto& [image, framesLeft] : retiredImages)
+    {
+        vkDestroyImageView(helper->device, image.view, nullptr);
+        vkFreeMemory(helper->device, image.memory, nullptr);
+        vkDestroyImage(helper->device, image.image, nullptr);
+    }
+
+    for (size_t i = 0; i < feedbackBuffers.size(); i++)
+    {
+        vkUnmapMemory(helper->device, feedbackBuffersMemory[i]);
+        vkDestroyBuffer(helper->device, feedbackBuffers[i], nullptr);
+        vkFreeMemory(helper->device, feedbackBuffersMemory[i], nullptr);
+    }
+}
+
+void TextureStreamer::createFeedbackBuffers()
+{
+    VkDeviceSize size = sizeof(uint32_t) * MAX_FEEDBACK_SLOTS;
+
+    feedbackBuffers.resize(helper->MAX_FRAMES_IN_FLIGHT);
+    feedbackBuffersMemory.resize(helper->MAX_FRAMES_IN_FLIGHT);
+    feedbackBuffersMapped.resize(helper->MAX_FRAMES_IN_FLIGHT);
+
+    for (size_t i = 0; i < helper->MAX_FRAMES_IN_FLIGHT; i++)
+    {
+        helper->createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, feedbackBuffers[i], feedbackBuffersMemory[i]);
+        helper->setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)feedbackBuffers[i], "TextureStreamer::Feedback Buffer " + std::to_string(i));
+
+        vkMapMemory(helper->device, feedbackBuffersMemory[i], 0, size, 0, &feedbackBuffersMapped[i]);
+        memset(feedbackBuffersMapped[i], 0xFF, size);
+    }
+}
+
+void TextureStreamer::recordFeedbackBarrier(VkCommandBuffer commandBuffer)
+{
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void TextureStreamer::update(uint32_t currentFrame)
+{
+    frame++;
+
+    for (auto it = retiredImages.begin(); it != retiredImages.end();)
+    {
+        if (--it->second > 0)
+        {
+            ++it;
+            continue;
+        }
+
+        vkDestroyImageView(helper->device, it->first.view, nullptr);
+        vkFreeMemory(helper->device, it->first.memory, nullptr);
+        vkDestroyImage(helper->device, it->first.image, nullptr);
+        it = retiredImages.erase(it);
+    }
+
+    std::vector<std::shared_ptr<Texture>> textures = helper->textureCache->getStreamedTextures();
+
+    // Levels requested the last time this frame's buffer was written
+    uint32_t* feedback = static_cast<uint32_t*>(feedbackBuffersMapped[currentFrame]);
+    for (auto& texture : textures)
+    {
+        if (texture->feedbackSlot == NO_FEEDBACK_SLOT)
+        {
+            assignSlot(texture);
+            continue;
+        }
+
+        uint32_t level = feedback[texture->feedbackSlot];
+        if (level != UINT32_MAX)
+        {
+            texture->requestedMip = std::min(level, texture->fullMipLevels - 1);
+            texture->lastRequestFrame = frame;
+        }
+    }
+    memset(feedback, 0xFF, sizeof(uint32_t) * MAX_FEEDBACK_SLOTS);
+
+    for (auto it = requests.begin(); it != requests.end();)
+    {
+        if (it->task.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++it;
+            continue;
+        }
+
+        try
+        {
+            it->task.get();
+            retire(it->texture->replace(*helper, *it->data));
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Failed to stream " << it->texture->path << ": " << e.what() << std::endl;
+            it->texture->streamingFailed = true;
+        }
+
+        it->texture->streaming = false;
+        it = requests.erase(it);
+    }
+
+    residentMemorySize = 0;
+    for (auto& texture : textures)
+    {
+        residentMemorySize += texture->memorySize;
+    }
+
+    auto getLevelSize = [](const Texture& texture, uint32_t level)
+    {
+        return TextureCache::getMipChainSize(std::max(1, texture.fullWidth >> level), std::max(1, texture.fullHeight >> level));
+    };
+
+    VkDeviceSize pendingMemorySize = 0;
+    for (auto& request : requests)
+    {
+        pendingMemorySize += getLevelSize(*request.texture, request.level) - request.texture->memorySize;
+    }
+
+    // Something was evicted to make room lately, adding detail now would only push it out again
+    if (helper->residency->isUnderPressure())
+        return;
+
+    // Textures furthest from the detail they need go first
+    std::vector<std::shared_ptr<Texture>> upgrades;
+    for (auto& texture : textures)
+    {
+        if (!texture->streaming && getTargetLevel(*texture) < texture->baseMip)
+            upgrades.push_back(texture);
+    }
+    std::sort(upgrades.begin(), upgrades.end(), [this](const auto& a, const auto& b)
+    {
+        return a->baseMip - getTargetLevel(*a) > b->baseMip - getTargetLevel(*b);
+    });
+
+    for (auto& texture : upgrades)
+    {
+        if (requests.size() >= options.maxConcurrentLoads)
+            break;
+
+        uint32_t level = getTargetLevel(*texture);
+        VkDeviceSize extraMemorySize = getLevelSize(*texture, level) - texture->memorySize;
+
+        // Make room by dropping detail that is no longer needed, least recently sampled first
+        while (residentMemorySize + pendingMemorySize + extraMemorySize > options.memoryBudget)
+        {
+            Texture* victim = nullptr;
+            for (auto& other : textures)
+            {
+                if (other == texture || other->streaming || other->baseMip >= getTargetLevel(*other))
+                    continue;
+
+                if (!victim || other->lastRequestFrame < victim->lastRequestFrame)
+                    victim = other.get();
+            }
+
+            if (!victim)
+                break;
+
+            VkDeviceSize previousMemorySize = victim->memorySize;
+            retire(victim->shrink(*helper, getTargetLevel(*victim)));
+            residentMemorySize -= previousMemorySize - victim->memorySize;
+        }
+
+        if (residentMemorySize + pendingMemorySize + extraMemorySize > options.memoryBudget)
+            continue;
+
+        StreamRequest request;
+        request.texture = texture;
+        request.level = level;
+        request.data = std::make_shared<TextureData>();
+        request.task = helper->threadPool->submit([helper = helper.get(), data = request.data, path = texture->path, level]()
+        {
+            *data = helper->loadTextureData(path);
+            TextureCache::downsample(*data, level);
+        });
+
+        texture->streaming = true;
+        pendingMemorySize += extraMemorySize;
+        requests.push_back(std::move(request));
+    }
+}
+
+VkDeviceSize TextureStreamer::getResidentMemorySize() const
+{
+    return residentMemorySize;
+}
+
+uint32_t TextureStreamer::getLoadingCount() const
+{
+    return static_cast<uint32_t>(requests.size());
+}
+
+void TextureStreamer::assignSlot(const std::shared_ptr<Texture>& texture)
+{
+    for (uint32_t i = 0; i < MAX_FEEDBACK_SLOTS; i++)
+    {
+        if (!slots[i].expired())
+            continue;
+
+        slots[i] = texture;
+        texture->feedbackSlot = i;
+
+        // Clear whatever the slot's previous owner requested
+        for (void* mapped : feedbackBuffersMapped)
+        {
+            static_cast<uint32_t*>(mapped)[i] = UINT32_MAX;
+        }
+        return;
+    }
+}
+
+void TextureStreamer::retire(TextureImage image)
+{
+    retiredImages.emplace_back(image, static_cast<uint32_t>(helper->MAX_FRAMES_IN_FLIGHT) + 1);
+}
+
+uint32_t TextureStreamer::getTargetLevel(const Texture& texture) const
+{
+    if (texture.streamingFailed)
+        return texture.baseMip;
+
+    bool recentlySampled = texture.lastRequestFrame > 0 && frame - texture.lastRequestFrame <= options.unusedFrames;
+    return recentlySampled ? std::min(texture.requestedMip, texture.streamingBaseMip) : texture.streamingBaseMip;
+}
@@ -0,0 +1,131 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        // Leave one core for the render thread
+        threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+
+    for (uint32_t i = 0; i < threadCount; i++)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> task)
+{
+    std::packaged_task<void()> packagedTask(std::move(task));
+    std::future<void> future = packagedTask.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(std::move(packagedTask));
+    }
+    condition.notify_one();
+
+    return future;
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task)
+{
+    if (count == 0)
+        return;
+
+    struct State
+    {
+        std::atomic<size_t> next{ 0 };
+        size_t done = 0;
+        std::exception_ptr exception;
+        std::mutex mutex;
+        std::condition_variable condition;
+    };
+
+    // Helpers that start after the caller finished everything find no work left, so the caller never
+    // waits on queued tasks. That keeps nested calls from worker threads deadlock free.
+    auto state = std::make_shared<State>();
+    size_t total = count;
+
+    auto run = [state, total, &task]()
+    {
+        for (size_t i = state->next++; i < total; i = state->next++)
+        {
+            std::exception_ptr exception;
+            try
+            {
+                task(i);
+            }
+            catch (...)
+            {
+                exception = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (exception && !state->exception)
+                state->exception = exception;
+
+            if (++state->done == total)
+                state->condition.notify_all();
+        }
+    };
+
+    size_t helperCount = std::min(count - 1, workers.size());
+    for (size_t i = 0; i < helperCount; i++)
+    {
+        submit(run);
+    }
+
+    run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->condition.wait(lock, [&]() { return state->done == total; });
+
+    if (state->exception)
+        std::rethrow_exception(state->exception);
+}
+
+uint32_t ThreadPool::getThreadCount() const
+{
+    return static_cast<uint32_t>(workers.size());
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::packaged_task<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+            if (stopping && tasks.empty())
+                return;
+
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,271 @@
+#include "TransformSystem.h"
+#include "Helper.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_SYSTEM_SSE
+#endif
+
+TransformSystem::TransformSystem(Helper& helper) : helper(helper)
+{}
+
+TransformSystem::~TransformSystem()
+{
+    for (FrameBuffer& frame : frames)
+    {
+        destroyBuffer(frame);
+    }
+}
+
+uint32_t TransformSystem::add()
+{
+    uint32_t transform;
+    if (!freeTransforms.empty())
+    {
+        transform = freeTransforms.back();
+        freeTransforms.pop_back();
+    }
+    else
+    {
+        transform = count++;
+
+        size_t paddedCount = (count + 3) / 4 * 4;
+        if (paddedCount > scales.size())
+        {
+            for (std::vector<float>* values : { &positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ, &rotationW })
+            {
+                values->resize(paddedCount, 0.0f);
+            }
+            scales.resize(paddedCount, 1.0f);
+            dirty.resize(paddedCount, 0);
+            matrices.resize(paddedCount, glm::mat4(1.0f));
+        }
+    }
+
+    positionX[transform] = positionY[transform] = positionZ[transform] = 0.0f;
+    rotationX[transform] = rotationY[transform] = rotationZ[transform] = 0.0f;
+    rotationW[transform] = 1.0f;
+    scales[transform] = 1.0f;
+    markDirty(transform);
+
+    return transform;
+}
+
+void TransformSystem::remove(uint32_t transform)
+{
+    freeTransforms.push_back(transform);
+}
+
+void TransformSystem::setPosition(uint32_t transform, const glm::vec3& position)
+{
+    positionX[transform] = position.x;
+    positionY[transform] = position.y;
+    positionZ[transform] = position.z;
+    markDirty(transform);
+}
+
+void TransformSystem::setRotation(uint32_t transform, const glm::quat& rotation)
+{
+    rotationX[transform] = rotation.x;
+    rotationY[transform] = rotation.y;
+    rotationZ[transform] = rotation.z;
+    rotationW[transform] = rotation.w;
+    markDirty(transform);
+}
+
+void TransformSystem::setScale(uint32_t transform, float scale)
+{
+    scales[transform] = scale;
+    markDirty(transform);
+}
+
+glm::vec3 TransformSystem::getPosition(uint32_t transform) const
+{
+    return glm::vec3(positionX[transform], positionY[transform], positionZ[transform]);
+}
+
+glm::quat TransformSystem::getRotation(uint32_t transform) const
+{
+    return glm::quat(rotationW[transform], rotationX[transform], rotationY[transform], rotationZ[transform]);
+}
+
+float TransformSystem::getScale(uint32_t transform) const
+{
+    return scales[transform];
+}
+
+const glm::mat4& TransformSystem::getMatrix(uint32_t transform) const
+{
+    return matrices[transform];
+}
+
+void TransformSystem::markDirty(uint32_t transform)
+{
+    dirty[transform] = 1;
+    anyDirty = true;
+}
+
+void TransformSystem::update()
+{
+    updatedCount = 0;
+    if (!anyDirty)
+        return;
+
+    uint32_t dirtyBegin = UINT32_MAX;
+    uint32_t dirtyEnd = 0;
+
+    // Groups of four are computed together, which also covers clean transforms next to dirty ones
+    for (uint32_t first = 0; first < count; first += 4)
+    {
+        uint32_t groupDirty;
+        memcpy(&groupDirty, &dirty[first], sizeof(groupDirty));
+        if (groupDirty == 0)
+            continue;
+
+        computeMatrices(first);
+        memset(&dirty[first], 0, 4);
+
+        dirtyBegin = std::min(dirtyBegin, first);
+        dirtyEnd = std::min(first + 4, count);
+        updatedCount += dirtyEnd - first;
+    }
+
+    for (FrameBuffer& frame : frames)
+    {
+        frame.dirtyBegin = std::min(frame.dirtyBegin, dirtyBegin);
+        frame.dirtyEnd = std::max(frame.dirtyEnd, dirtyEnd);
+    }
+
+    anyDirty = false;
+}
+
+void TransformSystem::computeMatrices(uint32_t first)
+{
+#ifdef TRANSFORM_SYSTEM_SSE
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+
+    __m128 x = _mm_loadu_ps(&rotationX[first]);
+    __m128 y = _mm_loadu_ps(&rotationY[first]);
+    __m128 z = _mm_loadu_ps(&rotationZ[first]);
+    __m128 w = _mm_loadu_ps(&rotationW[first]);
+    __m128 scale = _mm_loadu_ps(&scales[first]);
+
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+    // Rotation columns scaled, same layout as glm::mat3_cast
+    __m128 columns[3][4];
+    columns[0][0] = _mm_mul_ps(scale, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))));
+    columns[0][1] = _mm_mul_ps(scale, _mm_mul_ps(two, _mm_add_ps(xy, wz)));
+    columns[0][2] = _mm_mul_ps(scale, _mm_mul_ps(two, _mm_sub_ps(xz, wy)));
+    columns[1][0] = _mm_mul_ps(scale, _mm_mul_ps(two, _mm_sub_ps(xy, wz)));
+    columns[1][1] = _mm_mul_ps(scale, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))));
+    columns[1][2] = _mm_mul_ps(scale, _mm_mul_ps(two, _mm_add_ps(yz, wx)));
+    columns[2][0] = _mm_mul_ps(scale, _mm_mul_ps(two, _mm_add_ps(xz, wy)));
+    columns[2][1] = _mm_mul_ps(scale, _mm_mul_ps(two, _mm_sub_ps(yz, wx)));
+    columns[2][2] = _mm_mul_ps(scale, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))));
+
+    // The position is applied first, so it is rotated and scaled as well
+    __m128 px = _mm_loadu_ps(&positionX[first]);
+    __m128 py = _mm_loadu_ps(&positionY[first]);
+    __m128 pz = _mm_loadu_ps(&positionZ[first]);
+
+    __m128 translation[4];
+    for (int row = 0; row < 3; row++)
+    {
+        translation[row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(columns[0][row], px), _mm_mul_ps(columns[1][row], py)), _mm_mul_ps(columns[2][row], pz));
+    }
+    translation[3] = one;
+
+    for (int column = 0; column < 3; column++)
+    {
+        columns[column][3] = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(columns[column][0], columns[column][1], columns[column][2], columns[column][3]);
+    }
+    _MM_TRANSPOSE4_PS(translation[0], translation[1], translation[2], translation[3]);
+
+    // After the transposes, element i of each array is the column of transform first + i
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        glm::mat4& matrix = matrices[first + i];
+        _mm_storeu_ps(&matrix[0][0], columns[0][i]);
+        _mm_storeu_ps(&matrix[1][0], columns[1][i]);
+        _mm_storeu_ps(&matrix[2][0], columns[2][i]);
+        _mm_storeu_ps(&matrix[3][0], translation[i]);
+    }
+#else
+    for (uint32_t i = first; i < first + 4; i++)
+    {
+        glm::mat4 matrix = glm::mat4_cast(getRotation(i));
+        matrix = glm::mat4(glm::mat3(matrix) * scales[i]);
+        matrix[3] = glm::vec4(glm::mat3(matrix) * getPosition(i), 1.0f);
+        matrices[i] = matrix;
+    }
+#endif
+}
+
+void TransformSystem::upload(uint32_t currentFrame)
+{
+    if (frames.empty())
+        frames.resize(helper.MAX_FRAMES_IN_FLIGHT);
+
+    FrameBuffer& frame = frames[currentFrame];
+
+    if (count > frame.capacity || frame.buffer == VK_NULL_HANDLE)
+    {
+        uint32_t capacity = std::max<uint32_t>(frame.capacity, 256);
+        while (capacity < count)
+            capacity *= 2;
+
+        // The frame's previous buffer is no longer in use
+        destroyBuffer(frame);
+
+        VkDeviceSize size = sizeof(glm::mat4) * capacity;
+        helper.createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.buffer, frame.memory);
+        vkMapMemory(helper.device, frame.memory, 0, size, 0, &frame.mapped);
+        frame.capacity = capacity;
+
+        helper.setNameOfObject(VK_OBJECT_TYPE_BUFFER, (uint64_t)frame.buffer, "TransformSystem::Matrix Buffer " + std::to_string(currentFrame));
+
+        frame.dirtyBegin = 0;
+        frame.dirtyEnd = count;
+    }
+
+    if (frame.dirtyBegin < frame.dirtyEnd)
+    {
+        memcpy(static_cast<glm::mat4*>(frame.mapped) + frame.dirtyBegin, &matrices[frame.dirtyBegin], sizeof(glm::mat4) * (frame.dirtyEnd - frame.dirtyBegin));
+    }
+
+    frame.dirtyBegin = UINT32_MAX;
+    frame.dirtyEnd = 0;
+}
+
+VkBuffer TransformSystem::getBuffer(uint32_t currentFrame) const
+{
+    return frames[currentFrame].buffer;
+}
+
+uint32_t TransformSystem::getCount() const
+{
+    return count - static_cast<uint32_t>(freeTransforms.size());
+}
+
+uint32_t TransformSystem::getUpdatedCount() const
+{
+    return updatedCount;
+}
+
+void TransformSystem::destroyBuffer(FrameBuffer& frame)
+{
+    if (frame.buffer == VK_NULL_HANDLE)
+        return;
+
+    vkDestroyBuffer(helper.device, frame.buffer, nullptr);
+    vkFreeMemory(helper.device, frame.memory, nullptr);
+    frame.buffer = VK_NULL_HANDLE;
+}
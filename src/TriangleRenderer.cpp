@@ -5,12 +5,25 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <chrono>
+#include <filesystem>
 
 
 TriangleRenderer::TriangleRenderer(std::string app_name) : Application(app_name), camera(std::make_shared<Camera>(glm::vec3(-2907.25, 2827.39, 755.888), glm::vec3(0.0f, 0.0f, 0.0f)))
 {
-    models.push_back(std::make_shared<Model>("models/sponza/Sponza.gltf", helper));
+    // Loaded in the background, meshes show up as they become resident
+    ModelLoadOptions modelOptions;
+    modelOptions.asynchronous = true;
+    modelOptions.streamTextures = true;
+    models.push_back(std::make_shared<Model>("models/sponza/Sponza.gltf", helper, modelOptions));
     renderObjects.push_back(std::make_shared<RenderObject>(helper, models[0]));
+    staticRenderObjectCount = renderObjects.size();
+
+    if (std::filesystem::exists(streamedScenePath))
+    {
+        SceneStreamingOptions streamingOptions;
+        streamingOptions.modelOptions.streamTextures = true;
+        sceneStreamer = std::make_unique<SceneStreamer>(helper, streamedScenePath, streamingOptions);
+    }
 
     lightUBO = std::make_shared<LightUBO>();
     lightUBO->direction = glm::vec4(0.3f, -1.0f, 0.3f, 1.0f);
@@ -26,6 +39,19 @@ TriangleRenderer::TriangleRenderer(std::string app_name) : Application(app_name)
     meshPushConstants.surfaceOffset = 15.719f;
     meshPushConstants.coneCutoff = 143.813f;
 
+    textureStreamer = std::make_unique<TextureStreamer>(helper);
+    drawBatch = std::make_unique<DrawBatch>(helper);
+    // A software device runs compute culling on the same cores, the software occlusion culler is cheaper there
+    if (helper->cpuDevice)
+        enableGpuCulling = false;
+    if (helper->drawIndirectCountSupported)
+    {
+        drawCuller = std::make_unique<DrawCuller>(helper, depthImageView, swapChainExtent);
+        createOcclusionRenderPasses();
+    }
+    staticPassCache = std::make_unique<StaticPassCache>(helper);
+    deferredRenderer = std::make_unique<DeferredRenderer>(helper, depthImageView, swapChainExtent, swapChainRenderPass);
+
     createBuffers();
     createDescriptorSetLayouts();
     createDescriptorSets();
@@ -34,6 +60,11 @@ TriangleRenderer::TriangleRenderer(std::string app_name) : Application(app_name)
 
 void TriangleRenderer::cleanup_extended()
 {
+    meshletCuller.reset();
+    retiredMeshletCullers.clear();
+    sceneStreamer.reset();
+    textureStreamer.reset();
+
     for (auto& renderObject : renderObjects)
     {
         renderObject.reset();
@@ -46,10 +77,27 @@ void TriangleRenderer::cleanup_extended()
 
     shadowMap.reset();
     voxelizer.reset();
-
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    drawCuller.reset();
+    drawBatch.reset();
+    staticPassCache.reset();
+    MeshletCuller::destroyDescriptorSetLayouts(*helper);
+    DrawCuller::destroyDescriptorSetLayout(*helper);
+    DrawBatch::destroyDescriptorSetLayout(*helper);
+    // Frees the shared samplers, every texture went with the models
+    helper->textureCache.reset();
+    helper->residency->destroyRetired();
+    // Retired geometry ranges hold on to the arena until they are freed
+    helper->geometryArena.reset();
+    helper->transforms.reset();
+
+    destroyGraphicsPipeline();
+    deferredRenderer.reset();
     vkDestroyRenderPass(device, swapChainRenderPass, nullptr);
+    if (firstPhaseRenderPass != VK_NULL_HANDLE)
+    {
+        vkDestroyRenderPass(device, firstPhaseRenderPass, nullptr);
+        vkDestroyRenderPass(device, secondPhaseRenderPass, nullptr);
+    }
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
         vkDestroyBuffer(device, transformationUniformBuffers[i], nullptr);
@@ -200,7 +248,7 @@ void TriangleRenderer::createGraphicsPipeline()
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     std::vector<VkDescriptorSetLayout> layouts = { 
         descriptorSetLayout, 
-        Model::descriptorSetLayout, 
+        DrawBatch::descriptorSetLayout, 
         shadowMap->shadowMapDescriptorSetLayout, 
         voxelizer->mipMapperDescriptorSetLayout,
         voxelizer->voxelGridDescriptorSetLayout,
@@ -238,31 +286,254 @@ void TriangleRenderer::createGraphicsPipeline()
         throw std::runtime_error("failed to create graphics pipeline!");
     }
 
+    // Shades only the fragments the depth pre-pass left visible
+    depthStencil.depthWriteEnable = VK_FALSE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+
+    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &depthEqualGraphicsPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create graphics pipeline!");
+    }
+
+    // Depth pre-pass, positions only and no fragment stage
+    auto depthPrePassShaderCode = helper->readFile("shaders/depthPrePass.vert.spv");
+    auto depthPrePassShaderModule = helper->createShaderModule(depthPrePassShaderCode);
+    helper->setNameOfObject(VK_OBJECT_TYPE_SHADER_MODULE, (uint64_t)depthPrePassShaderModule, "TriangleRenderer::Depth Pre-Pass Shader Module");
+
+    VkPipelineShaderStageCreateInfo depthPrePassShaderStageInfo = vertShaderStageInfo;
+    depthPrePassShaderStageInfo.module = depthPrePassShaderModule;
+
+    VkVertexInputAttributeDescription positionAttributeDescription = Vertex::getAttributeDescriptions()[0];
+    VkPipelineVertexInputStateCreateInfo positionInputInfo = vertexInputInfo;
+    positionInputInfo.vertexAttributeDescriptionCount = 1;
+    positionInputInfo.pVertexAttributeDescriptions = &positionAttributeDescription;
+
+    VkPipelineColorBlendAttachmentState depthOnlyBlendAttachment{};
+    depthOnlyBlendAttachment.colorWriteMask = 0;
+    depthOnlyBlendAttachment.blendEnable = VK_FALSE;
+    VkPipelineColorBlendStateCreateInfo depthOnlyBlending = colorBlending;
+    depthOnlyBlending.pAttachments = &depthOnlyBlendAttachment;
+
+    depthStencil.depthWriteEnable = VK_TRUE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    VkGraphicsPipelineCreateInfo depthPrePassPipelineInfo = pipelineInfo;
+    depthPrePassPipelineInfo.stageCount = 1;
+    depthPrePassPipelineInfo.pStages = &depthPrePassShaderStageInfo;
+    depthPrePassPipelineInfo.pVertexInputState = &positionInputInfo;
+    depthPrePassPipelineInfo.pColorBlendState = &depthOnlyBlending;
+
+    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &depthPrePassPipelineInfo, nullptr, &depthPrePassPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create graphics pipeline!");
+    }
+
+    vkDestroyShaderModule(device, depthPrePassShaderModule, nullptr);
+
+    // G-buffer pass of the deferred path, same vertex stage with albedo and normals written instead of shading
+    auto geometryShaderCode = helper->readFile("shaders/gbuffer.frag.spv");
+    auto geometryShaderModule = helper->createShaderModule(geometryShaderCode);
+    helper->setNameOfObject(VK_OBJECT_TYPE_SHADER_MODULE, (uint64_t)geometryShaderModule, "TriangleRenderer::G-Buffer Shader Module");
+
+    VkPipelineShaderStageCreateInfo geometryShaderStageInfo = fragShaderStageInfo;
+    geometryShaderStageInfo.module = geometryShaderModule;
+    VkPipelineShaderStageCreateInfo geometryShaderStages[] = { vertShaderStageInfo, geometryShaderStageInfo };
+
+    std::array<VkPipelineColorBlendAttachmentState, 2> geometryBlendAttachments{};
+    for (VkPipelineColorBlendAttachmentState& attachment : geometryBlendAttachments)
+    {
+        attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        attachment.blendEnable = VK_FALSE;
+    }
+    VkPipelineColorBlendStateCreateInfo geometryBlending = colorBlending;
+    geometryBlending.attachmentCount = static_cast<uint32_t>(geometryBlendAttachments.size());
+    geometryBlending.pAttachments = geometryBlendAttachments.data();
+
+    VkGraphicsPipelineCreateInfo geometryPipelineInfo = pipelineInfo;
+    geometryPipelineInfo.pStages = geometryShaderStages;
+    geometryPipelineInfo.pColorBlendState = &geometryBlending;
+    geometryPipelineInfo.renderPass = deferredRenderer->geometryRenderPass;
+
+    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &geometryPipelineInfo, nullptr, &geometryPipeline) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create graphics pipeline!");
+    }
+
+    vkDestroyShaderModule(device, geometryShaderModule, nullptr);
+
+    deferredRenderer->createShadingPipeline({ descriptorSetLayout, shadowMap->shadowMapDescriptorSetLayout, voxelizer->mipMapperDescriptorSetLayout, voxelizer->voxelGridDescriptorSetLayout });
+
+    // Meshlet pipeline, the vertex stage is replaced by task and mesh shaders that cull clusters
+    if (helper->meshShaderSupported)
+    {
+        auto taskShaderCode = helper->readFile("shaders/meshlet.task.spv");
+        auto meshShaderCode = helper->readFile("shaders/meshlet.mesh.spv");
+        auto taskShaderModule = helper->createShaderModule(taskShaderCode);
+        auto meshShaderModule = helper->createShaderModule(meshShaderCode);
+
+        VkPipelineShaderStageCreateInfo taskShaderStageInfo{};
+        taskShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        taskShaderStageInfo.stage = VK_SHADER_STAGE_TASK_BIT_EXT;
+        taskShaderStageInfo.module = taskShaderModule;
+        taskShaderStageInfo.pName = "main";
+
+        VkPipelineShaderStageCreateInfo meshShaderStageInfo{};
+        meshShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        meshShaderStageInfo.stage = VK_SHADER_STAGE_MESH_BIT_EXT;
+        meshShaderStageInfo.module = meshShaderModule;
+        meshShaderStageInfo.pName = "main";
+        VkPipelineShaderStageCreateInfo meshletShaderStages[] = { taskShaderStageInfo, meshShaderStageInfo, fragShaderStageInfo };
+
+        // MeshPushConstants followed by MeshletDrawPushConstants
+        VkPushConstantRange meshletPushConstantRange{};
+        meshletPushConstantRange.stageFlags = MeshletCuller::MESHLET_PUSH_CONSTANT_STAGES;
+        meshletPushConstantRange.offset = 0;
+        meshletPushConstantRange.size = MeshletCuller::MESHLET_PUSH_CONSTANT_OFFSET + sizeof(MeshletDrawPushConstants);
+
+        std::vector<VkDescriptorSetLayout> meshletLayouts = layouts;
+        meshletLayouts.push_back(MeshletCuller::meshletDescriptorSetLayout);
+        meshletLayouts.push_back(MeshletCuller::cullingDescriptorSetLayout);
+
+        VkPipelineLayoutCreateInfo meshletPipelineLayoutInfo{};
+        meshletPipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        meshletPipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(meshletLayouts.size());
+        meshletPipelineLayoutInfo.pSetLayouts = meshletLayouts.data();
+        meshletPipelineLayoutInfo.pushConstantRangeCount = 1;
+        meshletPipelineLayoutInfo.pPushConstantRanges = &meshletPushConstantRange;
+
+        if (vkCreatePipelineLayout(device, &meshletPipelineLayoutInfo, nullptr, &meshletPipelineLayout) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        pipelineInfo.stageCount = 3;
+        pipelineInfo.pStages = meshletShaderStages;
+        pipelineInfo.pVertexInputState = nullptr;
+        pipelineInfo.pInputAssemblyState = nullptr;
+        pipelineInfo.layout = meshletPipelineLayout;
+
+        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &meshletGraphicsPipeline) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+
+        vkDestroyShaderModule(device, taskShaderModule, nullptr);
+        vkDestroyShaderModule(device, meshShaderModule, nullptr);
+    }
+
     vkDestroyShaderModule(device, vertShaderModule, nullptr);
     vkDestroyShaderModule(device, fragShaderModule, nullptr);
 }
 
-void TriangleRenderer::renderScene()
+void TriangleRenderer::destroyGraphicsPipeline()
 {
-    for (auto& renderObject : renderObjects)
+    vkDestroyPipeline(device, graphicsPipeline, nullptr);
+    vkDestroyPipeline(device, depthEqualGraphicsPipeline, nullptr);
+    vkDestroyPipeline(device, depthPrePassPipeline, nullptr);
+    vkDestroyPipeline(device, geometryPipeline, nullptr);
+    deferredRenderer->destroyShadingPipeline();
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+
+    if (meshletGraphicsPipeline != VK_NULL_HANDLE)
     {
-        meshPushConstants.model = renderObject->getModelMatrix();
-        vkCmdPushConstants(commandBuffers[currentFrame], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(MeshPushConstants), &meshPushConstants);
+        vkDestroyPipeline(device, meshletGraphicsPipeline, nullptr);
+        vkDestroyPipelineLayout(device, meshletPipelineLayout, nullptr);
+        meshletGraphicsPipeline = VK_NULL_HANDLE;
+        meshletPipelineLayout = VK_NULL_HANDLE;
+    }
+}
+
+void TriangleRenderer::renderScene(DrawCullPhase phase)
+{
+    bool meshShaderPath = useMeshShaderPath();
+    VkPipelineLayout layout = meshShaderPath ? meshletPipelineLayout : pipelineLayout;
+    VkShaderStageFlags pushConstantStages = meshShaderPath ? MeshletCuller::MESHLET_PUSH_CONSTANT_STAGES : VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
+    drawBatch->bind(commandBuffers[currentFrame], layout, 1);
+
+    if (!meshShaderPath)
+    {
+        // Model matrices and textures come from the draw batch, only the pass settings are pushed
+        vkCmdPushConstants(commandBuffers[currentFrame], layout, pushConstantStages, 0, sizeof(MeshPushConstants), &meshPushConstants);
+
+        auto drawMainPass = [&]()
+        {
+            if (useMeshletCulling())
+                meshletCuller->drawCompacted(commandBuffers[currentFrame], MESHLET_CULLING_MAIN_PASS, currentFrame);
+            else if (useGpuCulling())
+                drawCuller->draw(commandBuffers[currentFrame], phase);
+            else
+                drawBatch->draw(commandBuffers[currentFrame], DRAW_BATCH_MAIN_PASS);
+        };
+
+        // The same draws twice, the nearest depth first so every pixel is shaded once
+        if (enableDepthPrePass && !useDeferredShading())
+        {
+            vkCmdBindPipeline(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, depthPrePassPipeline);
+            drawMainPass();
+            vkCmdBindPipeline(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, depthEqualGraphicsPipeline);
+        }
+        drawMainPass();
+        return;
+    }
 
+    // The pass settings are pushed once, only the model matrix changes between draws
+    vkCmdPushConstants(commandBuffers[currentFrame], layout, pushConstantStages, 0, sizeof(MeshPushConstants), &meshPushConstants);
+
+    const RenderObject* pushedRenderObject = nullptr;
+    const std::vector<DrawListEntry>& entries = drawList.getEntries();
+    for (uint32_t i = 0; i < entries.size(); i++)
+    {
+        const DrawListEntry& entry = entries[i];
+        if (!softwareOcclusionCuller.isVisible(i))
+            continue;
+
+        if (entry.renderObject != pushedRenderObject)
+        {
+            glm::mat4 model = entry.renderObject->getModelMatrix();
+            vkCmdPushConstants(commandBuffers[currentFrame], layout, pushConstantStages, 0, sizeof(glm::mat4), &model);
+            pushedRenderObject = entry.renderObject;
+        }
+
+        meshletCuller->drawMeshlets(commandBuffers[currentFrame], layout, 6, entry.renderObjectIndex, entry.meshIndex, *entry.renderObject, *entry.mesh, selectMainPassLod(*entry.renderObject, *entry.mesh));
+    }
+}
+
+void TriangleRenderer::buildDrawBatch(uint32_t currentFrame)
+{
+    // Draws are added in the order of the meshlet culler's slots, so a slot is also the mesh's draw index
+    bool batchedPasses = !useMeshletCulling();
+    bool gpuCulling = useGpuCulling();
+
+    drawBatch->begin(currentFrame);
+    if (gpuCulling)
+        drawCuller->begin(currentFrame);
+    for (auto& renderObject : renderObjects)
+    {
         for (auto& mesh : renderObject->model->meshes)
         {
-            VkBuffer vertexBuffers[] = { mesh->vertexBuffer };
-            VkDeviceSize offsets[] = { 0 };
+            drawBatch->addDraw(renderObject->transform, renderObject->model->textures[mesh->materialIndex]);
+        }
+    }
 
-            vkCmdBindVertexBuffers(commandBuffers[currentFrame], 0, 1, vertexBuffers, offsets);
-            vkCmdBindIndexBuffer(commandBuffers[currentFrame], mesh->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    const std::vector<DrawListEntry>& entries = drawList.getEntries();
+    for (uint32_t i = 0; i < entries.size(); i++)
+    {
+        const DrawListEntry& entry = entries[i];
 
-            vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, nullptr);
-            vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &renderObject->model->descriptorSets[mesh->materialIndex], 0, nullptr);
+        if (sceneComplete)
+            voxelizationCuller.addCommands(*drawBatch, i, entry, selectVoxelizationLod(*entry.renderObject, *entry.mesh));
 
-            vkCmdDrawIndexed(commandBuffers[currentFrame], static_cast<uint32_t>(mesh->indices.size()), 1, 0, 0, 0);
+        if (batchedPasses)
+        {
+            // The shadow pass keeps full detail
+            if (shadowCasterCuller.isVisible(i))
+                drawBatch->addCommand(DRAW_BATCH_SHADOW_PASS, entry.drawIndex, *entry.mesh, entry.mesh->lods[0]);
+            if (gpuCulling)
+                drawCuller->addDraw(entry.drawIndex, *entry.mesh, selectMainPassLod(*entry.renderObject, *entry.mesh));
+            else if (softwareOcclusionCuller.isVisible(i))
+                drawBatch->addCommand(DRAW_BATCH_MAIN_PASS, entry.drawIndex, *entry.mesh, selectMainPassLod(*entry.renderObject, *entry.mesh));
         }
     }
+    drawBatch->end();
+    if (gpuCulling)
+        drawCuller->end();
 }
 
 void TriangleRenderer::recordCommandBuffer(uint32_t currentFrame, uint32_t imageIndex)
@@ -295,33 +566,51 @@ void TriangleRenderer::recordCommandBuffer(uint32_t currentFrame, uint32_t image
     memoryBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT | VK_ACCESS_MEMORY_READ_BIT;
     memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
 
+    ViewProjectionMatrices matrices = camera->getViewProjectionMatrices(swapChainExtent.width, swapChainExtent.height);
+    sceneBvh.update(drawList, helper->transforms->getUpdatedCount() > 0);
+    shadowCasterCuller.cull(drawList, sceneBvh, shadowMap->getLightSpaceMatrix(), matrices.proj * matrices.view);
+    voxelizationCuller.cull(drawList, sceneBvh, glm::vec3(voxelizer->aabbMin), glm::vec3(voxelizer->aabbMax));
+
+    // The GPU culls the batched main pass on its own
+    if (!useGpuCulling())
+    {
+        frustumCuller.cull(drawList, matrices.proj * matrices.view, helper->transforms->getUpdatedCount() > 0, enableBvhCulling ? &sceneBvh : nullptr);
+        // Runs while the GPU is still busy with the previous frame, every CPU culled path reads its result
+        softwareOcclusionCuller.cull(drawList, frustumCuller, matrices.proj * matrices.view, *helper->threadPool);
+    }
+
+    buildDrawBatch(currentFrame);
+
     beginCommandBuffer();
 
-    // Voxelization
+    // Voxelization, skipped until every mesh is resident so the grid is never built from a partial scene
+    if (sceneComplete)
     {
         voxelizer->updateUniformBuffers(currentFrame);
 
         vkCmdPipelineBarrier(commandBuffers[currentFrame], VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 
-        voxelizer->beginVoxelization(commandBuffers[currentFrame], currentFrame);
-        for (auto& renderObject : renderObjects)
+        std::shared_ptr<GeometryVoxelizer> vox = std::dynamic_pointer_cast<GeometryVoxelizer>(voxelizer);
+        auto drawVoxelization = [&](VkCommandBuffer commandBuffer)
         {
-            meshPushConstants.model = renderObject->getModelMatrix();
-            vkCmdPushConstants(commandBuffers[currentFrame], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(MeshPushConstants), &meshPushConstants);
+            drawBatch->bind(commandBuffer, vox->voxelGridPipelineLayout, 1);
+            drawBatch->draw(commandBuffer, DRAW_BATCH_VOXELIZATION_PASS);
+        };
 
-            for (auto& mesh : renderObject->model->meshes)
+        if (staticPassCache->enabled)
+        {
+            voxelizer->beginVoxelization(commandBuffers[currentFrame], currentFrame, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            staticPassCache->execute(commandBuffers[currentFrame], STATIC_PASS_VOXELIZATION, currentFrame, drawBatch->getPassVersion(DRAW_BATCH_VOXELIZATION_PASS),
+                vox->voxelizationRenderPass, vox->voxelizationFrameBuffer, [&](VkCommandBuffer commandBuffer)
             {
-                VkBuffer vertexBuffers[] = { mesh->vertexBuffer };
-                VkDeviceSize offsets[] = { 0 };
-
-                vkCmdBindVertexBuffers(commandBuffers[currentFrame], 0, 1, vertexBuffers, offsets);
-                vkCmdBindIndexBuffer(commandBuffers[currentFrame], mesh->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-
-                std::shared_ptr<GeometryVoxelizer> vox = std::dynamic_pointer_cast<GeometryVoxelizer>(voxelizer);
-                vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, vox->voxelGridPipelineLayout, 1, 1, &renderObject->model->descriptorSets[mesh->materialIndex], 0, nullptr);
-
-                vkCmdDrawIndexed(commandBuffers[currentFrame], static_cast<uint32_t>(mesh->indices.size()), 1, 0, 0, 0);
-            }
+                voxelizer->bindVoxelizationState(commandBuffer, currentFrame);
+                drawVoxelization(commandBuffer);
+            });
+        }
+        else
+        {
+            voxelizer->beginVoxelization(commandBuffers[currentFrame], currentFrame);
+            drawVoxelization(commandBuffers[currentFrame]);
         }
         voxelizer->endVoxelization(commandBuffers[currentFrame], currentFrame);
 
@@ -352,42 +641,147 @@ void TriangleRenderer::recordCommandBuffer(uint32_t currentFrame, uint32_t image
     }
     else
     {
-        // Shadow map rendering
-        shadowMap->beginRender(commandBuffers[currentFrame]);
-        for (auto& renderObject : renderObjects)
+        bool meshShaderPath = useMeshShaderPath();
+        bool meshletCulling = useMeshletCulling();
+
+        // The compute fallback compacts the visible meshlets' indices before the render passes start
+        if (meshletCulling && !meshShaderPath)
         {
-            glm::mat4 model = renderObject->getModelMatrix();
-            vkCmdPushConstants(commandBuffers[currentFrame], shadowMap->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &model);
+            cullMeshlets(MESHLET_CULLING_SHADOW_PASS, currentFrame);
+            cullMeshlets(MESHLET_CULLING_MAIN_PASS, currentFrame);
+        }
 
-            for (auto& mesh : renderObject->model->meshes)
-            {
-                VkBuffer vertexBuffers[] = { mesh->vertexBuffer };
-                VkDeviceSize offsets[] = { 0 };
+        if (useGpuCulling())
+            drawCuller->cull(commandBuffers[currentFrame], *drawBatch, matrices.proj * matrices.view);
 
-                vkCmdBindVertexBuffers(commandBuffers[currentFrame], 0, 1, vertexBuffers, offsets);
-                vkCmdBindIndexBuffer(commandBuffers[currentFrame], mesh->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        // Shadow map rendering
+        auto drawShadowCasters = [&](VkCommandBuffer commandBuffer)
+        {
+            drawBatch->bind(commandBuffer, shadowMap->pipelineLayout, 1);
 
-                vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, shadowMap->pipelineLayout, 0, 1, &shadowMap->descriptorSet, 0, nullptr);
+            if (meshletCulling)
+                meshletCuller->drawCompacted(commandBuffer, MESHLET_CULLING_SHADOW_PASS, currentFrame);
+            else
+                drawBatch->draw(commandBuffer, DRAW_BATCH_SHADOW_PASS);
+        };
 
-                vkCmdDrawIndexed(commandBuffers[currentFrame], static_cast<uint32_t>(mesh->indices.size()), 1, 0, 0, 0);
+        if (meshShaderPath)
+        {
+            shadowMap->beginRender(commandBuffers[currentFrame]);
+            vkCmdBindPipeline(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, shadowMap->meshletPipeline);
+            vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, shadowMap->meshletPipelineLayout, 0, 1, &shadowMap->descriptorSet, 0, nullptr);
+            meshletCuller->bindMeshShaderPass(commandBuffers[currentFrame], shadowMap->meshletPipelineLayout, 1, MESHLET_CULLING_SHADOW_PASS, currentFrame);
+
+            const RenderObject* pushedRenderObject = nullptr;
+            const std::vector<DrawListEntry>& entries = drawList.getEntries();
+            for (uint32_t i = 0; i < entries.size(); i++)
+            {
+                const DrawListEntry& entry = entries[i];
+                if (!shadowCasterCuller.isVisible(i))
+                    continue;
+
+                if (entry.renderObject != pushedRenderObject)
+                {
+                    glm::mat4 model = entry.renderObject->getModelMatrix();
+                    vkCmdPushConstants(commandBuffers[currentFrame], shadowMap->meshletPipelineLayout, MeshletCuller::MESHLET_PUSH_CONSTANT_STAGES, 0, sizeof(glm::mat4), &model);
+                    pushedRenderObject = entry.renderObject;
+                }
+
+                meshletCuller->drawMeshlets(commandBuffers[currentFrame], shadowMap->meshletPipelineLayout, 1, entry.renderObjectIndex, entry.meshIndex, *entry.renderObject, *entry.mesh, entry.mesh->lods[0]);
             }
         }
+        else if (staticPassCache->enabled)
+        {
+            shadowMap->beginRender(commandBuffers[currentFrame], VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+            staticPassCache->execute(commandBuffers[currentFrame], STATIC_PASS_SHADOW, currentFrame, drawBatch->getPassVersion(DRAW_BATCH_SHADOW_PASS),
+                shadowMap->renderPass, shadowMap->framebuffer, [&](VkCommandBuffer commandBuffer)
+            {
+                shadowMap->bindRenderState(commandBuffer);
+                drawShadowCasters(commandBuffer);
+            });
+        }
+        else
+        {
+            shadowMap->beginRender(commandBuffers[currentFrame]);
+            drawShadowCasters(commandBuffers[currentFrame]);
+        }
         shadowMap->endRender(commandBuffers[currentFrame]);
 
         // main rendering
-        beginRenderPass(currentFrame, imageIndex);
-        vkCmdBindPipeline(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-        vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &shadowMap->shadowMapDescriptorSet, 0, nullptr);
-        vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 3, 1, &voxelizer->mipMapperDescriptorSet, 0, nullptr);
-        vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 4, 1, &voxelizer->voxelGridDescriptorSets[currentFrame], 0, nullptr);
-        vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 5, 1, &voxelizer->noiseTextureDescriptorSet, 0, nullptr);
-        renderScene();
+        VkPipelineLayout layout = meshShaderPath ? meshletPipelineLayout : pipelineLayout;
+
+        auto beginMainPass = [&](VkRenderPass renderPass)
+        {
+            beginRenderPass(currentFrame, imageIndex, renderPass);
+            vkCmdBindPipeline(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, meshShaderPath ? meshletGraphicsPipeline : graphicsPipeline);
+            vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 2, 1, &shadowMap->shadowMapDescriptorSet, 0, nullptr);
+            vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 3, 1, &voxelizer->mipMapperDescriptorSet, 0, nullptr);
+            vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 4, 1, &voxelizer->voxelGridDescriptorSets[currentFrame], 0, nullptr);
+            vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 5, 1, &voxelizer->noiseTextureDescriptorSet, 0, nullptr);
+            if (meshShaderPath)
+                meshletCuller->bindMeshShaderPass(commandBuffers[currentFrame], layout, 6, MESHLET_CULLING_MAIN_PASS, currentFrame);
+        };
+
+        if (useDeferredShading())
+        {
+            auto beginGeometryPass = [&](bool clear)
+            {
+                deferredRenderer->beginGeometryPass(commandBuffers[currentFrame], clear);
+                vkCmdBindPipeline(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, geometryPipeline);
+            };
+
+            beginGeometryPass(true);
+            renderScene(DRAW_CULL_FIRST_PHASE);
+            deferredRenderer->endGeometryPass(commandBuffers[currentFrame]);
+
+            if (useOcclusionCulling())
+            {
+                drawCuller->cullOccluded(commandBuffers[currentFrame], *drawBatch, matrices.proj * matrices.view);
+
+                beginGeometryPass(false);
+                renderScene(DRAW_CULL_SECOND_PHASE);
+                deferredRenderer->endGeometryPass(commandBuffers[currentFrame]);
+            }
+
+            vkCmdPipelineBarrier(commandBuffers[currentFrame], VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+            DeferredShadingPushConstants shadingPushConstants{};
+            shadingPushConstants.inverseViewProjection = glm::inverse(matrices.proj * matrices.view);
+            shadingPushConstants.occlusionDecayFactor = meshPushConstants.occlusionDecayFactor;
+            shadingPushConstants.ambientOcclusionEnabled = meshPushConstants.ambientOcclusionEnabled;
+            shadingPushConstants.occlusionVisualizationEnabled = meshPushConstants.occlusionVisualizationEnabled;
+            shadingPushConstants.surfaceOffset = meshPushConstants.surfaceOffset;
+            shadingPushConstants.coneCutoff = meshPushConstants.coneCutoff;
+
+            deferredRenderer->shade(commandBuffers[currentFrame], { descriptorSets[currentFrame], shadowMap->shadowMapDescriptorSet, voxelizer->mipMapperDescriptorSet, voxelizer->voxelGridDescriptorSets[currentFrame] }, shadingPushConstants);
+
+            beginRenderPass(currentFrame, imageIndex);
+            deferredRenderer->composite(commandBuffers[currentFrame]);
+        }
+        else if (useOcclusionCulling())
+        {
+            // Draws visible last frame, then the ones the depth pyramid of their depth does not hide
+            beginMainPass(firstPhaseRenderPass);
+            renderScene(DRAW_CULL_FIRST_PHASE);
+            vkCmdEndRenderPass(commandBuffers[currentFrame]);
+
+            drawCuller->cullOccluded(commandBuffers[currentFrame], *drawBatch, matrices.proj * matrices.view);
+
+            beginMainPass(secondPhaseRenderPass);
+            renderScene(DRAW_CULL_SECOND_PHASE);
+        }
+        else
+        {
+            beginMainPass(swapChainRenderPass);
+            renderScene();
+        }
     }
 
     ImGui::Render();
     ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffers[currentFrame]);
 
     vkCmdEndRenderPass(commandBuffers[currentFrame]);    
+    textureStreamer->recordFeedbackBarrier(commandBuffers[currentFrame]);
     vkCmdPipelineBarrier(commandBuffers[currentFrame], VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
 
     if (vkEndCommandBuffer(commandBuffers[currentFrame]) != VK_SUCCESS) {
@@ -395,11 +789,11 @@ void TriangleRenderer::recordCommandBuffer(uint32_t currentFrame, uint32_t image
     }
 }
 
-void TriangleRenderer::beginRenderPass(uint32_t currentFrame, uint32_t imageIndex)
+void TriangleRenderer::beginRenderPass(uint32_t currentFrame, uint32_t imageIndex, VkRenderPass renderPass)
 {
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    renderPassInfo.renderPass = swapChainRenderPass;
+    renderPassInfo.renderPass = renderPass != VK_NULL_HANDLE ? renderPass : swapChainRenderPass;
     renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
     renderPassInfo.renderArea.offset = { 0, 0 };
     renderPassInfo.renderArea.extent = swapChainExtent;
@@ -417,6 +811,110 @@ void TriangleRenderer::beginRenderPass(uint32_t currentFrame, uint32_t imageInde
 
 }
 
+void TriangleRenderer::createOcclusionRenderPasses()
+{
+    // Both are compatible with the swap chain render pass, so its framebuffers and pipelines are used with them
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = swapChainImageFormat;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    // The first phase's depth is read by the depth pyramid
+    VkAttachmentDescription depthAttachment{};
+    depthAttachment.format = VK_FORMAT_D32_SFLOAT;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 1;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+    VkSubpassDependency dependency1{};
+    dependency1.srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependency1.dstSubpass = 0;
+    dependency1.srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    dependency1.srcAccessMask = 0;
+    dependency1.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependency1.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    VkSubpassDependency dependency2{};
+    dependency2.srcSubpass = 0;
+    dependency2.dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependency2.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependency2.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependency2.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependency2.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    std::vector<VkSubpassDependency> dependencies = { dependency1, dependency2 };
+
+    std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
+
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &firstPhaseRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render pass!");
+    }
+
+    // The second phase draws on top of the first and presents
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    // Waits for the pyramid to stop reading the depth buffer
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    dependencies[1].dstAccessMask = 0;
+
+    attachments = { colorAttachment, depthAttachment };
+
+    if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &secondPhaseRenderPass) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create render pass!");
+    }
+}
+
+void TriangleRenderer::recreate_swap_chain_extended()
+{
+    // The depth pyramid follows the new depth buffer
+    if (drawCuller)
+        drawCuller->resize(depthImageView, swapChainExtent);
+    deferredRenderer->resize(depthImageView, swapChainExtent);
+}
+
 void TriangleRenderer::setDynamicState()
 {
     VkViewport viewport{};
@@ -438,18 +936,28 @@ void TriangleRenderer::main_loop_extended(uint32_t currentFrame, uint32_t imageI
 {
     camera->deltaTime = deltaTime;
     camera->move();
+    helper->residency->beginFrame();
+    textureStreamer->update(currentFrame);
+    updateModels();
+    helper->transforms->update();
+    helper->transforms->upload(currentFrame);
     updateUniformBuffers(currentFrame);
 
     ImGui_ImplVulkan_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
+    if (!sceneComplete)
+        ImGui::Text("Loading scene...");
+
     ImGui::Checkbox("Enable Voxel Visualization", &enableVoxelVis);
 
     ImGui::Text("");
     ImGui::Text("Voxel Grid resolution:");
 
+    // Follows the grid actually in use, which may be coarser than requested after running out of memory
     static int res_group = 3;
+    res_group = static_cast<int>(std::log2(voxelizer->voxelsPerSide / 64));
     if (ImGui::RadioButton("64", &res_group, 0))
         revoxelize(64);
     if (ImGui::RadioButton("128", &res_group, 1))
@@ -459,14 +967,80 @@ void TriangleRenderer::main_loop_extended(uint32_t currentFrame, uint32_t imageI
     if (ImGui::RadioButton("512", &res_group, 3))
         revoxelize(512);
 
+    ImGui::Text("");
+    ImGui::Checkbox("Enable Mesh LODs", &enableMeshLods);
+    ImGui::SliderFloat("LOD Error Threshold (px)", &lodErrorThreshold, 0.25f, 16.0f);
+    ImGui::SliderFloat("Voxelization LOD Error (voxels)", &voxelLodErrorThreshold, 0.0f, 2.0f);
+
+    ImGui::Text("");
+    if (ImGui::Checkbox("Enable Meshlet Culling", &enableMeshletCulling))
+        staticPassCache->invalidate();
+    if (meshletCuller)
+        ImGui::Text(meshletCuller->useMeshShaders ? "Meshlet path: mesh shaders" : "Meshlet path: compute index compaction");
+    else
+        ImGui::Text("Meshlet path: waiting for the scene to load");
+
+    if (sceneStreamer)
+    {
+        ImGui::Text("");
+        ImGui::Text("Streamed cells: %u resident, %u loading, %u total", sceneStreamer->getResidentCellCount(), sceneStreamer->getLoadingCellCount(), static_cast<uint32_t>(sceneStreamer->cells.size()));
+        ImGui::Text("Streamed memory: %.1f / %.1f MB", sceneStreamer->getResidentMemorySize() / (1024.0 * 1024.0), sceneStreamer->options.memoryBudget / (1024.0 * 1024.0));
+        ImGui::SliderFloat("Stream Load Radius", &sceneStreamer->options.loadRadius, 500.0f, 20000.0f);
+        sceneStreamer->options.unloadRadius = sceneStreamer->options.loadRadius * 1.25f;
+    }
+
+    ImGui::Text("");
+    ImGui::Text("Streamed textures: %.1f / %.1f MB, %u loading", textureStreamer->getResidentMemorySize() / (1024.0 * 1024.0), textureStreamer->options.memoryBudget / (1024.0 * 1024.0), textureStreamer->getLoadingCount());
+    ImGui::Text("Evictable memory: %.1f MB, %u evicted, %llu evictions", helper->residency->getTrackedSize() / (1024.0 * 1024.0), helper->residency->getEvictedCount(), static_cast<unsigned long long>(helper->residency->getEvictionCount()));
+    ImGui::Text("Relocated: %.1f MB%s", helper->residency->getRelocatedSize() / (1024.0 * 1024.0), helper->residency->isDefragmenting() ? ", defragmenting" : "");
+    ImGui::Text("Geometry arena: %.1f / %.1f MB in %u blocks", helper->geometryArena->getUsedSize() / (1024.0 * 1024.0), helper->geometryArena->getAllocatedSize() / (1024.0 * 1024.0), helper->geometryArena->getBlockCount());
+    ImGui::Checkbox("Enable Depth Pre-Pass", &enableDepthPrePass);
+    ImGui::Checkbox("Enable Deferred Shading", &enableDeferredShading);
+    ImGui::Checkbox("Enable Frustum Culling", &frustumCuller.enabled);
+    ImGui::Checkbox("Cull Through Scene BVH", &enableBvhCulling);
+    ImGui::Checkbox("Enable Shadow Caster Culling", &shadowCasterCuller.enabled);
+    ImGui::Checkbox("Cull Casters Without Visible Receivers", &shadowCasterCuller.receiverCulling);
+    ImGui::Checkbox("Extend Caster Volume Toward Light", &shadowCasterCuller.extendTowardLight);
+    ImGui::Text("Shadow casters: %u for %u receivers, %.3f ms", shadowCasterCuller.getCasterCount(), shadowCasterCuller.getReceiverCount(), shadowCasterCuller.getCullTime());
+    ImGui::Checkbox("Enable Voxelization Culling", &voxelizationCuller.enabled);
+    ImGui::Checkbox("Cull Meshlets Outside Voxel Grid", &voxelizationCuller.clusterCulling);
+    ImGui::Text("Voxelization: %u meshes culled, %u split, %u triangles culled", voxelizationCuller.getCulledCount(), voxelizationCuller.getSplitCount(), voxelizationCuller.getCulledTriangleCount());
+    ImGui::Text("Scene BVH: %u nodes, built %u times, refit %u times", sceneBvh.getNodeCount(), sceneBvh.getBuildCount(), sceneBvh.getRefitCount());
+    if (pickedRenderObject >= 0)
+        ImGui::Text("Picked: render object %d, mesh %u at %.1f units", pickedRenderObject, pickedMesh, pickedDistance);
+    ImGui::Text("Frustum culling: %u / %u meshes visible, %.3f ms", frustumCuller.getVisibleCount(), static_cast<uint32_t>(drawList.getEntries().size()), frustumCuller.getCullTime());
+    ImGui::Checkbox("Enable Software Occlusion Culling", &softwareOcclusionCuller.enabled);
+    ImGui::Text("Software occlusion: %u occluders, %u triangles, %u meshes culled, %.3f ms", softwareOcclusionCuller.getOccluderCount(), softwareOcclusionCuller.getRasterizedTriangleCount(), softwareOcclusionCuller.getOccludedCount(), softwareOcclusionCuller.getCullTime());
+    if (drawCuller)
+    {
+        ImGui::Checkbox("Enable GPU Culling", &enableGpuCulling);
+        ImGui::Checkbox("Enable Occlusion Culling", &drawCuller->occlusionCulling);
+        ImGui::Text("GPU culling: %u main pass draws submitted", drawCuller->getDrawCount());
+    }
+    ImGui::Text("Transforms: %u, %u matrices updated", helper->transforms->getCount(), helper->transforms->getUpdatedCount());
+    ImGui::Text("Draws: %u, %u textures, %u main pass multi-draws", drawBatch->getDrawCount(), drawBatch->getTextureCount(), drawBatch->getMultiDrawCount(DRAW_BATCH_MAIN_PASS));
+    ImGui::Checkbox("Enable Instancing", &drawBatch->instancing);
+    ImGui::Checkbox("Reuse Shadow and Voxelization Commands", &staticPassCache->enabled);
+    ImGui::Text("Static passes: %llu recorded, %llu reused", static_cast<unsigned long long>(staticPassCache->getRecordCount()), static_cast<unsigned long long>(staticPassCache->getReuseCount()));
+    ImGui::Text("Draw list: %u meshes, %u mesh and %u material changes, built %u times", static_cast<uint32_t>(drawList.getEntries().size()), drawList.getMeshChangeCount(), drawList.getMaterialChangeCount(), drawList.getBuildCount());
+    ImGui::Text("Main pass: %u commands for %u instances", drawBatch->getCommandCount(DRAW_BATCH_MAIN_PASS), drawBatch->getInstanceCount(DRAW_BATCH_MAIN_PASS));
+
     ImGui::Text("");
     ImGui::Checkbox("Enable Ambient Occlusion", (bool*)&meshPushConstants.ambientOcclusionEnabled);
     ImGui::Checkbox("Enable Occlusion Visualization", (bool*) & meshPushConstants.occlusionVisualizationEnabled);
     ImGui::SliderFloat("Occlusion Decay Factor", &meshPushConstants.occlusionDecayFactor, 0.0f, 0.5f);
     ImGui::SliderFloat("Surface Offset", &meshPushConstants.surfaceOffset, 0.0f, 30.0f);
     ImGui::SliderFloat("Cone Cutoff", &meshPushConstants.coneCutoff, 0.0f, 2000.0f);
+    // Reduced resolution occlusion is traced by the deferred path only
+    if (useDeferredShading())
+    {
+        const char* resolutions[] = { "Full", "Half", "Quarter" };
+        int resolution = deferredRenderer->ambientOcclusionScale >= 4 ? 2 : deferredRenderer->ambientOcclusionScale - 1;
+        if (ImGui::Combo("Occlusion Resolution", &resolution, resolutions, IM_ARRAYSIZE(resolutions)))
+            deferredRenderer->ambientOcclusionScale = 1u << resolution;
+    }
 
-
+    makeSceneResident();
     recordCommandBuffer(currentFrame, imageIndex);
 }
 
@@ -508,7 +1082,9 @@ void TriangleRenderer::createDescriptorSetLayouts()
     transformationUboLayoutBinding.binding = 0;
     transformationUboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     transformationUboLayoutBinding.descriptorCount = 1;
-    transformationUboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    transformationUboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    if (helper->meshShaderSupported)
+        transformationUboLayoutBinding.stageFlags |= VK_SHADER_STAGE_MESH_BIT_EXT;
     transformationUboLayoutBinding.pImmutableSamplers = nullptr; // Optional
 
     // Light binding
@@ -516,7 +1092,7 @@ void TriangleRenderer::createDescriptorSetLayouts()
     lightUboLayoutBinding.binding = 1;
     lightUboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     lightUboLayoutBinding.descriptorCount = 1;
-    lightUboLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    lightUboLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
     lightUboLayoutBinding.pImmutableSamplers = nullptr; // Optional
 
     // Light space matrix binding
@@ -524,10 +1100,18 @@ void TriangleRenderer::createDescriptorSetLayouts()
     lightSpaceMatrixUboLayoutBinding.binding = 2;
     lightSpaceMatrixUboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     lightSpaceMatrixUboLayoutBinding.descriptorCount = 1;
-    lightSpaceMatrixUboLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    lightSpaceMatrixUboLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
     lightSpaceMatrixUboLayoutBinding.pImmutableSamplers = nullptr; // Optional
 
-    std::vector<VkDescriptorSetLayoutBinding> bindings = { transformationUboLayoutBinding, lightUboLayoutBinding, lightSpaceMatrixUboLayoutBinding };
+    // Texture streaming feedback binding
+    VkDescriptorSetLayoutBinding textureFeedbackLayoutBinding{};
+    textureFeedbackLayoutBinding.binding = 3;
+    textureFeedbackLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    textureFeedbackLayoutBinding.descriptorCount = 1;
+    textureFeedbackLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    textureFeedbackLayoutBinding.pImmutableSamplers = nullptr; // Optional
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = { transformationUboLayoutBinding, lightUboLayoutBinding, lightSpaceMatrixUboLayoutBinding, textureFeedbackLayoutBinding };
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -557,6 +1141,14 @@ void TriangleRenderer::updateUniformBuffers(uint32_t currentImage)
     memcpy(transformationUniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
     memcpy(lightUniformBuffersMapped[currentImage], lightUBO.get(), sizeof(LightUBO));
     memcpy(lightSpaceMatrixUniformBuffersMapped[currentImage], &lightSpaceMatrix, sizeof(LightSpaceMatrix));
+
+    // The shadow pipeline has no Y flip, so its back face culling removes the faces turned towards the light
+    glm::vec3 lightDirection = glm::vec3(lightUBO->direction);
+    if (!meshletCuller)
+        return;
+
+    meshletCuller->updateCullingData(MESHLET_CULLING_MAIN_PASS, currentImage, matrices.proj * matrices.view, camera->position, camera->front, false);
+    meshletCuller->updateCullingData(MESHLET_CULLING_SHADOW_PASS, currentImage, lightSpaceMatrix.model, -lightDirection * shadowMap->backOffDistance, -lightDirection, true);
 }
 
 void TriangleRenderer::createDescriptorSets()
@@ -582,7 +1174,7 @@ void TriangleRenderer::createDescriptorSets()
         transformsBufferInfo.offset = 0;
         transformsBufferInfo.range = sizeof(TransformationUniformBufferObject);
 
-        std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+        std::array<VkWriteDescriptorSet, 4> descriptorWrites{};
         descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         descriptorWrites[0].dstSet = descriptorSets[i];
         descriptorWrites[0].dstBinding = 0;
@@ -619,6 +1211,20 @@ void TriangleRenderer::createDescriptorSets()
         descriptorWrites[2].descriptorCount = 1;
         descriptorWrites[2].pBufferInfo = &lightSpaceMatrixBufferInfo;  
 
+        // Texture streaming feedback
+        VkDescriptorBufferInfo textureFeedbackBufferInfo{};
+        textureFeedbackBufferInfo.buffer = textureStreamer->feedbackBuffers[i];
+        textureFeedbackBufferInfo.offset = 0;
+        textureFeedbackBufferInfo.range = VK_WHOLE_SIZE;
+
+        descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[3].dstSet = descriptorSets[i];
+        descriptorWrites[3].dstBinding = 3;
+        descriptorWrites[3].dstArrayElement = 0;
+        descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[3].descriptorCount = 1;
+        descriptorWrites[3].pBufferInfo = &textureFeedbackBufferInfo;
+
         vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
     }
 }
@@ -702,6 +1308,40 @@ void TriangleRenderer::mouse_callback_extended(GLFWwindow* window, int button, i
         camera->freeLook = false;
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 	}
+    else if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !camera->freeLook && !ImGui::GetIO().WantCaptureMouse)
+    {
+        pickMesh(window);
+    }
+}
+
+void TriangleRenderer::pickMesh(GLFWwindow* window)
+{
+    double xpos, ypos;
+    int width, height;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    glfwGetWindowSize(window, &width, &height);
+    if (width == 0 || height == 0)
+        return;
+
+    // From the cursor on the near plane to the far plane
+    ViewProjectionMatrices matrices = camera->getViewProjectionMatrices(swapChainExtent.width, swapChainExtent.height);
+    glm::mat4 inverseViewProjection = glm::inverse(matrices.proj * matrices.view);
+    glm::vec2 ndc = glm::vec2(xpos / width, ypos / height) * 2.0f - 1.0f;
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, 0.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 end = glm::vec3(farPoint) / farPoint.w;
+
+    pickedRenderObject = -1;
+
+    SceneBvhHit hit;
+    if (sceneBvh.raycast(origin, glm::normalize(end - origin), glm::length(end - origin), hit))
+    {
+        const DrawListEntry& entry = drawList.getEntries()[hit.entry];
+        pickedRenderObject = static_cast<int32_t>(entry.renderObjectIndex);
+        pickedMesh = entry.meshIndex;
+        pickedDistance = hit.distance;
+    }
 }
 
 void TriangleRenderer::cursor_position_callback_extended(GLFWwindow* window, double xpos, double ypos)
@@ -711,13 +1351,184 @@ void TriangleRenderer::cursor_position_callback_extended(GLFWwindow* window, dou
 
 void TriangleRenderer::revoxelize(int resolution)
 {
-    if (resolution != voxelizer->voxelsPerSide)
+    if (resolution == voxelizer->voxelsPerSide && voxelizer->isVoxelTextureResident())
+        return;
+
+    vkDeviceWaitIdle(device);
+    voxelizer.reset();
+    destroyGraphicsPipeline();
+    helper->residency->requestDefragmentation();
+
+    // Everything evictable is gone when this fails, so settle for a coarser grid
+    while (true)
     {
-        vkDeviceWaitIdle(device);
-        voxelizer.reset();
-        vkDestroyPipeline(device, graphicsPipeline, nullptr);
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-        voxelizer = std::make_shared<GeometryVoxelizer>(helper, resolution, corner1, corner2);
-        createGraphicsPipeline();
+        try
+        {
+            voxelizer = std::make_shared<GeometryVoxelizer>(helper, resolution, corner1, corner2);
+            break;
+        }
+        catch (const std::runtime_error& e)
+        {
+            if (resolution <= minVoxelResolution)
+                throw;
+
+            std::cerr << "Failed to create a " << resolution << " voxel grid: " << e.what() << ", falling back to " << resolution / 2 << std::endl;
+            resolution /= 2;
+        }
     }
-}
\ No newline at end of file
+
+    createGraphicsPipeline();
+    staticPassCache->invalidate();
+}
+
+const MeshLod& TriangleRenderer::selectMainPassLod(RenderObject& renderObject, const Mesh& mesh)
+{
+    if (!enableMeshLods)
+        return mesh.lods[0];
+
+    glm::vec3 center = glm::vec3(renderObject.getModelMatrix() * glm::vec4(mesh.boundingSphereCenter, 1.0f));
+    float radius = mesh.boundingSphereRadius * renderObject.getScale();
+    float distance = glm::length(center - camera->position) - radius;
+
+    if (distance <= 0.0f)
+        return mesh.lods[0];
+
+    // Model space error that projects to lodErrorThreshold pixels at the nearest point of the bounding sphere
+    float pixelsPerUnit = static_cast<float>(swapChainExtent.height) / (2.0f * std::tan(glm::radians(camera->fovY) * 0.5f) * distance);
+    return mesh.selectLod(lodErrorThreshold / (pixelsPerUnit * renderObject.getScale()));
+}
+
+const MeshLod& TriangleRenderer::selectVoxelizationLod(RenderObject& renderObject, const Mesh& mesh)
+{
+    if (!enableMeshLods)
+        return mesh.lods[0];
+
+    // Geometry detail below the voxel size does not change the grid
+    return mesh.selectLod(voxelLodErrorThreshold * voxelizer->voxelWidth / renderObject.getScale());
+}
+
+bool TriangleRenderer::useMeshletCulling()
+{
+    return enableMeshletCulling && meshletCuller;
+}
+
+bool TriangleRenderer::useMeshShaderPath()
+{
+    return useMeshletCulling() && meshletCuller->useMeshShaders && meshletGraphicsPipeline != VK_NULL_HANDLE;
+}
+
+bool TriangleRenderer::useGpuCulling()
+{
+    return enableGpuCulling && drawCuller && !useMeshletCulling();
+}
+
+bool TriangleRenderer::useOcclusionCulling()
+{
+    return useGpuCulling() && drawCuller->occlusionCulling;
+}
+
+bool TriangleRenderer::useDeferredShading()
+{
+    return enableDeferredShading && !useMeshShaderPath();
+}
+
+void TriangleRenderer::updateModels()
+{
+    for (auto it = retiredMeshletCullers.begin(); it != retiredMeshletCullers.end();)
+    {
+        if (--it->second == 0)
+            it = retiredMeshletCullers.erase(it);
+        else
+            ++it;
+    }
+
+    bool renderObjectsChanged = false;
+
+    if (!sceneComplete)
+    {
+        bool complete = true;
+        for (auto& model : models)
+        {
+            complete = model->update(modelUploadsPerFrame) && complete;
+        }
+
+        sceneComplete = complete;
+        renderObjectsChanged = complete;
+    }
+
+    if (sceneStreamer && sceneStreamer->update(camera->position, glm::min(glm::vec3(corner1), glm::vec3(corner2)), glm::max(glm::vec3(corner1), glm::vec3(corner2))))
+    {
+        const auto& streamedRenderObjects = sceneStreamer->getRenderObjects();
+        renderObjects.resize(staticRenderObjectCount);
+        renderObjects.insert(renderObjects.end(), streamedRenderObjects.begin(), streamedRenderObjects.end());
+        renderObjectsChanged = true;
+    }
+
+    if (renderObjectsChanged)
+    {
+        meshletCullerDirty = true;
+        drawListDirty = true;
+    }
+}
+
+void TriangleRenderer::makeSceneResident()
+{
+    // Relocations are uploads too, so they wait for frames where nothing else is loading
+    bool loading = !sceneComplete || textureStreamer->getLoadingCount() > 0 || (sceneStreamer && sceneStreamer->getLoadingCellCount() > 0);
+    if (!loading)
+        helper->residency->defragment();
+
+    // Everything restored and marked here is safe from eviction until the frame is recorded
+    for (auto& renderObject : renderObjects)
+    {
+        if (renderObject->model->makeResident())
+        {
+            meshletCullerDirty = true;
+            drawListDirty = true;
+        }
+    }
+
+    if (!voxelizer->isVoxelTextureResident())
+        revoxelize(voxelizer->voxelsPerSide);
+    helper->residency->markUsed(voxelizer->residencyHandle);
+
+    // The culler's draw slots and descriptor sets are built from the render objects' mesh buffers, so it is rebuilt
+    // whenever they change. The old one is kept until the frames in flight are done with it.
+    if (meshletCullerDirty && sceneComplete)
+    {
+        if (meshletCuller)
+            retiredMeshletCullers.emplace_back(std::move(meshletCuller), MAX_FRAMES_IN_FLIGHT + 1);
+
+        meshletCuller = std::make_unique<MeshletCuller>(helper, renderObjects);
+        meshletCullerDirty = false;
+        staticPassCache->invalidate();
+    }
+
+    // Loading models gain meshes every frame
+    if (drawListDirty || !sceneComplete)
+    {
+        drawList.build(renderObjects);
+        drawListDirty = false;
+    }
+}
+
+void TriangleRenderer::cullMeshlets(MeshletCullingPass pass, uint32_t currentFrame)
+{
+    meshletCuller->beginCulling(commandBuffers[currentFrame], pass, currentFrame);
+    const std::vector<DrawListEntry>& entries = drawList.getEntries();
+    for (uint32_t i = 0; i < entries.size(); i++)
+    {
+        const DrawListEntry& entry = entries[i];
+
+        // Skipped slots keep the template's empty command
+        if (pass == MESHLET_CULLING_MAIN_PASS && !softwareOcclusionCuller.isVisible(i))
+            continue;
+        if (pass == MESHLET_CULLING_SHADOW_PASS && !shadowCasterCuller.isVisible(i))
+            continue;
+
+        // The shadow pass keeps full detail
+        const MeshLod& lod = pass == MESHLET_CULLING_MAIN_PASS ? selectMainPassLod(*entry.renderObject, *entry.mesh) : entry.mesh->lods[0];
+        meshletCuller->cullMesh(commandBuffers[currentFrame], entry.renderObjectIndex, entry.meshIndex, *entry.renderObject, *entry.mesh, lod);
+    }
+    meshletCuller->endCulling(commandBuffers[currentFrame]);
+}
@@ -0,0 +1,102 @@
+#include "VoxelizationCuller.h"
+
+#include <algorithm>
+
+void VoxelizationCuller::cull(const DrawList& drawList, const SceneBvh& bvh, const glm::vec3& gridMin, const glm::vec3& gridMax)
+{
+    this->gridMin = gridMin;
+    this->gridMax = gridMax;
+
+    uint32_t entryCount = static_cast<uint32_t>(drawList.getEntries().size());
+    culledCount = 0;
+    splitCount = 0;
+    culledTriangleCount = 0;
+
+    if (!enabled)
+    {
+        overlaps.assign(entryCount, OVERLAP_INSIDE);
+        return;
+    }
+
+    overlaps.assign(entryCount, OVERLAP_NONE);
+
+    entries.clear();
+    bvh.queryBox(gridMin, gridMax, entries);
+    for (uint32_t entry : entries)
+    {
+        bool inside = glm::all(glm::greaterThanEqual(bvh.getEntryBoundsMin(entry), gridMin)) && glm::all(glm::lessThanEqual(bvh.getEntryBoundsMax(entry), gridMax));
+        overlaps[entry] = inside || !clusterCulling ? OVERLAP_INSIDE : OVERLAP_PARTIAL;
+        splitCount += overlaps[entry] == OVERLAP_PARTIAL;
+    }
+
+    culledCount = entryCount - static_cast<uint32_t>(entries.size());
+}
+
+void VoxelizationCuller::addCommands(DrawBatch& drawBatch, uint32_t entry, const DrawListEntry& drawListEntry, const MeshLod& lod)
+{
+    if (overlaps[entry] == OVERLAP_NONE)
+        return;
+
+    const Mesh& mesh = *drawListEntry.mesh;
+    if (overlaps[entry] == OVERLAP_INSIDE || lod.meshletCount == 0)
+    {
+        drawBatch.addCommand(DRAW_BATCH_VOXELIZATION_PASS, drawListEntry.drawIndex, mesh, lod);
+        return;
+    }
+
+    const glm::mat4& model = drawListEntry.renderObject->getModelMatrix();
+    float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    uint32_t firstTriangle = mesh.meshlets[lod.meshletOffset].triangleOffset;
+
+    // Consecutive meshlets touching the grid, in triangles of the level
+    uint32_t runStart = 0;
+    uint32_t runCount = 0;
+    auto flush = [&]()
+    {
+        if (runCount == 0)
+            return;
+
+        MeshLod range = lod;
+        range.firstIndex = lod.firstIndex + runStart * 3;
+        range.indexCount = runCount * 3;
+        drawBatch.addCommand(DRAW_BATCH_VOXELIZATION_PASS, drawListEntry.drawIndex, mesh, range);
+        runCount = 0;
+    };
+
+    for (uint32_t i = lod.meshletOffset; i < lod.meshletOffset + lod.meshletCount; i++)
+    {
+        const Meshlet& meshlet = mesh.meshlets[i];
+
+        glm::vec3 center = glm::vec3(model * glm::vec4(glm::vec3(meshlet.boundingSphere), 1.0f));
+        float radius = meshlet.boundingSphere.w * scale;
+        glm::vec3 offset = center - glm::clamp(center, gridMin, gridMax);
+
+        if (glm::dot(offset, offset) > radius * radius)
+        {
+            flush();
+            culledTriangleCount += meshlet.triangleCount;
+            continue;
+        }
+
+        if (runCount == 0)
+            runStart = meshlet.triangleOffset - firstTriangle;
+        runCount += meshlet.triangleCount;
+    }
+
+    flush();
+}
+
+uint32_t VoxelizationCuller::getCulledCount() const
+{
+    return culledCount;
+}
+
+uint32_t VoxelizationCuller::getSplitCount() const
+{
+    return splitCount;
+}
+
+uint32_t VoxelizationCuller::getCulledTriangleCount() const
+{
+    return culledTriangleCount;
+}
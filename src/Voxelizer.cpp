@@ -1,5 +1,7 @@
 #include "Voxelizer.h"
 
+#include <algorithm>
+
 Voxelizer::Voxelizer(std::shared_ptr<Helper> helper, uint32_t voxelsPerSide, glm::vec4 corner1, glm::vec4 corner2):
 	helper(helper), voxelsPerSide(voxelsPerSide), aabbMin(glm::vec4(0.0f)), aabbMax(glm::vec4(0.0f)), center(glm::vec3(0.0f))
 {
@@ -21,6 +23,15 @@ Voxelizer::Voxelizer(std::shared_ptr<Helper> helper, uint32_t voxelsPerSide, glm
 		helper->setNameOfObject(VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t)voxelTextureMipViews[i], "Voxel Texture Mip View level" + std::to_string(i));
 	}
 
+	residencyHandle = helper->residency->add("Voxel Texture", RESIDENCY_PRIORITY_REGENERABLE, getVoxelTextureSize(), [this]() -> VkDeviceSize
+	{
+		if (!isVoxelTextureResident())
+			return 0;
+
+		destroyVoxelTexture();
+		return getVoxelTextureSize();
+	});
+
 	// Generate a unit cube from (0, 0, 0) to (1.0, 1.0, 1.0) in unitCubeVertices and unitCubeIndices
 	unitCubeVertices = {
 		{{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
@@ -81,17 +92,12 @@ Voxelizer::Voxelizer(std::shared_ptr<Helper> helper, uint32_t voxelsPerSide, glm
 
 Voxelizer::~Voxelizer()
 {
+	helper->residency->remove(residencyHandle);
+
 	vkDestroyDescriptorSetLayout(helper->device, voxelGridDescriptorSetLayout, nullptr);
 	vkDestroyDescriptorSetLayout(helper->device, voxelTextureDescriptorSetLayout, nullptr);
 
-	vkDestroyImageView(helper->device, voxelTextureView, nullptr);
-	vkDestroyImage(helper->device, voxelTexture, nullptr);
-	vkFreeMemory(helper->device, voxelTextureMemory, nullptr);
-
-	for (auto mipView : voxelTextureMipViews)
-	{
-		vkDestroyImageView(helper->device, mipView, nullptr);
-	}
+	destroyVoxelTexture();
 
 	for (size_t i = 0; i < helper->MAX_FRAMES_IN_FLIGHT; i++)
 	{
@@ -146,6 +152,39 @@ Voxelizer::~Voxelizer()
 	vkDestroyDescriptorSetLayout(helper->device, noiseTextureDescriptorSetLayout, nullptr);
 }
 
+bool Voxelizer::isVoxelTextureResident() const
+{
+	return voxelTexture != VK_NULL_HANDLE;
+}
+
+VkDeviceSize Voxelizer::getVoxelTextureSize() const
+{
+	VkDeviceSize size = 0;
+	for (uint32_t i = 0; i < mipLevelCount; i++)
+	{
+		VkDeviceSize side = std::max(1u, voxelsPerSide >> i);
+		size += side * side * side * 4;
+	}
+	return size;
+}
+
+void Voxelizer::destroyVoxelTexture()
+{
+	for (auto mipView : voxelTextureMipViews)
+	{
+		vkDestroyImageView(helper->device, mipView, nullptr);
+	}
+	voxelTextureMipViews.clear();
+
+	vkDestroyImageView(helper->device, voxelTextureView, nullptr);
+	vkDestroyImage(helper->device, voxelTexture, nullptr);
+	vkFreeMemory(helper->device, voxelTextureMemory, nullptr);
+
+	voxelTextureView = VK_NULL_HANDLE;
+	voxelTexture = VK_NULL_HANDLE;
+	voxelTextureMemory = VK_NULL_HANDLE;
+}
+
 void Voxelizer::calculateAABBMinMaxCenter(glm::vec4 corner1, glm::vec4 corner2)
 {
 	glm::vec4 center4 = (corner1 + corner2) / 2.0f;
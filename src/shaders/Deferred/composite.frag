@@ -0,0 +1,11 @@
+#version 450
+
+// Output of deferredShading.comp, the same size as the swap chain
+layout(set = 0, binding = 0) uniform sampler2D shadedImage;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+	outColor = texelFetch(shadedImage, ivec2(gl_FragCoord.xy), 0);
+}
@@ -0,0 +1,158 @@
+// Shared by the deferred shading and reduced resolution ambient occlusion compute shaders
+
+#define TILE_SIZE 8
+
+layout(set = 0, binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+	vec4 cameraPosition;
+} ubo;
+
+layout (set = 0, binding = 1) uniform LightsUBO {	
+    vec4 direction;
+} lights;
+
+layout (set = 0, binding = 2) uniform LightSpaceMatrix {	
+    mat4 matrix;
+} lightSpaceMatrix;
+
+layout(set = 1, binding = 0) uniform sampler2D albedoImage;
+layout(set = 1, binding = 1) uniform sampler2D normalImage;
+layout(set = 1, binding = 2) uniform sampler2D depthImage;
+layout(set = 1, binding = 3, rgba8) uniform writeonly image2D shadedImage;
+// Reduced resolution occlusion, half the size of the shaded image
+layout(set = 1, binding = 4, r32f) uniform image2D ambientOcclusionImage;
+
+layout(set = 3, binding = 0, rgba8) uniform image3D voxelTexture[];
+
+layout (set = 4, binding = 1) uniform voxelGridUBO{
+	vec4 aabb_min;
+	vec4 aabb_max;
+} voxelGrid;
+
+layout( push_constant ) uniform constants{
+	mat4 inverseViewProjection;
+	float occlusionDecayFactor;
+	bool ambientOcclusionEnabled;
+	bool visualizeOcclusion;
+	float surfaceOffset;
+	float coneCutoff;
+	// 1 traces cones for every pixel, 2 and 4 once per block of that many pixels on a side
+	uint ambientOcclusionScale;
+} PushConstants;
+
+vec3 reconstructPosition(ivec2 pixel, float depth)
+{
+	vec2 size = vec2(imageSize(shadedImage));
+	vec4 ndc = vec4((vec2(pixel) + 0.5) / size * 2.0 - 1.0, depth, 1.0);
+	vec4 world = PushConstants.inverseViewProjection * ndc;
+	return world.xyz / world.w;
+}
+
+ivec2 getAmbientOcclusionSize()
+{
+	int scale = int(PushConstants.ambientOcclusionScale);
+	return (imageSize(shadedImage) + scale - 1) / scale;
+}
+
+// Full resolution pixel a reduced resolution texel is traced from, the middle of its block
+ivec2 getAmbientOcclusionSource(ivec2 texel)
+{
+	int scale = int(PushConstants.ambientOcclusionScale);
+	return min(texel * scale + scale / 2, imageSize(shadedImage) - 1);
+}
+
+float calculateVoxelWidth(int mipLevel)
+{
+	return (voxelGrid.aabb_max.x - voxelGrid.aabb_min.x) / float(imageSize(voxelTexture[mipLevel]).x);
+}
+
+uint hash( uint x ) {
+    x += ( x << 10u );
+    x ^= ( x >>  6u );
+    x += ( x <<  3u );
+    x ^= ( x >> 11u );
+    x += ( x << 15u );
+    return x;
+}
+
+uint hash( uvec3 v ) {
+    return hash( v.x ^ hash(v.y) ^ hash(v.z) );
+}
+
+float random( vec3 f ) {
+    const uint mantissaMask = 0x007FFFFFu;
+    const uint one          = 0x3F800000u;
+   
+    uint h = hash(uvec3(floatBitsToUint(f.x), floatBitsToUint(f.y), floatBitsToUint(f.z)));
+    h &= mantissaMask;
+    h |= one;
+    
+    float  r2 = uintBitsToFloat( h );
+    return r2 - 1.0;
+}
+
+// fragCoord is what gl_FragCoord was for the pixel in the main pass, so the cones match main.frag's
+float calculateAmbientOcclusion(vec3 fragPosition, vec3 normal, vec3 fragCoord){
+
+	if(dot(normal, ubo.cameraPosition.xyz - fragPosition) < 0) 
+		normal = -normal;
+	
+	vec3 position = fragPosition + normal * PushConstants.surfaceOffset;
+
+	#define CONE_COUNT 7
+	#define CONE_HALF_ANGLE 45.0
+
+	vec3 directions[CONE_COUNT];
+	directions[0] = normal;
+
+	for(uint i = 1; i < CONE_COUNT; i++)
+	{
+		directions[i] = vec3(random(vec3(fragCoord.x, i, directions[i-1].x)), random(vec3(fragCoord.y, i, directions[i-1].y)), random(vec3(fragCoord.z, i, directions[i-1].z)));
+		directions[i] *= 2.0;
+		directions[i] -= vec3(1.0);
+		directions[i] = normalize(directions[i]);
+
+		if(dot(normal, directions[i]) < 0.0)
+		{
+			directions[i] = -directions[i];
+		}
+	}
+
+	float occlusion = 0.0f;
+
+	for(int i = 0; i < CONE_COUNT; i++)
+	{
+		int currentMipLevel = 0;
+		float voxelWidth = calculateVoxelWidth(currentMipLevel);
+
+		vec3 sampleLocation = position + directions[i] * voxelWidth * 1.75;
+
+		float sampleLength = length(sampleLocation - position);
+		float radius = sampleLength * tan(radians(CONE_HALF_ANGLE));
+		float coneOcclusion = 0.0f;
+
+		while(sampleLength < PushConstants.coneCutoff)
+		{
+			if(radius > voxelWidth){
+				currentMipLevel++;
+				voxelWidth = calculateVoxelWidth(currentMipLevel);
+			}
+
+			ivec3 voxelCoord = ivec3((sampleLocation - voxelGrid.aabb_min.xyz) / voxelWidth);
+			float currentOcclusion = imageLoad(voxelTexture[currentMipLevel], voxelCoord).w;
+			currentOcclusion += (1.0 / (1.0 + PushConstants.occlusionDecayFactor * sampleLength)) * currentOcclusion;
+			coneOcclusion = coneOcclusion + (1 - coneOcclusion) * currentOcclusion;
+
+			sampleLocation += directions[i] * voxelWidth;
+			sampleLength = length(sampleLocation - position);
+			radius = sampleLength * tan(radians(CONE_HALF_ANGLE));
+
+		}
+
+		occlusion += coneOcclusion;
+	}
+	
+	return occlusion / 4.0;
+
+}
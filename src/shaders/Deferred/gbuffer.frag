@@ -0,0 +1,39 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) in vec3 fragPosition;
+layout(location = 2) in vec3 fragNormal;
+layout(location = 3) flat in uint fragDrawIndex;
+
+struct DrawData {
+	uint transformIndex;
+	uint textureIndex;
+	uint textureFeedbackSlot;
+	uint textureBaseMip;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer DrawDataBuffer {
+	DrawData draws[];
+};
+
+// Every material texture of the frame, see DrawBatch
+layout(set = 1, binding = 1) uniform sampler2D textures[];
+
+#include "../main/textureFeedback.glsl"
+
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal;
+
+void main()
+{
+	DrawData draw = draws[fragDrawIndex];
+	uint textureIndex = draw.textureIndex;
+
+	writeTextureFeedback(draw, fragTexCoord);
+
+	outAlbedo = vec4(texture(textures[nonuniformEXT(textureIndex)], fragTexCoord).xyz, 1.0);
+	outNormal = vec4(normalize(fragNormal), 0.0);
+}
@@ -1,8 +1,11 @@
 #version 450
 
+#extension GL_EXT_nonuniform_qualifier : require
+
 layout (location = 0) in vec3 FS_IN_FragPos;
 layout (location = 1) in vec3 FS_IN_Normal;
 layout (location = 2) in vec2 FS_IN_Texcoord;
+layout (location = 3) flat in uint FS_IN_DrawIndex;
 
 layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 view;
@@ -14,7 +17,18 @@ layout (set = 0, binding = 1) uniform voxelGridUBO{
 	vec4 aabb_max;
 } voxelGrid;
 
-layout(set = 1, binding = 0) uniform sampler2D diffuseTexture;
+struct DrawData {
+	uint transformIndex;
+	uint textureIndex;
+	uint textureFeedbackSlot;
+	uint textureBaseMip;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer DrawDataBuffer {
+	DrawData draws[];
+};
+
+layout(set = 1, binding = 1) uniform sampler2D textures[];
 
 layout(set = 2, binding = 0, rgba8) uniform image3D voxelTexture;
 
@@ -31,7 +45,7 @@ void main()
 	float voxel_width = (_max.x - _min.x) / float(voxels_per_side);
 	ivec3 voxel_coordinate = ivec3((FS_IN_FragPos - _min) / voxel_width);
 
-	vec3 diffuse = texture(diffuseTexture, FS_IN_Texcoord).xyz;
+	vec3 diffuse = texture(textures[nonuniformEXT(draws[FS_IN_DrawIndex].textureIndex)], FS_IN_Texcoord).xyz;
 	const vec4 current_voxel_value = imageLoad(voxelTexture, voxel_coordinate);
 	const vec4 voxel_value = vec4(diffuse, 1.0);
 
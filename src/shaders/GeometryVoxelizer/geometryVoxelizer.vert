@@ -7,10 +7,28 @@ layout(location = 2) in vec2 inTexCoord;
 layout (location = 0) out vec3 GS_IN_FragPos;
 layout (location = 1) out vec3 GS_IN_Normal;
 layout (location = 2) out vec2 GS_IN_Texcoord;
+layout (location = 3) flat out uint GS_IN_DrawIndex;
 
-layout( push_constant ) uniform constants{
-	mat4 model;
-} pc;
+struct DrawData {
+	uint transformIndex;
+	uint textureIndex;
+	uint textureFeedbackSlot;
+	uint textureBaseMip;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer DrawDataBuffer {
+	DrawData draws[];
+};
+
+// Draw index of every instance, see DrawBatch
+layout(std430, set = 1, binding = 2) readonly buffer InstanceBuffer {
+	uint instanceDrawIndices[];
+};
+
+// World matrices, see TransformSystem
+layout(std430, set = 1, binding = 3) readonly buffer TransformBuffer {
+	mat4 transforms[];
+};
 
 layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 view;
@@ -20,18 +38,21 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
 void main() 
 {
     // Transform position into world space
-	vec4 world_pos = pc.model * vec4(inPosition, 1.0);
+	uint drawIndex = instanceDrawIndices[gl_InstanceIndex];
+	mat4 model = transforms[draws[drawIndex].transformIndex];
+	vec4 world_pos = model * vec4(inPosition, 1.0);
 
     // Pass world position into Fragment shader
     GS_IN_FragPos = world_pos.xyz;
 
     GS_IN_Texcoord = inTexCoord;
+    GS_IN_DrawIndex = drawIndex;
 
     // Transform world position into clip space
 	gl_Position = ubo.proj * ubo.view * world_pos;
 	
     // Transform vertex normal into world space
-    mat3 normal_mat = mat3(pc.model);
+    mat3 normal_mat = mat3(model);
 
 	GS_IN_Normal = normal_mat * inNormal;
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+// Shared by the meshlet culling compute shader and the task/mesh shaders.
+// MESHLET_SET and CULLING_SET have to be defined before including this file.
+
+struct Meshlet
+{
+    vec4 boundingSphere;
+    vec4 cone;
+    uint vertexOffset;
+    uint triangleOffset;
+    uint vertexCount;
+    uint triangleCount;
+};
+
+struct TaskPayload
+{
+    uint meshletIndices[32];
+};
+
+layout(std430, set = MESHLET_SET, binding = 0) readonly buffer VertexBuffer {
+    float vertexData[];
+};
+
+layout(std430, set = MESHLET_SET, binding = 1) readonly buffer MeshletBuffer {
+    Meshlet meshlets[];
+};
+
+layout(std430, set = MESHLET_SET, binding = 2) readonly buffer MeshletVertexBuffer {
+    uint meshletVertices[];
+};
+
+layout(std430, set = MESHLET_SET, binding = 3) readonly buffer MeshletTriangleBuffer {
+    uint meshletTriangles[];
+};
+
+layout(set = CULLING_SET, binding = 0) uniform MeshletCullingUBO {
+    vec4 frustumPlanes[6];
+    vec4 viewPosition;
+    vec4 viewDirection;
+} culling;
+
+// Vertex is pos, normal, texCoord packed as 8 floats
+const uint VERTEX_STRIDE = 8;
+
+vec3 loadPosition(uint vertexIndex)
+{
+    uint base = vertexIndex * VERTEX_STRIDE;
+    return vec3(vertexData[base + 0], vertexData[base + 1], vertexData[base + 2]);
+}
+
+vec3 loadNormal(uint vertexIndex)
+{
+    uint base = vertexIndex * VERTEX_STRIDE;
+    return vec3(vertexData[base + 3], vertexData[base + 4], vertexData[base + 5]);
+}
+
+vec2 loadTexCoord(uint vertexIndex)
+{
+    uint base = vertexIndex * VERTEX_STRIDE;
+    return vec2(vertexData[base + 6], vertexData[base + 7]);
+}
+
+uvec3 unpackTriangle(uint packedTriangle)
+{
+    return uvec3(packedTriangle & 0xFF, (packedTriangle >> 8) & 0xFF, (packedTriangle >> 16) & 0xFF);
+}
+
+bool isMeshletVisible(Meshlet meshlet, mat4 model, float scale)
+{
+    vec3 center = (model * vec4(meshlet.boundingSphere.xyz, 1.0)).xyz;
+    float radius = meshlet.boundingSphere.w * scale;
+
+    for (int i = 0; i < 6; i++)
+    {
+        if (dot(culling.frustumPlanes[i].xyz, center) + culling.frustumPlanes[i].w < -radius)
+            return false;
+    }
+
+    // A cutoff of 1 marks clusters whose normals spread too far to ever be entirely backfacing
+    if (meshlet.cone.w < 1.0)
+    {
+        vec3 axis = normalize(mat3(model) * meshlet.cone.xyz);
+
+        if (culling.viewDirection.w > 0.5)
+        {
+            if (dot(culling.viewDirection.xyz, axis) >= meshlet.cone.w)
+                return false;
+        }
+        else
+        {
+            vec3 toCenter = center - culling.viewPosition.xyz;
+            if (dot(toCenter, axis) >= meshlet.cone.w * length(toCenter) + radius)
+                return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,34 @@
+// Task stage shared by the main and shadow meshlet pipelines. Each invocation culls one meshlet and the
+// visible ones are compacted into the payload, one mesh workgroup each.
+
+layout(local_size_x = 32) in;
+
+layout(push_constant) uniform constants {
+    mat4 model;
+    layout(offset = 96) uint meshletOffset;
+    uint meshletCount;
+    float scale;
+} pc;
+
+taskPayloadSharedEXT TaskPayload payload;
+
+shared uint visibleCount;
+
+void main()
+{
+    if (gl_LocalInvocationIndex == 0)
+        visibleCount = 0;
+
+    barrier();
+
+    uint meshletIndex = gl_GlobalInvocationID.x;
+    if (meshletIndex < pc.meshletCount && isMeshletVisible(meshlets[pc.meshletOffset + meshletIndex], pc.model, pc.scale))
+    {
+        uint slot = atomicAdd(visibleCount, 1);
+        payload.meshletIndices[slot] = pc.meshletOffset + meshletIndex;
+    }
+
+    barrier();
+
+    EmitMeshTasksEXT(visibleCount, 1, 1);
+}
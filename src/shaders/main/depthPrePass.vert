@@ -0,0 +1,42 @@
+#version 450
+
+// Writes the depth main.vert produces for the same draws, so the main pass can shade with an equal depth test
+layout(set = 0, binding = 0) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+} ubo;
+
+struct DrawData {
+	uint transformIndex;
+	uint textureIndex;
+	uint textureFeedbackSlot;
+	uint textureBaseMip;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer DrawDataBuffer {
+	DrawData draws[];
+};
+
+// Draw index of every instance, see DrawBatch
+layout(std430, set = 1, binding = 2) readonly buffer InstanceBuffer {
+	uint instanceDrawIndices[];
+};
+
+// World matrices, see TransformSystem
+layout(std430, set = 1, binding = 3) readonly buffer TransformBuffer {
+	mat4 transforms[];
+};
+
+layout(location = 0) in vec3 inPosition;
+
+invariant gl_Position;
+
+void main() {
+
+    uint drawIndex = instanceDrawIndices[gl_InstanceIndex];
+    mat4 model = transforms[draws[drawIndex].transformIndex];
+
+    vec4 world_pos = model * vec4(inPosition, 1.0);
+
+    gl_Position = ubo.proj * ubo.view * world_pos;
+}
@@ -7,6 +7,7 @@
 layout(location = 0) in vec2 fragTexCoord;
 layout(location = 1) in vec3 fragPosition;
 layout(location = 2) in vec3 fragNormal;
+layout(location = 3) flat in uint fragDrawIndex;
 
 layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 view;
@@ -22,7 +23,21 @@ layout (set = 0, binding = 2) uniform LightSpaceMatrix {
     mat4 matrix;
 } lightSpaceMatrix;
 
-layout(set = 1, binding = 0) uniform sampler2D diffuseTexture;
+struct DrawData {
+	uint transformIndex;
+	uint textureIndex;
+	uint textureFeedbackSlot;
+	uint textureBaseMip;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer DrawDataBuffer {
+	DrawData draws[];
+};
+
+// Every material texture of the frame, see DrawBatch
+layout(set = 1, binding = 1) uniform sampler2D textures[];
+
+#include "textureFeedback.glsl"
 
 layout(set = 2, binding = 0) uniform sampler2D shadow_map;
 
@@ -245,7 +260,12 @@ void main()
 
 	float lambert = max(0.0f, dot(n, -light_dir));
 
-    vec3 diffuse = texture(diffuseTexture, fragTexCoord).xyz;
+	DrawData draw = draws[fragDrawIndex];
+	uint textureIndex = draw.textureIndex;
+
+    vec3 diffuse = texture(textures[nonuniformEXT(textureIndex)], fragTexCoord).xyz;
+
+	writeTextureFeedback(draw, fragTexCoord);
 	vec3 ambient = diffuse * ambient;
 
 	vec4 FragPosLightSpace = lightSpaceMatrix.matrix * vec4(fragPosition, 1.0);
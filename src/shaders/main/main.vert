@@ -5,9 +5,26 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 proj;
 } ubo;
 
-layout( push_constant ) uniform constants{
-	mat4 model;
-} PushConstants;
+struct DrawData {
+	uint transformIndex;
+	uint textureIndex;
+	uint textureFeedbackSlot;
+	uint textureBaseMip;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer DrawDataBuffer {
+	DrawData draws[];
+};
+
+// Draw index of every instance, see DrawBatch
+layout(std430, set = 1, binding = 2) readonly buffer InstanceBuffer {
+	uint instanceDrawIndices[];
+};
+
+// World matrices, see TransformSystem
+layout(std430, set = 1, binding = 3) readonly buffer TransformBuffer {
+	mat4 transforms[];
+};
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
@@ -16,13 +33,21 @@ layout(location = 2) in vec2 inTexCoord;
 layout(location = 0) out vec2 fragTexCoord;
 layout(location = 1) out vec3 fragPosition;
 layout(location = 2) out vec3 fragNormal;
+layout(location = 3) flat out uint fragDrawIndex;
+
+// Has to match depthPrePass.vert exactly for the equal depth test
+invariant gl_Position;
 
 void main() {
 
-    vec4 world_pos = PushConstants.model * vec4(inPosition, 1.0);
+    uint drawIndex = instanceDrawIndices[gl_InstanceIndex];
+    mat4 model = transforms[draws[drawIndex].transformIndex];
+
+    vec4 world_pos = model * vec4(inPosition, 1.0);
     fragPosition = world_pos.xyz;
     fragTexCoord = inTexCoord;
-    fragNormal = mat3(PushConstants.model) * inNormal.xyz;
+    fragNormal = mat3(model) * inNormal.xyz;
+    fragDrawIndex = drawIndex;
 
-    gl_Position = ubo.proj * ubo.view * PushConstants.model * vec4(inPosition, 1.0);
+    gl_Position = ubo.proj * ubo.view * world_pos;
 }
\ No newline at end of file
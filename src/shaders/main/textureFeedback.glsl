@@ -0,0 +1,18 @@
+// Shared by main.frag and the deferred G-buffer pass. DrawData and the textures array have to be declared before
+// including this file.
+
+// Finest full resolution mip level requested per streamed texture, read back by the TextureStreamer
+layout (set = 0, binding = 3) buffer TextureFeedback {
+	uint requestedMip[];
+} textureFeedback;
+
+// Has to be called from uniform control flow, the level is queried with the derivatives of the whole quad. One pixel
+// in 64 is enough to find the finest level a texture needs.
+void writeTextureFeedback(DrawData draw, vec2 texCoord)
+{
+	float lod = max(textureQueryLod(textures[nonuniformEXT(draw.textureIndex)], texCoord).y, 0.0);
+	if (draw.textureFeedbackSlot != 0xFFFFFFFFu && ((uint(gl_FragCoord.x) | uint(gl_FragCoord.y)) & 7u) == 0u)
+	{
+		atomicMin(textureFeedback.requestedMip[draw.textureFeedbackSlot], uint(lod) + draw.textureBaseMip);
+	}
+}
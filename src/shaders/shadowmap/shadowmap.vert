@@ -8,9 +8,26 @@ layout (location = 0) out vec3 FS_IN_FragPos;
 layout (location = 1) out vec2 FS_IN_Texcoord;
 layout (location = 2) out vec3 FS_IN_Normal;
 
-layout( push_constant ) uniform constants{
-	mat4 model;
-} pc;
+struct DrawData {
+	uint transformIndex;
+	uint textureIndex;
+	uint textureFeedbackSlot;
+	uint textureBaseMip;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer DrawDataBuffer {
+	DrawData draws[];
+};
+
+// Draw index of every instance, see DrawBatch
+layout(std430, set = 1, binding = 2) readonly buffer InstanceBuffer {
+	uint instanceDrawIndices[];
+};
+
+// World matrices, see TransformSystem
+layout(std430, set = 1, binding = 3) readonly buffer TransformBuffer {
+	mat4 transforms[];
+};
 
 layout (set = 0, binding = 0) uniform PerFrameUBO {
 	mat4 view;
@@ -25,7 +42,8 @@ layout (set = 0, binding = 0) uniform PerFrameUBO {
 void main() 
 {
     // Transform position into world space
-	vec4 world_pos = pc.model * vec4(VS_IN_Position.xyz, 1.0);
+	mat4 model = transforms[draws[instanceDrawIndices[gl_InstanceIndex]].transformIndex];
+	vec4 world_pos = model * vec4(VS_IN_Position.xyz, 1.0);
 
     // Pass world position into Fragment shader
     FS_IN_FragPos = world_pos.xyz;
@@ -36,7 +54,7 @@ void main()
 	gl_Position = ubo.projection * ubo.view * world_pos;
 	
     // Transform vertex normal into world space
-    mat3 normal_mat = mat3(pc.model);
+    mat3 normal_mat = mat3(model);
 
 	FS_IN_Normal = normal_mat * VS_IN_Normal.xyz;
 }
\ No newline at end of file